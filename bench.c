@@ -0,0 +1,370 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <stdbool.h>
+#include "logger.h"
+#include "huff.h"
+
+/* 基準測試：histogram、建樹、canonical code、解碼表、編碼、解碼分開計時，
+ * 每個 corpus 每個階段重複 reps 次，取 median / p10 / p90。
+ * 結果以 JSON lines 寫到 stdout（一行一個 corpus×階段），進度 log 寫到 stderr。 */
+
+static double now_sec(void){
+    struct timespec ts;
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+/* ----------------- 可重現的 corpus 產生器 ----------------- */
+static uint64_t rng_next(uint64_t *s){     // splitmix64
+    uint64_t z = (*s += UINT64_C(0x9E3779B97F4A7C15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+static double rng_unit(uint64_t *s){ return (double)(rng_next(s) >> 11) * (1.0/9007199254740992.0); }
+
+/* 英文字母頻率近似的單字表，單字出現次數服從 Zipf(1) */
+static void gen_skewed(unsigned char *p, size_t n, uint64_t seed){
+    static const char letters[] = "eeeeeeeeeeeetttttttttaaaaaaaaooooooooiiiiiiinnnnnnnsssssshhhhhhrrrrrrddddlllluuucccmmmwwffggyyppbbvkjxqz";
+    enum { NWORDS = 2048 };
+    char words[NWORDS][12];
+    double cdf[NWORDS], sum = 0;
+    for (int w=0;w<NWORDS;w++) {
+        int L = 1 + (int)(rng_next(&seed) % 9);
+        for (int k=0;k<L;k++) words[w][k] = letters[rng_next(&seed) % (sizeof letters - 1)];
+        words[w][L] = '\0';
+        sum += 1.0/(w+1);
+        cdf[w] = sum;
+    }
+    size_t i = 0;
+    int in_line = 0;
+    while (i < n) {
+        double u = rng_unit(&seed) * sum;
+        int lo = 0, hi = NWORDS-1;
+        while (lo < hi) { int mid = (lo+hi)/2; if (cdf[mid] < u) lo = mid+1; else hi = mid; }
+        for (const char *c = words[lo]; *c && i < n; c++) p[i++] = (unsigned char)(in_line ? *c : (*c - 'a' + 'A'));
+        in_line++;
+        unsigned r = (unsigned)(rng_next(&seed) % 64);
+        if (i < n) p[i++] = r == 0 ? '.' : r == 1 ? ',' : (in_line > 12 && r < 8) ? '\n' : ' ';
+        if (i && p[i-1] == '\n') in_line = 0;
+    }
+}
+
+static void gen_uniform(unsigned char *p, size_t n, uint64_t seed){
+    for (size_t i=0;i<n;i++) p[i] = (unsigned char)rng_next(&seed);
+}
+
+static void gen_single(unsigned char *p, size_t n, uint64_t seed){
+    (void)seed;
+    memset(p, 'a', n);
+}
+
+/* 16-byte 紀錄：遞增序號、小整數狀態、帶雜訊的 16-bit 量測值、補 0 */
+static void gen_binary(unsigned char *p, size_t n, uint64_t seed){
+    uint32_t id = 1000;
+    int v = 20000;
+    for (size_t i=0;i<n;) {
+        unsigned char rec[16] = {0};
+        rec[0]=(unsigned char)id; rec[1]=(unsigned char)(id>>8); rec[2]=(unsigned char)(id>>16); rec[3]=(unsigned char)(id>>24);
+        rec[4] = (unsigned char)(rng_next(&seed) % 4);
+        v += (int)(rng_next(&seed) % 201) - 100;
+        rec[6]=(unsigned char)v; rec[7]=(unsigned char)(v>>8);
+        rec[8] = (unsigned char)(rng_next(&seed) % 16 == 0 ? 0xFF : 0);
+        id++;
+        for (int k=0;k<16 && i<n;k++) p[i++] = rec[k];
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*gen)(unsigned char *p, size_t n, uint64_t seed);
+} CorpusGen;
+
+static const CorpusGen GENS[] = {
+    { "skewed",  gen_skewed  },
+    { "uniform", gen_uniform },
+    { "single",  gen_single  },
+    { "binary",  gen_binary  },
+};
+#define NGENS ((int)(sizeof GENS / sizeof GENS[0]))
+
+/* ----------------- 計時與輸出 ----------------- */
+typedef struct {
+    const char *tag;
+    int reps;
+} BenchCfg;
+
+static int cmp_double(const void *A, const void *B){
+    double a = *(const double*)A, b = *(const double*)B;
+    return (a > b) - (a < b);
+}
+/* 最近排名法取百分位 */
+static double pct(const double *sorted, int n, int p){
+    int k = (p*n + 99)/100;
+    if (k < 1) k = 1;
+    return sorted[k-1];
+}
+
+/* t[0..reps) 為每次的秒數；ops：每次處理的符號數（建表類階段為呼叫次數） */
+static void report(const BenchCfg *cfg, const char *corpus, size_t bytes, const char *stage, const char *impl,
+                   double *t, long long ops, bool per_symbol){
+    qsort(t, (size_t)cfg->reps, sizeof(double), cmp_double);
+    double med = pct(t, cfg->reps, 50);
+    double mb_s = med > 0 ? (double)bytes/1e6/med : 0.0;
+    double ns = med*1e9/(double)(ops ? ops : 1);
+    char mb[32];
+    if (per_symbol) snprintf(mb, sizeof mb, "%.2f", mb_s);
+    else strcpy(mb, "null");      // 建表類階段與輸入大小無關，沒有吞吐量
+    printf("{\"tag\":\"%s\",\"corpus\":\"%s\",\"bytes\":%zu,\"stage\":\"%s\",\"impl\":\"%s\",\"reps\":%d,"
+           "\"median_s\":%.9f,\"p10_s\":%.9f,\"p90_s\":%.9f,\"min_s\":%.9f,\"mb_s\":%s,\"%s\":%.3f}\n",
+           cfg->tag, corpus, bytes, stage, impl, cfg->reps,
+           med, pct(t, cfg->reps, 10), pct(t, cfg->reps, 90), t[0], mb,
+           per_symbol ? "ns_per_symbol" : "ns_per_op", ns);
+    fflush(stdout);
+    log_info("bench","result corpus=%s stage=%s impl=%s median_ms=%.3f p90_ms=%.3f mb_s=%s %s=%.3f",
+             corpus, stage, impl, med*1e3, pct(t, cfg->reps, 90)*1e3, mb,
+             per_symbol ? "ns_per_symbol" : "ns_per_op", ns);
+}
+
+#define BUILD_ITERS 2000    // 257 個符號的建表只需數微秒，一次計時內重複多次
+
+/* 回傳 0 成功；-1 編碼後解碼結果不符（不輸出該 corpus 其餘結果） */
+static int bench_corpus(const BenchCfg *cfg, const char *corpus, const unsigned char *src, size_t n){
+    double *t = (double*)malloc(sizeof(double)*(size_t)cfg->reps);
+    long long freq[HUFF_MAX_SYMBOLS];
+    log_info("bench","corpus name=%s bytes=%zu reps=%d", corpus, n, cfg->reps);
+
+    // histogram：各實作分開量測
+    static const HuffHistImpl impls[] = { HUFF_HIST_REF, HUFF_HIST_X8 };
+    for (int k=0;k<2;k++) {
+        for (int r=0;r<cfg->reps;r++) {
+            memset(freq, 0, sizeof freq);
+            double t0 = now_sec();
+            huff_histogram_impl(impls[k], src, n, freq);
+            t[r] = now_sec() - t0;
+        }
+        report(cfg, corpus, n, "histogram", huff_histogram_name(impls[k]), t, (long long)n, true);
+    }
+    memset(freq, 0, sizeof freq);
+    huff_histogram(src, n, freq);
+    freq[HUFF_EOF_MARK] = 1;
+
+    // CRC32C（--checksum 的檢查碼）
+    uint32_t crc = 0;
+    for (int r=0;r<cfg->reps;r++) {
+        double t0 = now_sec();
+        crc = huff_crc32c(0, src, n);
+        t[r] = now_sec() - t0;
+    }
+    report(cfg, corpus, n, "crc32c", huff_crc32c_name(), t, (long long)n, true);
+    if (crc == 0 && n > 0) log_info("bench","crc32c zero corpus=%s", corpus);   // 避免計算被最佳化掉
+
+    // 建樹 + 依樹形指定 code
+    HuffCode code[HUFF_MAX_SYMBOLS];
+    HuffHeader hdr = {0};
+    for (int r=0;r<cfg->reps;r++) {
+        double t0 = now_sec();
+        for (int i=0;i<BUILD_ITERS;i++) huff_build_codes(freq, HUFF_MAX_SYMBOLS, code, NULL);
+        t[r] = now_sec() - t0;
+    }
+    report(cfg, corpus, n, "tree_build", "two_queue", t, BUILD_ITERS, false);
+
+    // canonical code（含長度限制檢查）
+    HuffCode tree_code[HUFF_MAX_SYMBOLS];
+    memcpy(tree_code, code, sizeof code);
+    for (int r=0;r<cfg->reps;r++) {
+        double t0 = now_sec();
+        for (int i=0;i<BUILD_ITERS;i++) {
+            memcpy(code, tree_code, sizeof code);
+            huff_canonicalize(code, HUFF_MAX_SYMBOLS, hdr.len);
+            huff_limit_codes(freq, HUFF_MAX_SYMBOLS, HUFF_DT_MAX_CODE_LEN, code, hdr.len, NULL);
+        }
+        t[r] = now_sec() - t0;
+    }
+    report(cfg, corpus, n, "code_gen", "canonical", t, BUILD_ITERS, false);
+
+    // 解碼表
+    uint64_t val[HUFF_MAX_SYMBOLS];
+    for (int s=0;s<HUFF_MAX_SYMBOLS;s++) val[s] = code[s].bits;
+    HuffDTable dt = {0};
+    for (int r=0;r<cfg->reps;r++) {
+        double t0 = now_sec();
+        for (int i=0;i<BUILD_ITERS/10;i++) huff_dtable_build(&dt, hdr.len, val, HUFF_MAX_SYMBOLS, NULL);
+        t[r] = now_sec() - t0;
+    }
+    report(cfg, corpus, n, "table_build", "two_level", t, BUILD_ITERS/10, false);
+
+    // 編碼（到記憶體，含 EOF 與補位）
+    size_t cap = huff_encode_bound(n);
+    unsigned char *enc = (unsigned char*)malloc(cap);
+    size_t enc_len = 0;
+    for (int r=0;r<cfg->reps;r++) {
+        HuffBitWriter bw;
+        double t0 = now_sec();
+        huff_bw_init_mem(&bw, enc, cap);
+        huff_bw_encode(&bw, code, src, n);
+        huff_bw_put(&bw, code[HUFF_EOF_MARK]);
+        huff_bw_flush(&bw);
+        t[r] = now_sec() - t0;
+        enc_len = bw.pos;
+    }
+    report(cfg, corpus, n, "encode", "acc64", t, (long long)n, true);
+
+    // 解碼（查表，到 EOF_MARK）
+    unsigned char *dec = (unsigned char*)malloc(n ? n : 1);
+    int rc = 0;
+    for (int r=0;r<cfg->reps;r++) {
+        HuffBitReader br;
+        size_t outn = 0;
+        long long bitpos = 0;
+        double t0 = now_sec();
+        huff_br_init_mem(&br, enc, enc_len);
+        int st = huff_br_decode_eof(&br, &dt, dec, n, &outn, &bitpos);
+        t[r] = now_sec() - t0;
+        if (st != 0 || outn != n || memcmp(src, dec, n) != 0) rc = -1;
+    }
+    if (rc == 0) report(cfg, corpus, n, "decode", "table", t, (long long)n, true);
+
+    // 4 路交錯位元串（HUFF_FLAG_X4 的單位格式）
+    size_t x4_cap = huff_x4_bound(n, huff_max_code_len(code, HUFF_MAX_SYMBOLS));
+    unsigned char *x4 = (unsigned char*)malloc(x4_cap);
+    long long x4_len = 0, x4_bits;
+    for (int r=0;r<cfg->reps;r++) {
+        double t0 = now_sec();
+        x4_len = huff_x4_encode(code, src, n, x4, x4_cap, &x4_bits);
+        t[r] = now_sec() - t0;
+    }
+    if (x4_len < 0) rc = -1;
+    else report(cfg, corpus, n, "encode", "x4", t, (long long)n, true);
+    for (int r=0;r<cfg->reps && rc==0;r++) {
+        long long misses = 0;
+        memset(dec, 0, n);
+        double t0 = now_sec();
+        long long bad = huff_x4_decode(x4, (size_t)x4_len, &dt, dec, n, &misses);
+        t[r] = now_sec() - t0;
+        if (bad != 0 || memcmp(src, dec, n) != 0) rc = -1;
+    }
+    if (rc == 0) report(cfg, corpus, n, "decode", "x4", t, (long long)n, true);
+
+    // tANS（HUFF_FLAG_TANS 的位元串，不含模型）
+    HuffTansModel tm;
+    if (huff_tans_normalize(freq, HUFF_TANS_DEFAULT_LOG, &tm) != 0) rc = -1;
+    size_t tans_cap = huff_tans_bound(n, HUFF_TANS_DEFAULT_LOG);
+    unsigned char *tans = (unsigned char*)malloc(tans_cap);
+    long long tans_len = -1;
+    for (int r=0;r<cfg->reps && rc==0;r++) {
+        double t0 = now_sec();
+        tans_len = huff_tans_encode(&tm, src, n, tans, tans_cap);
+        t[r] = now_sec() - t0;
+    }
+    if (tans_len < 0) rc = -1;
+    else report(cfg, corpus, n, "encode", "tans", t, (long long)n, true);
+    for (int r=0;r<cfg->reps && rc==0;r++) {
+        memset(dec, 0, n);
+        double t0 = now_sec();
+        long long bad = huff_tans_decode(&tm, tans, (size_t)tans_len, dec, n);
+        t[r] = now_sec() - t0;
+        if (bad != 0 || memcmp(src, dec, n) != 0) rc = -1;
+    }
+    if (rc == 0) {
+        report(cfg, corpus, n, "decode", "tans", t, (long long)n, true);
+        log_info("bench","corpus_done name=%s encoded_bytes=%zu x4_bytes=%lld tans_bytes=%lld bits_per_symbol=%.4f tans_bits_per_symbol=%.4f",
+                 corpus, enc_len, x4_len, tans_len, n ? 8.0*(double)enc_len/(double)n : 0.0,
+                 n ? 8.0*(double)tans_len/(double)n : 0.0);
+    } else {
+        log_error("bench","roundtrip mismatch corpus=%s", corpus);
+    }
+
+    huff_dtable_free(&dt, NULL);
+    free(enc); free(dec); free(x4); free(tans); free(t);
+    return rc;
+}
+
+/* "1048576"、"1024K"、"8M" → 位元組數；格式錯誤回傳 0 */
+static size_t parse_size(const char *s){
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if(*end=='K' || *end=='k'){ v <<= 10; end++; }
+    else if(*end=='M' || *end=='m'){ v <<= 20; end++; }
+    if(*end!='\0') return 0;
+    return (size_t)v;
+}
+
+static unsigned char* read_file(const char *fn, size_t *n){
+    FILE *f = fopen(fn, "rb");
+    if (!f) return NULL;
+    size_t cap = 1<<20, len = 0, got;
+    unsigned char *p = (unsigned char*)malloc(cap);
+    while ((got = fread(p+len, 1, cap-len, f)) > 0) {
+        len += got;
+        if (len == cap) { cap *= 2; p = (unsigned char*)realloc(p, cap); }
+    }
+    fclose(f);
+    *n = len;
+    return p;
+}
+
+int main(int argc, char **argv){
+    BenchCfg cfg = { "dev", 9 };
+    size_t size = 8u<<20;
+    const char *gen_dir = NULL, *only = NULL;
+    const char *files[32]; int nfiles = 0;
+    bool bad = false;
+    for (int i=1;i<argc;i++) {
+        if (strncmp(argv[i], "--reps=", 7) == 0) { cfg.reps = atoi(argv[i]+7); if (cfg.reps < 1) bad = true; }
+        else if (strncmp(argv[i], "--size=", 7) == 0) { size = parse_size(argv[i]+7); if (!size) bad = true; }
+        else if (strncmp(argv[i], "--tag=", 6) == 0) cfg.tag = argv[i]+6;
+        else if (strncmp(argv[i], "--corpus=", 9) == 0) only = argv[i]+9;
+        else if (strncmp(argv[i], "--gen=", 6) == 0) gen_dir = argv[i]+6;
+        else if (strncmp(argv[i], "--", 2) == 0 || nfiles == 32) bad = true;
+        else files[nfiles++] = argv[i];
+    }
+    if (bad) {
+        fprintf(stderr, "Usage: %s [--reps=N] [--size=SIZE] [--tag=STR] [--corpus=skewed,uniform,single,binary|none] [file ...]\n"
+                        "       %s --gen=DIR [--size=SIZE]   (write the generated corpus and exit)\n",
+                argv[0], argv[0]);
+        return 1;
+    }
+    log_set_output(stderr);
+
+    unsigned char *buf = (unsigned char*)malloc(size);
+    int rc = 0;
+    for (int g=0;g<NGENS;g++) {
+        if (only && !strstr(only, GENS[g].name)) continue;
+        GENS[g].gen(buf, size, UINT64_C(0x5EED0000) + (uint64_t)g);
+        if (gen_dir) {
+            char fn[4096];
+            snprintf(fn, sizeof fn, "%s/corpus_%s.bin", gen_dir, GENS[g].name);
+            FILE *f = fopen(fn, "wb");
+            bool ok = f && fwrite(buf, 1, size, f) == size;
+            if (f && fclose(f) != 0) ok = false;
+            if (ok) log_info("bench","write_corpus file=%s bytes=%zu", fn, size);
+            else { log_error("bench","write corpus failed file=%s", fn); rc = 2; }
+            continue;
+        }
+        if (bench_corpus(&cfg, GENS[g].name, buf, size) != 0) rc = 3;
+    }
+    free(buf);
+    if (gen_dir) return rc;
+
+    for (int i=0;i<nfiles;i++) {
+        size_t n = 0;
+        unsigned char *p = read_file(files[i], &n);
+        if (!p) { log_error("bench","open input failed file=%s", files[i]); rc = 2; continue; }
+        // corpus 名稱只取檔名，避免路徑中的反斜線破壞 JSON
+        const char *name = files[i];
+        for (const char *c = files[i]; *c; c++) if (*c == '/' || *c == '\\') name = c+1;
+        if (bench_corpus(&cfg, name, p, n) != 0) rc = 3;
+        free(p);
+    }
+    log_info("bench","finish status=%s", rc ? "error" : "ok");
+    return rc;
+}
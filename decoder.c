@@ -1,129 +1,128 @@
 #define _CRT_SECURE_NO_WARNINGS
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include "logger.h"
+#include "huff.h"
+#include "mapio.h"
+#include "metrics.h"
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 #define EOF_MARK 256
+#define MAX_CODES 257          // 256 個 byte + EOF_MARK
+#define OUT_CHUNK (1<<20)      // 輸出緩衝（重複使用）與 stdin 讀取緩衝的大小
 
-typedef struct Node {
+/* "-" 代表 stdin / stdout：只能循序讀寫一次，各階段由上一階段讀到的位置接續，不 seek、不映射 */
+static bool is_std(const char *fn){ return strcmp(fn, "-") == 0; }
+
+/* 定位到絕對位移；大檔的位移超過 long 能表示的 2 GiB，改用 64 位元的 seek */
+static int seek_abs(FILE *f, uint64_t off) {
+#ifdef _WIN32
+    return _fseeki64(f, (__int64)off, SEEK_SET);
+#else
+    return fseeko(f, (off_t)off, SEEK_SET);
+#endif
+}
+
+/* 開啟 encoded 檔並定位到 off；stdin 時呼叫端保證前面的階段剛好讀到 off */
+static FILE *open_enc(const char *enc_fn, long off) {
+    if (is_std(enc_fn)) return stdin;
+    FILE *f = fopen(enc_fn, "rb");
+    if (f && fseek(f, off, SEEK_SET) != 0) { fclose(f); f = NULL; }
+    if (!f) log_error("decoder","open encoded failed file=%s", enc_fn);
+    return f;
+}
+static void close_enc(FILE *f){ if (f != stdin) fclose(f); }
+
+static FILE *open_out(const char *out_fn) {
+    FILE *f = is_std(out_fn) ? stdout : fopen(out_fn, "wb");
+    if (!f) log_error("decoder","open output failed file=%s", out_fn);
+    return f;
+}
+/* 回傳 0 成功，-1 寫出失敗（stdout 只 flush 不關閉） */
+static int close_out(FILE *f){ return (f == stdout ? fflush(f) : fclose(f)) == 0 ? 0 : -1; }
+
+/* 整棵樹放在一塊連續陣列裡：根固定是第 0 個節點，子節點以索引表示（0 表示沒有子節點） */
+typedef struct {
     int symbol;         // 葉節點: 0..255 或 EOF_MARK；內部節點：-1
-    struct Node *l, *r;
+    int child[2];       // 左(0) / 右(1) 子節點索引
 } Node;
 
-static Node* node_new(int sym){ Node* n=(Node*)calloc(1,sizeof(Node)); n->symbol=sym; return n; }
-static void tree_free(Node *n){ if(!n) return; tree_free(n->l); tree_free(n->r); free(n); }
+static void tree_free(Node *root){ free(root); }
 
-static void tree_insert(Node **root, const char *code, int symbol) {
-    if (!*root) *root = node_new(-1);
-    Node *cur = *root;
+static void tree_insert(Node *root, int *count, const char *code, int symbol) {
+    int cur = 0;
     for (const char *p = code; *p; ++p) {
-        if (*p == '0') { if (!cur->l) cur->l = node_new(-1); cur = cur->l; }
-        else if (*p == '1') { if (!cur->r) cur->r = node_new(-1); cur = cur->r; }
-    }
-    cur->symbol = symbol;
-}
-
-/* --------- CSV 解析（支援反斜線逃脫：\" \\ \n \r \t） --------- */
-static void csv_next_field(char **cursor, char *dst, size_t dstsz) {
-    char *p = *cursor;
-    size_t k = 0;
-    int quoted = 0;
-
-    // 跳過前導空格
-    while (*p == ' ' || *p == '\t') p++;
-    
-    // 檢查是否為引號開頭
-    if (*p == '"') { 
-        quoted = 1; 
-        p++; 
-    }
-
-    while (*p && k + 1 < dstsz) {
-        if (quoted) {
-            if (*p == '\\' && *(p+1)) {
-                // 反斜線逃脫：\", \\, \n, \r, \t, \x, \,
-                p++;
-                switch (*p) {
-                    case '"':  dst[k++] = '"';  p++; break;
-                    case '\\': dst[k++] = '\\'; p++; break;
-                    case 'n':  dst[k++] = '\n'; p++; break;
-                    case 'r':  dst[k++] = '\r'; p++; break;
-                    case 't':  dst[k++] = '\t'; p++; break;
-                    case ',':  dst[k++] = ',';  p++; break;
-                    case 'x': {
-                        // \xNN 轉義
-                        if (isxdigit((unsigned char)*(p+1)) && isxdigit((unsigned char)*(p+2))) {
-                            int hi = isdigit((unsigned char)*(p+1)) ? *(p+1)-'0' : 10 + (tolower(*(p+1))-'a');
-                            int lo = isdigit((unsigned char)*(p+2)) ? *(p+2)-'0' : 10 + (tolower(*(p+2))-'a');
-                            dst[k++] = (hi << 4) | lo;
-                            p += 3;
-                        } else {
-                            dst[k++] = '\\'; // 如果格式不對，就當普通反斜線
-                            p++;
-                        }
-                        break;
-                    }
-                    default:
-                        dst[k++] = *p; // 其他情況保留反斜線
-                        p++;
-                        break;
-                }
-            } else if (*p == '"') {
-                // 結束引號
-                p++;
-                // 跳過後續空格直到逗號
-                while (*p && (*p == ' ' || *p == '\t')) p++;
-                if (*p == ',') p++;
-                break;
-            } else {
-                // 引號內的普通字符
-                dst[k++] = *p;
-                p++;
-            }
-        } else {
-            // 不帶引號的欄位
-            if (*p == ',' || *p == '\r' || *p == '\n') {
-                if (*p == ',') p++;
-                break;
-            } else {
-                dst[k++] = *p;
-                p++;
-            }
-        }
+        if (*p != '0' && *p != '1') continue;
+        int b = *p == '1';
+        if (!root[cur].child[b]) { root[*count].symbol = -1; root[cur].child[b] = (*count)++; }
+        cur = root[cur].child[b];
     }
-    
-    dst[k] = '\0';
-    *cursor = p;
+    root[cur].symbol = symbol;
 }
 
-/* 轉回單一位元組/特殊符號 */
-static int parse_symbol_token(const char *s) {
-    if (strcmp(s, "<EOF>") == 0) return EOF_MARK;
-    if (strcmp(s, "\\n")  == 0) return '\n';
-    if (strcmp(s, "\\r")  == 0) return '\r';
-    if (strcmp(s, "\\t")  == 0) return '\t';
-    if (strcmp(s, "\\\\") == 0) return '\\';
-    if (strcmp(s, "\\,")  == 0) return ',';
-    if (strcmp(s, "\\\"") == 0) return '\"';
-    if (s[0]=='\\' && s[1]=='x' && isxdigit((unsigned char)s[2]) && isxdigit((unsigned char)s[3]) && s[4]=='\0'){
-        int hi = isdigit((unsigned char)s[2]) ? s[2]-'0' : 10 + (tolower(s[2])-'a');
-        int lo = isdigit((unsigned char)s[3]) ? s[3]-'0' : 10 + (tolower(s[3])-'a');
-        return (hi<<4)|lo;
+/* codebook 的一列：符號與其 codeword 字串 */
+typedef struct {
+    int symbol;
+    char *code;
+} CodeEntry;
+
+static void codes_free(CodeEntry *codes, int n){
+    for (int i=0;i<n;i++) free(codes[i].code);
+    free(codes);
+}
+
+/* 由 code 長度表重建 canonical codebook；回傳 0 成功，-1 長度表不合法 */
+static int codes_from_lengths(const uint8_t *len, int nsym, CodeEntry **out, int *entries) {
+    uint64_t val[HUFF_MAX_SYMBOLS];
+    if (huff_canonical_codes(len, nsym, val) != 0) return -1;
+    CodeEntry *codes = (CodeEntry*)malloc(sizeof(CodeEntry)*nsym);
+    int cnt = 0;
+    for (int s=0;s<nsym;s++) {
+        int L = len[s];
+        if (!L) continue;
+        codes[cnt].symbol = s;
+        codes[cnt].code = (char*)malloc(L+1);
+        for (int k=0;k<L;k++) codes[cnt].code[k] = ((val[s]>>(L-1-k))&1) ? '1' : '0';
+        codes[cnt].code[L] = '\0';
+        cnt++;
     }
-    return (unsigned char)s[0];
+    *out = codes;
+    *entries = cnt;
+    return 0;
 }
 
-/* 載入 codebook 並建樹 */
-static Node* load_codebook_and_build_tree(const char *cb_fn, int *entries) {
+/* 載入 codebook：回傳 (symbol, codeword) 陣列，樹與查表都由此建立。
+ * 檔案以 "HUFC" 開頭時為 encoder --train 的二進位形式（只有檔頭），依長度表重建 canonical code */
+static CodeEntry* load_codebook(const char *cb_fn, int *entries) {
     FILE *fp = fopen(cb_fn, "rb");
     if (!fp) { log_error("decoder","open_codebook failed file=%s", cb_fn); return NULL; }
     log_info("decoder","load_codebook file=%s", cb_fn);
 
-    Node *root = NULL;
+    HuffHeader h;
+    long hb = huff_header_read(fp, &h);
+    if (hb != 0) {
+        fclose(fp);
+        CodeEntry *codes = NULL;
+        if (hb < 0 || (h.flags & HUFF_NO_LEN_TABLE) || codes_from_lengths(h.len, h.nsym, &codes, entries) != 0) {
+            log_error("decoder","load_codebook failed file=%s reason=invalid_binary_codebook", cb_fn);
+            return NULL;
+        }
+        log_info("decoder","codebook_loaded format=binary loaded_entries=%d", *entries);
+        return codes;
+    }
+    rewind(fp);
+
+    CodeEntry *codes = NULL;
+    int cap = 0;
     char line[4096];
     int cnt = 0;
     int line_num = 0;
@@ -134,19 +133,25 @@ static Node* load_codebook_and_build_tree(const char *cb_fn, int *entries) {
 
         char *cur = line;
         char f0[256], f1[64], f2[128], f3[2048], f4[128];
-        csv_next_field(&cur, f0, sizeof f0); // symbol
-        csv_next_field(&cur, f1, sizeof f1); // count
-        csv_next_field(&cur, f2, sizeof f2); // prob
-        csv_next_field(&cur, f3, sizeof f3); // codeword
-        csv_next_field(&cur, f4, sizeof f4); // self-info
+        huff_csv_field(&cur, f0, sizeof f0); // symbol
+        huff_csv_field(&cur, f1, sizeof f1); // count
+        huff_csv_field(&cur, f2, sizeof f2); // prob
+        huff_csv_field(&cur, f3, sizeof f3); // codeword
+        huff_csv_field(&cur, f4, sizeof f4); // self-info
 
         if (f0[0]=='\0' || f3[0]=='\0') {
             log_warn("decoder","skip_line line_num=%d symbol_empty=%d codeword_empty=%d",
                      line_num, (f0[0]=='\0'), (f3[0]=='\0'));
             continue;
         }
-        int sym = parse_symbol_token(f0);
-        tree_insert(&root, f3, sym);
+        int sym = huff_csv_symbol(f0);
+        if (cnt == cap) {
+            cap = cap ? cap*2 : 64;
+            codes = (CodeEntry*)realloc(codes, sizeof(CodeEntry)*cap);
+        }
+        codes[cnt].symbol = sym;
+        codes[cnt].code = (char*)malloc(strlen(f3)+1);
+        strcpy(codes[cnt].code, f3);
         cnt++;
         if (cnt <= 5 || cnt >= 99) {  // 只輸出前 5 和最後幾行
             log_info("decoder","loaded_codeword line=%d symbol=%d code_len=%lu code=%.20s",
@@ -156,75 +161,1047 @@ static Node* load_codebook_and_build_tree(const char *cb_fn, int *entries) {
     fclose(fp);
     log_info("decoder","codebook_loaded total_lines=%d loaded_entries=%d", line_num, cnt);
     if(entries) *entries = cnt;
+    return codes;
+}
+
+/* 讀入容器檔頭（與檢查碼段）並重建 codebook（串流格式的表在各 chunk 內，此處不建）；
+ * 回傳檔頭與檢查碼段的位元組數，失敗回傳 -1 */
+static long load_header_codebook(const char *enc_fn, CodeEntry **out, int *entries, HuffHeader *h, HuffCrcIndex *cx) {
+    FILE *fp = open_enc(enc_fn, 0);
+    if (!fp) return -1;
+    long hb = huff_header_read(fp, h);
+    long cb = hb > 0 && (h->flags & HUFF_FLAG_CRC) ? huff_crc_read(fp, cx) : 0;
+    close_enc(fp);
+    if (hb <= 0) {
+        log_error("decoder","read_header failed file=%s reason=%s", enc_fn, hb==0 ? "bad_magic" : "corrupt");
+        return -1;
+    }
+    if (cb < 0) {
+        log_error("decoder","read_checksums failed file=%s", enc_fn);
+        return -1;
+    }
+    hb += cb;
+    *out = NULL; *entries = 0;
+    if (!(h->flags & HUFF_NO_LEN_TABLE) && codes_from_lengths(h->len, h->nsym, out, entries) != 0) {
+        log_error("decoder","read_header failed file=%s reason=invalid_code_lengths", enc_fn);
+        return -1;
+    }
+    log_info("decoder","read_header file=%s version=%d flags=%d nsym=%d header_bytes=%ld loaded_entries=%d",
+             enc_fn, h->version, h->flags, h->nsym, hb, *entries);
+    return hb;
+}
+
+/* --------- 檢查碼 --------- */
+/* 比對 header_crc：檔頭、檢查碼段與其後的表 tab[0..tn)（由解析結果重新編碼，stdin 不必回頭重讀）。
+ * 回傳 0 相符，-1 不符 */
+static int verify_header_crc(const HuffHeader *h, const HuffCrcIndex *cx, const unsigned char *tab, size_t tn) {
+    if (huff_crc_header(h, cx, tab, tn) == cx->header_crc) return 0;
+    log_error("decoder","checksum_mismatch section=header table_bytes=%zu", tn);
+    return -1;
+}
+
+/* 依輸出順序累計 CRC32C，每滿一段就比對 */
+typedef struct {
+    const HuffCrcIndex *ix;
+    uint64_t pos;           // 已比對的原始位元組數
+    uint32_t k, cur;        // 目前的段與其累計 CRC
+} CrcCheck;
+
+/* 回傳 0 相符；-1 第 k 段不符或輸出超過 orig_size（k == count） */
+static int crc_check(CrcCheck *c, const unsigned char *p, size_t n) {
+    while (n > 0) {
+        if (c->k >= c->ix->count) return -1;
+        uint64_t end = (uint64_t)(c->k + 1) * c->ix->block;
+        if (end > c->ix->orig_size) end = c->ix->orig_size;
+        size_t step = end - c->pos < n ? (size_t)(end - c->pos) : n;
+        c->cur = huff_crc32c(c->cur, p, step);
+        c->pos += step; p += step; n -= step;
+        if (c->pos == end) {
+            if (c->cur != c->ix->crc[c->k]) return -1;
+            c->k++; c->cur = 0;
+        }
+    }
+    return 0;
+}
+
+static void crc_report(const CrcCheck *c, long long bit_position);
+
+/* 寫出一段解碼結果；ck->ix 非 NULL 時先比對檢查碼。回傳 0 成功，-1 寫出失敗，-2 檢查碼不符 */
+static int out_write(FILE *fout, const unsigned char *p, size_t n, CrcCheck *ck, long long bit_position) {
+    if (ck->ix && crc_check(ck, p, n) != 0) { crc_report(ck, bit_position); return -2; }
+    if (n && fwrite(p, 1, n, fout) != n) { log_error("decoder","write output failed bytes=%zu", n); return -1; }
+    return 0;
+}
+
+/* 單一位元串解完後：有檢查碼時沒有 EOF_MARK、大小不符或不是每段都比對過都視為錯誤。回傳 0 或 -2 */
+static int crc_finish(const CrcCheck *ck, bool found_eof) {
+    if (!ck->ix) return 0;
+    bool full = found_eof && ck->pos == ck->ix->orig_size;
+    if (!full || ck->k != ck->ix->count) {
+        // 長度正確且有 EOF_MARK 時問題出在檢查碼段本身，不是資料被截斷
+        log_error("decoder","checksum_mismatch reason=%s decoded_bytes=%llu orig_size=%llu found_eof=%d checked=%u count=%u",
+                  full ? "crc" : "truncated", (unsigned long long)ck->pos, (unsigned long long)ck->ix->orig_size,
+                  (int)found_eof, ck->k, ck->ix->count);
+        return -2;
+    }
+    log_info("decoder","verify_checksums crc_block=%u count=%u impl=%s status=ok", ck->ix->block, ck->k, huff_crc32c_name());
+    metrics_count("checksum_blocks", ck->k);
+    return 0;
+}
+
+static void crc_report(const CrcCheck *c, long long bit_position) {
+    if (c->k >= c->ix->count)
+        log_error("decoder","checksum_mismatch reason=overrun orig_size=%llu bit_position=%lld",
+                  (unsigned long long)c->ix->orig_size, bit_position);
+    else
+        log_error("decoder","checksum_mismatch block=%u offset=%llu bit_position=%lld",
+                  c->k, (unsigned long long)c->k * c->ix->block, bit_position);
+}
+
+/* 由 codebook 建樹（逐位元參考解碼器使用） */
+static Node* build_tree(const CodeEntry *codes, int n) {
+    if (n <= 0) return NULL;
+    // 節點數不超過 1 + 所有 code 長度總和，一次配置
+    size_t cap = 1;
+    for (int i=0;i<n;i++) cap += strlen(codes[i].code);
+    Node *root = (Node*)calloc(cap, sizeof(Node));
+    if (!root) return NULL;
+    int count = 1;
+    root[0].symbol = -1;
+    for (int i=0;i<n;i++) tree_insert(root, &count, codes[i].code, codes[i].symbol);
     return root;
 }
 
-/* 依樹解碼 bitstream，遇到 EOF_MARK 結束 */
-static int decode_bitstream(const char *enc_fn, const char *out_fn, Node *root) {
-    FILE *fin = fopen(enc_fn, "rb");
-    if (!fin) { log_error("decoder","open encoded failed file=%s", enc_fn); return -1; }
-    FILE *fout = fopen(out_fn, "wb");
-    if (!fout) { fclose(fin); log_error("decoder","open output failed file=%s", out_fn); return -1; }
-
-    Node *cur = root; int outc = 0;
-    int ch;
-    int bit_count = 0;
-    while ((ch=fgetc(fin)) != EOF) {
-        unsigned char byte = (unsigned char)ch;
-        for (int b=7;b>=0;--b){
-            int bit = (byte>>b)&1;
-            cur = bit ? cur->r : cur->l;
-            bit_count++;
-            if (!cur) { // 不應發生：樹錯誤或 bitstream 損壞
-                log_error("decoder","invalid_traverse bit_position=%d byte_value=%d", bit_count, (int)byte);
-                fclose(fin); fclose(fout); return -2;
-            }
-            if (cur->symbol != -1) {
-                if (cur->symbol == EOF_MARK) {
-                    log_info("decoder","found EOF_MARK at bit_position=%d decoded_symbols=%d", bit_count, outc);
-                    fclose(fin); fclose(fout);
-                    return outc;
+/* --------- 多位元查表解碼器（huff.h 的兩層表） --------- */
+typedef HuffDTable DTable;
+
+/* 由 codeword 字串建表；回傳 0 成功；-1 code 過長或含非 0/1 字元（呼叫端退回逐位元解碼） */
+static int dtable_build(DTable *t, const CodeEntry *codes, int n) {
+    uint8_t len[MAX_CODES] = {0};
+    uint64_t val[MAX_CODES];
+    for (int i=0;i<n;i++) {
+        int s = codes[i].symbol;
+        int L = (int)strlen(codes[i].code);
+        if (s < 0 || s >= MAX_CODES || L == 0 || L > HUFF_DT_MAX_CODE_LEN) return -1;
+        uint64_t v = 0;
+        for (int k=0;k<L;k++) {
+            char b = codes[i].code[k];
+            if (b != '0' && b != '1') return -1;
+            v = (v<<1) | (uint64_t)(b=='1');
+        }
+        len[s] = (uint8_t)L; val[s] = v;
+    }
+    return huff_dtable_build(t, len, val, MAX_CODES, NULL);
+}
+
+/* 依樹解碼 bitstream，遇到 EOF_MARK 結束。輸入與輸出都以 OUT_CHUNK 的緩衝整段讀寫，
+ * 位元與符號計數為 64 位元；cx 非 NULL 時每寫出一段就比對檢查碼。回傳解碼位元組數，失敗回傳負值 */
+static long long decode_bitstream(const char *enc_fn, long data_off, const char *out_fn, const Node *root,
+                                  const HuffCrcIndex *cx) {
+    FILE *fin = open_enc(enc_fn, data_off);
+    if (!fin) return -1;
+    FILE *fout = open_out(out_fn);
+    if (!fout) { close_enc(fin); return -1; }
+
+    unsigned char *ibuf = (unsigned char*)malloc(OUT_CHUNK);
+    unsigned char *obuf = (unsigned char*)malloc(OUT_CHUNK);
+    CrcCheck ck = { cx, 0, 0, 0 };
+    const Node *cur = root;
+    long long outc = 0, bit_count = 0;
+    int status = 1;                 // 0 遇到 EOF_MARK；1 位元用盡；負值錯誤
+    size_t got, on = 0;
+    while (status == 1 && (got = fread(ibuf, 1, OUT_CHUNK, fin)) > 0) {
+        for (size_t i=0;i<got && status == 1;i++) {
+            unsigned char byte = ibuf[i];
+            for (int b=7;b>=0;--b){
+                int c = cur->child[(byte>>b)&1];
+                bit_count++;
+                if (!c) { // 不應發生：樹錯誤或 bitstream 損壞
+                    log_error("decoder","invalid_traverse bit_position=%lld byte_value=%d", bit_count, (int)byte);
+                    status = -2; break;
                 }
-                fputc((unsigned char)cur->symbol, fout);
-                outc++;
+                cur = &root[c];
+                if (cur->symbol == -1) continue;
+                if (cur->symbol == EOF_MARK) { status = 0; break; }
+                obuf[on++] = (unsigned char)cur->symbol;
                 cur = root;
+                if (on == OUT_CHUNK) {
+                    int w = out_write(fout, obuf, on, &ck, bit_count);
+                    outc += (long long)on; on = 0;
+                    if (w) { status = w; break; }
+                }
+            }
+        }
+    }
+    if (status >= 0) {
+        int w = out_write(fout, obuf, on, &ck, bit_count);
+        outc += (long long)on;
+        if (w) status = w;
+    }
+    close_enc(fin);
+    if (close_out(fout) != 0 && status >= 0) { log_error("decoder","write output failed file=%s", out_fn); status = -1; }
+    free(ibuf); free(obuf);
+
+    if (status < 0) return status;
+    if (status == 0)
+        log_info("decoder","found EOF_MARK at bit_position=%lld decoded_symbols=%lld", bit_count, outc);
+    else
+        log_warn("decoder","no EOF_MARK found total_bits=%lld decoded_symbols=%lld", bit_count, outc);
+    if (crc_finish(&ck, status == 0) != 0) return -2;
+    return outc; // 沒有檢查碼時若沒遇到 EOF_MARK，仍回傳已解碼數（視為不完整）
+}
+
+/* 檔案大小（位元組）；失敗回傳 0，只用於計數器 */
+static long long file_size(const char *fn) {
+    FILE *fp = fopen(fn, "rb");
+    if (!fp) return 0;
+    long long n = fseek(fp, 0, SEEK_END) == 0 ? (long long)ftell(fp) : 0;
+    fclose(fp);
+    return n < 0 ? 0 : n;
+}
+
+/* --------- 64-bit 位元緩衝讀取（huff.h） --------- */
+typedef HuffBitReader BitR;
+
+/* 查表解碼：輸出與 decode_bitstream 逐位元相同。
+ * map 非 NULL 時為 order-1 context：t 為各類別的表，每個符號用 t[map[前一個 byte]]；
+ * dg 非 NULL 時為擴充字母表，byte 對符號一次寫出 2 bytes；
+ * cx 非 NULL 時邊寫邊比對檢查碼，第一個不符的段即停止。
+ * 記憶體只有位元讀取緩衝與 OUT_CHUNK 的輸出緩衝，與檔案大小無關。回傳解碼位元組數，失敗回傳負值 */
+static long long decode_bitstream_table(const char *enc_fn, long data_off, const char *out_fn, const DTable *t,
+                                        const uint8_t *map, const HuffDigrams *dg, const HuffCrcIndex *cx) {
+    // 一般檔案直接在映射記憶體上解碼，否則（含 stdin）以 stdio 分段讀入
+    MappedFile min;
+    bool mapped = !is_std(enc_fn) && mf_open_read(enc_fn, &min) == 0;
+    if (mapped && (size_t)data_off > min.size) { mf_close(&min); mapped = false; }
+    FILE *fin = NULL;
+    if (!mapped) {
+        fin = open_enc(enc_fn, data_off);
+        if (!fin) return -1;
+    }
+    FILE *fout = open_out(out_fn);
+    if (!fout) {
+        if (fin) close_enc(fin);
+        if (mapped) mf_close(&min);
+        return -1;
+    }
+
+    BitR *br = (BitR*)malloc(sizeof(BitR));
+    unsigned char *obuf = (unsigned char*)malloc(OUT_CHUNK);
+    long long outc = 0, bit_count = 0;
+    int status, prev = 0;
+    CrcCheck ck = { cx, 0, 0, 0 };
+    if (mapped) huff_br_init_mem(br, min.data + data_off, min.size - (size_t)data_off);
+    else huff_br_init(br, fin);
+
+    for (;;) {
+        size_t on = 0;
+        status = map ? huff_br_decode_ctx_eof(br, t, map, &prev, obuf, OUT_CHUNK, &on, &bit_count)
+               : dg  ? huff_br_decode_digram_eof(br, t, dg, obuf, OUT_CHUNK, &on, &bit_count)
+                     : huff_br_decode_eof(br, t, obuf, OUT_CHUNK, &on, &bit_count);
+        int w = out_write(fout, obuf, on, &ck, bit_count);
+        if (w) { status = w; break; }
+        outc += (long long)on;
+        if (status != HUFF_E_DST_SMALL) break;
+    }
+    if (status == HUFF_E_CORRUPT) {
+        log_error("decoder","invalid_traverse bit_position=%lld", bit_count + 1);
+        status = -2;
+    }
+    if (fin) close_enc(fin);
+    if (mapped) mf_close(&min);
+    if (close_out(fout) != 0 && status >= 0) { log_error("decoder","write output failed file=%s", out_fn); status = -1; }
+    metrics_count("table_misses", br->misses);
+    huff_br_free(br);
+    free(obuf); free(br);
+
+    if (status < 0) return status;
+    if (status == 0)
+        log_info("decoder","found EOF_MARK at bit_position=%lld decoded_symbols=%lld", bit_count, outc);
+    else
+        log_warn("decoder","no EOF_MARK found total_bits=%lld decoded_symbols=%lld", bit_count, outc);
+    if (crc_finish(&ck, status == 0) != 0) return -2;
+    return outc;
+}
+
+/* --------- order-1 context 碼表 --------- */
+/* 讀入 data_off 處的 context 表、逐類建表後解碼；回傳解碼位元組數，失敗回傳負值 */
+static long long decode_ctx(const char *enc_fn, long data_off, const HuffHeader *h, const HuffCrcIndex *cx,
+                            const char *out_fn) {
+    double t0 = metrics_now();
+    FILE *fp = open_enc(enc_fn, data_off);
+    if (!fp) return -1;
+    HuffCtxTables ctx;
+    long cb = huff_ctx_read(fp, h, &ctx, NULL);
+    close_enc(fp);
+    if (cb < 0) { log_error("decoder","read_context_tables failed file=%s", enc_fn); return -2; }
+    if (cx) {
+        unsigned char *tab = (unsigned char*)malloc((size_t)cb ? (size_t)cb : 1);
+        if (tab) huff_ctx_encode(&ctx, tab);
+        int bad = !tab || verify_header_crc(h, cx, tab, (size_t)cb) != 0;
+        free(tab);
+        if (bad) { huff_ctx_free(&ctx, NULL); return -2; }
+    }
+    metrics_stage("load_codebook", t0);
+
+    t0 = metrics_now();
+    DTable *tabs = (DTable*)calloc((size_t)ctx.nclass, sizeof(DTable));
+    int rc = tabs ? 0 : -1;
+    for (int k=0;k<ctx.nclass && rc==0;k++) {
+        uint64_t val[MAX_CODES];
+        rc = huff_canonical_codes(ctx.len[k], MAX_CODES, val);
+        if (rc == 0) rc = huff_dtable_build(&tabs[k], ctx.len[k], val, MAX_CODES, NULL);
+    }
+    metrics_stage("build_table", t0);
+    long long n = -2;
+    if (rc != 0) {
+        log_error("decoder","build_context_tables failed classes=%d", ctx.nclass);
+    } else {
+        log_info("decoder","build_context_tables classes=%d table_bytes=%ld", ctx.nclass, cb + h->nsym);
+        t0 = metrics_now();
+        n = decode_bitstream_table(enc_fn, data_off + cb, out_fn, tabs, ctx.map, NULL, cx);
+        metrics_stage("decode", t0);
+    }
+    for (int k=0;tabs && k<ctx.nclass;k++) huff_dtable_free(&tabs[k], NULL);
+    free(tabs);
+    huff_ctx_free(&ctx, NULL);
+    return n;
+}
+
+/* --------- 擴充字母表 --------- */
+/* 讀入 data_off 處的 byte 對表、對全部符號建表後解碼；回傳解碼位元組數，失敗回傳負值 */
+static long long decode_digram(const char *enc_fn, long data_off, const HuffHeader *h, const HuffCrcIndex *cx,
+                               const char *out_fn) {
+    double t0 = metrics_now();
+    FILE *fp = open_enc(enc_fn, data_off);
+    if (!fp) return -1;
+    HuffDigrams *dg = (HuffDigrams*)malloc(sizeof(HuffDigrams));
+    uint8_t *len = (uint8_t*)calloc(HUFF_EXT_MAX_SYMBOLS, 1);
+    uint64_t *val = (uint64_t*)malloc(sizeof(uint64_t)*HUFF_EXT_MAX_SYMBOLS);
+    long tb = (dg && len && val) ? huff_digram_read(fp, h, dg, len) : -1;
+    close_enc(fp);
+    long long n = -2;
+    unsigned char *tab = cx && tb >= 0 ? (unsigned char*)malloc((size_t)tb) : NULL;
+    if (tab) huff_digram_encode(dg, len, tab);
+    if (tb < 0) {
+        log_error("decoder","read_digram_table failed file=%s", enc_fn);
+    } else if (cx && (!tab || verify_header_crc(h, cx, tab, (size_t)tb) != 0)) {
+        n = -2;
+    } else {
+        metrics_stage("load_codebook", t0);
+        t0 = metrics_now();
+        int nsym = HUFF_MAX_SYMBOLS + dg->n;
+        DTable t = {0};
+        int rc = huff_canonical_codes(len, nsym, val);
+        if (rc == 0) rc = huff_dtable_build(&t, len, val, nsym, NULL);
+        metrics_stage("build_table", t0);
+        if (rc != 0) {
+            log_error("decoder","build_table failed alphabet=%d reason=invalid_code_lengths", nsym);
+        } else {
+            log_info("decoder","build_table alphabet=%d pairs=%d table_bytes=%ld table_entries=%d max_code_len=%d",
+                     nsym, dg->n, tb + h->nsym, t.size, t.max_len);
+            t0 = metrics_now();
+            n = decode_bitstream_table(enc_fn, data_off + tb, out_fn, &t, NULL, dg, cx);
+            metrics_stage("decode", t0);
+        }
+        huff_dtable_free(&t, NULL);
+    }
+    free(dg); free(len); free(val); free(tab);
+    return n;
+}
+
+/* --------- 區塊平行解碼 --------- */
+/* 讀入 data_off 處的區塊索引，回傳區塊資料起點；失敗回傳 -1 */
+static long load_block_index(const char *enc_fn, long data_off, HuffBlockIndex *ix) {
+    FILE *fp = open_enc(enc_fn, data_off);
+    if (!fp) return -1;
+    long ib = huff_index_read(fp, ix);
+    close_enc(fp);
+    if (ib < 0) { log_error("decoder","read_block_index failed file=%s", enc_fn); return -1; }
+    log_info("decoder","read_block_index block_size=%u nblocks=%u orig_size=%llu index_bytes=%ld",
+             ix->block_size, ix->nblocks, (unsigned long long)ix->orig_size, ib);
+    return data_off + ib;
+}
+
+/* 由 br 目前位置解碼剛好 n 個符號到 dst（NULL 表示丟棄）；*bitpos 累計已消耗位元。
+ * 回傳 0 成功，否則為出錯的位元位置（從 1 起算） */
+static long long br_decode_n(BitR *br, unsigned char *dst, size_t n,
+                             const DTable *t, const Node *root, long long *bitpos) {
+    if (t->e) return huff_br_decode(br, t, dst, n, bitpos);
+    for (size_t i=0;i<n;i++) {
+        huff_br_refill(br);
+        const Node *cur = root;
+        int L = 0;
+        while (cur && cur->symbol == -1 && L < 64) {
+            int c = cur->child[(br->bits << L) >> 63];
+            cur = c ? &root[c] : NULL;
+            L++;
+        }
+        if (!cur || cur->symbol == -1 || L > br->avail || cur->symbol == EOF_MARK) return *bitpos + 1;
+        br->bits <<= L; br->nbits -= L; br->avail -= L;
+        *bitpos += L;
+        if (dst) dst[i] = (unsigned char)cur->symbol;
+    }
+    return 0;
+}
+
+/* 由記憶體解碼剛好 n 個符號；回傳 0 成功，否則為區塊內出錯的位元位置（從 1 起算）。
+ * *misses 設為第二層查表次數 */
+static long long decode_block_mem(const unsigned char *src, size_t srclen, unsigned char *dst, size_t n,
+                                  const DTable *t, const Node *root, long long *misses) {
+    BitR br; huff_br_init_mem(&br, src, srclen);
+    long long bitpos = 0;
+    long long rc = br_decode_n(&br, dst, n, t, root, &bitpos);
+    *misses = br.misses;
+    return rc;
+}
+
+/* 4 路交錯單位：查表時 4 段在同一迴圈前進；樹狀解碼沒有查表可交錯，逐段解碼 */
+static long long decode_x4_mem(const unsigned char *src, size_t srclen, unsigned char *dst, size_t n,
+                               const DTable *t, const Node *root, long long *misses) {
+    *misses = 0;
+    if (t->e) return huff_x4_decode(src, srclen, t, dst, n, misses);
+    size_t off[HUFF_X4_STREAMS+1];
+    if (huff_x4_offsets(src, srclen, off) != 0) return 1;
+    for (int k=0;k<HUFF_X4_STREAMS;k++) {
+        long long m, bad = decode_block_mem(src + off[k], off[k+1] - off[k], dst + huff_x4_start(n, k),
+                                            huff_x4_count(n, k), t, root, &m);
+        if (bad) return (long long)off[k]*8 + bad;
+    }
+    return 0;
+}
+
+/* 整檔單一單位：4 路交錯時 u64 orig_size 之後即單位本身；tANS（tm 非 NULL）時先解析模型，
+ * 再接 u64 orig_size 與位元串。回傳解碼位元組數，失敗回傳負值 */
+static long long decode_unit_file(const char *enc_fn, long data_off, const char *out_fn,
+                                  const DTable *t, const Node *root, HuffTansModel *tm) {
+    MappedFile min, mout;
+    bool mapped = mf_open_read(enc_fn, &min) == 0;
+    unsigned char *src = NULL;
+    size_t srclen;
+    if (mapped) {
+        src = min.data; srclen = min.size;
+    } else {
+        FILE *fin = fopen(enc_fn, "rb");
+        if (!fin) { log_error("decoder","open encoded failed file=%s", enc_fn); return -1; }
+        long long sz = fseek(fin, 0, SEEK_END) == 0 ? (long long)ftell(fin) : -1;
+        src = sz >= 0 ? (unsigned char*)malloc(sz ? (size_t)sz : 1) : NULL;
+        srclen = sz >= 0 ? (size_t)sz : 0;
+        if (!src || fseek(fin, 0, SEEK_SET) != 0 || fread(src, 1, srclen, fin) != srclen) {
+            free(src); fclose(fin);
+            log_error("decoder","read encoded failed file=%s", enc_fn); return -1;
+        }
+        fclose(fin);
+    }
+    long long rc = -2;
+    if (tm) {
+        long mb = srclen > (size_t)data_off ? huff_tans_model_decode(src + data_off, srclen - (size_t)data_off, tm) : -1;
+        if (mb < 0) { log_error("decoder","invalid_tans_model file=%s", enc_fn); data_off = (long)srclen; }
+        else {
+            data_off += mb;
+            log_info("decoder","load_tans_model table_log=%d model_bytes=%ld", tm->table_log, mb);
+        }
+    }
+    uint64_t n = 0;
+    size_t unit_len = srclen >= (size_t)data_off + 8 ? srclen - (size_t)data_off - 8 : 0;
+    if (unit_len) for (int i=0;i<8;i++) n |= (uint64_t)src[data_off+i] << (8*i);
+    // 4 路交錯每個符號至少 1 位元；tANS 每個符號至少 log2(T/(T-1)) > 1/T 位元，
+    // 只有單一符號（份數 = T）時可以不佔位元，此時只檢查長度能否配置
+    uint64_t max_n = (uint64_t)unit_len*8;
+    if (tm) {
+        int single = 0;
+        for (int s=0;s<256;s++) single |= tm->norm[s] == 1u << tm->table_log;
+        max_n = single ? (uint64_t)SIZE_MAX/2 : max_n << tm->table_log;
+    }
+    if (!unit_len || n > max_n) {
+        log_error("decoder","invalid_%s_unit file=%s", tm ? "tans" : "x4", enc_fn);
+    } else {
+        bool out_mapped = mf_create(out_fn, (size_t)n, &mout) == 0;
+        unsigned char *dst = out_mapped ? mout.data : (unsigned char*)malloc(n ? (size_t)n : 1);
+        long long misses = 0, bad = -1;
+        if (dst || !n) {
+            if (tm) bad = huff_tans_decode(tm, src + data_off + 8, unit_len, dst, (size_t)n);
+            else    bad = decode_x4_mem(src + data_off + 8, unit_len, dst, (size_t)n, t, root, &misses);
+        }
+        metrics_count("table_misses", misses);
+        if (tm && bad) log_error("decoder","invalid_tans_stream file=%s", enc_fn);
+        else if (bad > 0) log_error("decoder","invalid_traverse bit_position=%lld", bad);
+        rc = bad ? -2 : (long long)n;
+        if (out_mapped) {
+            if (mf_close(&mout) != 0 && rc >= 0) rc = -1;
+        } else {
+            FILE *fout = rc >= 0 ? fopen(out_fn, "wb") : NULL;
+            if (rc >= 0 && (!fout || fwrite(dst, 1, (size_t)n, fout) != (size_t)n)) rc = -1;
+            if (fout && fclose(fout) != 0) rc = -1;
+            if (rc == -1) log_error("decoder","write output failed file=%s", out_fn);
+            free(dst);
+        }
+    }
+    if (mapped) mf_close(&min); else free(src);
+    if (rc >= 0) log_info("decoder","decode_%s mapped=%d decoded_bytes=%lld", tm ? "tans" : "x4", (int)mapped, rc);
+    return rc;
+}
+
+typedef struct {
+    const char *enc_fn, *out_fn;
+    long data_off;
+    const HuffBlockIndex *ix;
+    const DTable *t;
+    const Node *root;
+    const MappedFile *in_map;   // 兩者皆非 NULL 時直接在映射記憶體上解碼，否則各區塊走 stdio
+    MappedFile *out_map;
+    const HuffCrcIndex *cx; // 非 NULL：每個區塊一個檢查碼
+    long long *bad_bit;     // 每區塊：0 成功，>0 出錯位元位置，-1 I/O 失敗，-2 檢查碼不符，-3 因先前失敗而略過
+    long long *misses;      // 每區塊第二層查表次數
+    int x4;                 // 每個區塊是 4 路交錯單位
+    pthread_mutex_t mu;     // 保護 failed
+    bool failed;            // 已有區塊失敗：還沒開始的區塊不再解碼
+} BlockDecode;
+
+static void decode_block_one(BlockDecode *d, int j){
+    const HuffBlockIndex *ix = d->ix;
+    uint64_t start = (uint64_t)j * ix->block_size;
+    size_t n = (size_t)(ix->orig_size - start < ix->block_size ? ix->orig_size - start : ix->block_size);
+    size_t srclen = (size_t)(ix->offsets[j+1] - ix->offsets[j]);
+    if (d->in_map) {
+        uint64_t src_off = (uint64_t)d->data_off + ix->offsets[j];
+        if (src_off + srclen > d->in_map->size) { d->bad_bit[j] = -1; return; }
+        d->bad_bit[j] = (d->x4 ? decode_x4_mem : decode_block_mem)(d->in_map->data + src_off, srclen,
+                                         d->out_map->data + start, n, d->t, d->root, &d->misses[j]);
+        if (d->bad_bit[j] == 0 && d->cx && huff_crc32c(0, d->out_map->data + start, n) != d->cx->crc[j])
+            d->bad_bit[j] = -2;
+        return;
+    }
+    unsigned char *src = (unsigned char*)malloc(srclen ? srclen : 1);
+    unsigned char *dst = (unsigned char*)malloc(n ? n : 1);
+    d->bad_bit[j] = -1;
+    if (!src || !dst) { free(src); free(dst); return; }
+    FILE *fin = fopen(d->enc_fn, "rb");
+    FILE *fout = fopen(d->out_fn, "r+b");
+    if (fin && fout
+        && seek_abs(fin, (uint64_t)d->data_off + ix->offsets[j]) == 0
+        && fread(src, 1, srclen, fin) == srclen) {
+        d->bad_bit[j] = (d->x4 ? decode_x4_mem : decode_block_mem)(src, srclen, dst, n, d->t, d->root, &d->misses[j]);
+        if (d->bad_bit[j] == 0 && d->cx && huff_crc32c(0, dst, n) != d->cx->crc[j]) d->bad_bit[j] = -2;
+        if (d->bad_bit[j] == 0
+            && (seek_abs(fout, start) != 0 || fwrite(dst, 1, n, fout) != n))
+            d->bad_bit[j] = -1;
+    }
+    if (fin) fclose(fin);
+    if (fout) fclose(fout);
+    free(src); free(dst);
+}
+
+/* 區塊依序領取，失敗後才領到的區塊編號都比失敗的區塊大，略過它們不影響找出第一個失敗的區塊 */
+static void decode_block_job(void *ctx, int j){
+    BlockDecode *d = (BlockDecode*)ctx;
+    pthread_mutex_lock(&d->mu);
+    bool skip = d->failed;
+    pthread_mutex_unlock(&d->mu);
+    if (skip) { d->bad_bit[j] = -3; return; }
+    decode_block_one(d, j);
+    if (d->bad_bit[j] != 0) {
+        pthread_mutex_lock(&d->mu);
+        d->failed = true;
+        pthread_mutex_unlock(&d->mu);
+    }
+}
+
+/* 各區塊獨立解碼並寫回輸出檔中自己的位置；回傳解碼位元組數，失敗回傳負值 */
+static long long decode_blocks(const char *enc_fn, long data_off, const char *out_fn, const HuffBlockIndex *ix,
+                               const HuffCrcIndex *cx, const DTable *t, const Node *root, int nthreads, int x4) {
+    // 輸出大小已知：輸入與預留大小的輸出都能映射時，各區塊直接解碼進輸出映射；
+    // 否則先預留輸出檔，各區塊再以獨立的檔案代號讀寫
+    MappedFile min, mout;
+    bool mapped = mf_open_read(enc_fn, &min) == 0;
+    if (mapped && mf_create(out_fn, (size_t)ix->orig_size, &mout) != 0) { mf_close(&min); mapped = false; }
+    if (!mapped) {
+        FILE *fout = fopen(out_fn, "wb");
+        if (!fout) { log_error("decoder","open output failed file=%s", out_fn); return -1; }
+        if (ix->orig_size > 0) { seek_abs(fout, ix->orig_size-1); fputc(0, fout); }
+        fclose(fout);
+    }
+    log_info("decoder","decode_blocks mapped=%d interleave=%d", (int)mapped, x4 ? HUFF_X4_STREAMS : 1);
+
+    BlockDecode d;
+    memset(&d, 0, sizeof d);
+    d.enc_fn = enc_fn; d.out_fn = out_fn; d.data_off = data_off;
+    d.ix = ix; d.t = t; d.root = root; d.cx = cx; d.x4 = x4;
+    d.in_map  = mapped ? &min : NULL;
+    d.out_map = mapped ? &mout : NULL;
+    pthread_mutex_init(&d.mu, NULL);
+    d.bad_bit = (long long*)calloc(ix->nblocks ? ix->nblocks : 1, sizeof(long long));
+    d.misses  = (long long*)calloc(ix->nblocks ? ix->nblocks : 1, sizeof(long long));
+    huff_parallel_for(nthreads, (int)ix->nblocks, decode_block_job, &d);
+    pthread_mutex_destroy(&d.mu);
+
+    long long rc = (long long)ix->orig_size;
+    uint32_t first_bad = ix->nblocks, skipped = 0;
+    for (uint32_t j=0;j<ix->nblocks;j++) {
+        metrics_count("table_misses", d.misses[j]);
+        if (d.bad_bit[j] != 0 && first_bad == ix->nblocks) first_bad = j;
+        skipped += d.bad_bit[j] == -3;
+    }
+    for (uint32_t j=first_bad;j<ix->nblocks;j++) {
+        if (d.bad_bit[j] == -3) continue;
+        if (d.bad_bit[j] == -2)
+            log_error("decoder","checksum_mismatch block=%u offset=%llu block_offset=%llu",
+                      j, (unsigned long long)j * ix->block_size, (unsigned long long)ix->offsets[j]);
+        else if (d.bad_bit[j] < 0)
+            log_error("decoder","block_io failed block=%u", j);
+        else
+            log_error("decoder","invalid_traverse block=%u block_offset=%llu bit_position=%lld",
+                      j, (unsigned long long)ix->offsets[j], d.bad_bit[j]);
+        rc = -2;
+        break;
+    }
+    if (mapped) {
+        mf_close(&min);
+        if (mf_close(&mout) != 0) rc = -1;
+    }
+    // 失敗時輸出檔只留下第一個失敗區塊之前、已驗證過的部分
+    if (first_bad < ix->nblocks) {
+        uint64_t keep = (uint64_t)first_bad * ix->block_size;
+        if (mf_truncate(out_fn, (size_t)keep) != 0) log_error("decoder","truncate output failed file=%s", out_fn);
+        log_info("decoder","decode_blocks aborted first_bad_block=%u skipped_blocks=%u output_bytes=%llu",
+                 first_bad, skipped, (unsigned long long)keep);
+    }
+    free(d.bad_bit); free(d.misses);
+    if (cx && rc >= 0) {
+        log_info("decoder","verify_checksums crc_block=%u count=%u impl=%s status=ok", cx->block, ix->nblocks, huff_crc32c_name());
+        metrics_count("checksum_blocks", ix->nblocks);
+    }
+    return rc;
+}
+
+/* 區塊依序解碼（stdin 或 stdout，無法 seek 或預留輸出）：每次只讀入一個區塊的位元串，
+ * 解碼、比對檢查碼後立即寫出，記憶體只與區塊大小有關。回傳解碼位元組數，失敗回傳負值 */
+static long long decode_blocks_seq(const char *enc_fn, long data_off, const char *out_fn, const HuffBlockIndex *ix,
+                                   const HuffCrcIndex *cx, const DTable *t, const Node *root, int x4) {
+    FILE *fin = open_enc(enc_fn, data_off);
+    if (!fin) return -1;
+    FILE *fout = open_out(out_fn);
+    if (!fout) { close_enc(fin); return -1; }
+    log_info("decoder","decode_blocks mapped=0 sequential=1 interleave=%d", x4 ? HUFF_X4_STREAMS : 1);
+
+    unsigned char *src = NULL, *dst = (unsigned char*)malloc(ix->block_size);
+    size_t src_cap = 0;
+    long long rc = 0;
+    for (uint32_t j=0;j<ix->nblocks && rc==0;j++) {
+        uint64_t start = (uint64_t)j * ix->block_size;
+        size_t n = (size_t)(ix->orig_size - start < ix->block_size ? ix->orig_size - start : ix->block_size);
+        uint64_t srclen = ix->offsets[j+1] - ix->offsets[j];
+        // 依序讀取：各區塊位元串須緊接排列；每個符號最多 HUFF_MAX_CODE_LEN 位元（另加跳躍表與補位）
+        if (ix->offsets[0] != 0 || srclen > (uint64_t)n*HUFF_MAX_CODE_LEN/8 + HUFF_X4_JUMP_BYTES + 16) {
+            log_error("decoder","invalid_block_index block=%u block_offset=%llu", j, (unsigned long long)ix->offsets[j]);
+            rc = -2; break;
+        }
+        if (srclen > src_cap) { src_cap = (size_t)srclen; src = (unsigned char*)realloc(src, src_cap); }
+        if (!src || !dst || fread(src, 1, (size_t)srclen, fin) != (size_t)srclen) {
+            log_error("decoder","truncated_stream block=%u block_offset=%llu", j, (unsigned long long)ix->offsets[j]);
+            rc = -2; break;
+        }
+        long long misses = 0;
+        long long bad = (x4 ? decode_x4_mem : decode_block_mem)(src, (size_t)srclen, dst, n, t, root, &misses);
+        metrics_count("table_misses", misses);
+        if (bad) {
+            log_error("decoder","invalid_traverse block=%u block_offset=%llu bit_position=%lld",
+                      j, (unsigned long long)ix->offsets[j], bad);
+            rc = -2;
+        } else if (cx && huff_crc32c(0, dst, n) != cx->crc[j]) {
+            log_error("decoder","checksum_mismatch block=%u offset=%llu block_offset=%llu",
+                      j, (unsigned long long)start, (unsigned long long)ix->offsets[j]);
+            rc = -2;
+        } else if (fwrite(dst, 1, n, fout) != n) {
+            log_error("decoder","write output failed file=%s", out_fn);
+            rc = -1;
+        }
+    }
+    close_enc(fin);
+    if (close_out(fout) != 0 && rc == 0) { log_error("decoder","write output failed file=%s", out_fn); rc = -1; }
+    free(src); free(dst);
+    if (rc < 0) return rc;
+    if (cx) {
+        log_info("decoder","verify_checksums crc_block=%u count=%u impl=%s status=ok", cx->block, ix->nblocks, huff_crc32c_name());
+        metrics_count("checksum_blocks", ix->nblocks);
+    }
+    return (long long)ix->orig_size;
+}
+
+/* --------- 隨機存取：只解出 [start, start+len) --------- */
+/* 由最近的同步點（區塊起點或同步點索引）開始解碼，先丟棄同步點到 start 之間的符號；
+ * 區塊模式下各區塊獨立補位，跨區塊時逐區塊重新定位。回傳寫出的位元組數，失敗回傳負值 */
+static long long decode_range(const char *enc_fn, long data_off, const HuffBlockIndex *ix,
+                              uint64_t start, uint64_t len, const char *out_fn,
+                              const DTable *t, const Node *root) {
+    FILE *fin = fopen(enc_fn, "rb");
+    if (!fin) { log_error("decoder","open encoded failed file=%s", enc_fn); return -1; }
+    HuffSyncIndex sx = {0};
+    uint64_t orig_size, interval;
+    if (ix->offsets) {
+        orig_size = ix->orig_size; interval = ix->block_size;
+    } else {
+        if (huff_sync_read(fin, &sx) != 0) {
+            log_error("decoder","read_sync_index failed file=%s", enc_fn);
+            fclose(fin); return -1;
+        }
+        orig_size = sx.orig_size; interval = sx.interval;
+        log_info("decoder","read_sync_index interval=%u sync_points=%u orig_size=%llu",
+                 sx.interval, sx.count, (unsigned long long)sx.orig_size);
+    }
+    if (start > orig_size) start = orig_size;
+    if (len > orig_size - start) len = orig_size - start;
+
+    FILE *fout = open_out(out_fn);
+    if (!fout) { fclose(fin); huff_sync_free(&sx); return -1; }
+    unsigned char *obuf = (unsigned char*)malloc(OUT_CHUNK);
+    uint64_t k = interval ? start / interval : 0;
+    uint64_t skip = start - k*interval, done = 0, skipped = 0;
+    long long rc = 0;
+    int seeks = 0;
+    while (done < len && rc == 0) {
+        // 同步點索引：單一連續位元串，定位一次即可解到底；區塊：每區塊結尾有補位，只能解到區塊尾
+        uint64_t seg = ix->offsets ? interval - skip : len - done;
+        if (seg > len - done) seg = len - done;
+        uint64_t bit = ix->offsets ? ix->offsets[k]*8 : sx.bitoff[k];
+        if (seek_abs(fin, (uint64_t)data_off + bit/8) != 0) { rc = -1; break; }
+        BitR br; huff_br_init(&br, fin);
+        huff_br_skip(&br, (int)(bit % 8));
+        seeks++;
+        long long bitpos = 0, bad = 0;
+        for (uint64_t r = skip; r > 0 && !bad; ) {
+            size_t step = r < OUT_CHUNK ? (size_t)r : OUT_CHUNK;
+            bad = br_decode_n(&br, NULL, step, t, root, &bitpos);
+            r -= step;
+        }
+        for (uint64_t r = seg; r > 0 && !bad; ) {
+            size_t step = r < OUT_CHUNK ? (size_t)r : OUT_CHUNK;
+            bad = br_decode_n(&br, obuf, step, t, root, &bitpos);
+            if (!bad && fwrite(obuf, 1, step, fout) != step) { rc = -1; break; }
+            r -= step;
+        }
+        metrics_count("table_misses", br.misses);
+        huff_br_free(&br);
+        if (bad) {
+            log_error("decoder","invalid_traverse sync_point=%llu bit_position=%lld",
+                      (unsigned long long)k, bad);
+            rc = -2; break;
+        }
+        skipped += skip;
+        done += seg; skip = 0; k++;
+    }
+    free(obuf);
+    fclose(fin);
+    if (close_out(fout) != 0 && rc == 0) rc = -1;
+    huff_sync_free(&sx);
+    if (rc < 0) return rc;
+    log_info("decoder","decode_range start=%llu len=%llu sync_seeks=%d skipped_symbols=%llu",
+             (unsigned long long)start, (unsigned long long)len, seeks, (unsigned long long)skipped);
+    return (long long)done;
+}
+
+/* --------- 串流格式解碼 --------- */
+/* 逐 chunk 讀入、必要時重建解碼表並寫出；記憶體只與 chunk 大小有關。
+ * 回傳解碼位元組數，失敗回傳負值 */
+static long long decode_stream(const char *enc_fn, long data_off, int nsym, const char *out_fn, bool use_tree) {
+    FILE *fin = open_enc(enc_fn, data_off);
+    if (!fin) return -1;
+    FILE *fout = open_out(out_fn);
+    if (!fout) { close_enc(fin); return -1; }
+
+    DTable t = {0};
+    Node *root = NULL;
+    bool have_table = false;
+    unsigned char *src = NULL, *dst = NULL;
+    size_t src_cap = 0, dst_cap = 0;
+    long long total = 0, rc = 0, in_off = data_off;
+    int chunks = 0, tables = 0;
+
+    for (;;) {
+        HuffChunk ch;
+        if (huff_chunk_read(fin, &ch) != 0) {
+            log_error("decoder","truncated_stream chunk=%d file_offset=%lld", chunks, in_off);
+            rc = -2; break;
+        }
+        in_off += HUFF_CHUNK_HEADER_BYTES;
+        if (ch.flags & HUFF_CHUNK_LAST) break;
+        if (ch.flags & HUFF_CHUNK_TABLE) {
+            uint8_t len[HUFF_MAX_SYMBOLS];
+            CodeEntry *codes = NULL; int n = 0;
+            if (fread(len, 1, (size_t)nsym, fin) != (size_t)nsym || codes_from_lengths(len, nsym, &codes, &n) != 0) {
+                log_error("decoder","invalid_chunk_table chunk=%d file_offset=%lld", chunks, in_off);
+                rc = -2; break;
             }
+            in_off += nsym;
+            tree_free(root); root = NULL;
+            if (use_tree || dtable_build(&t, codes, n) != 0) { huff_dtable_free(&t, NULL); root = build_tree(codes, n); }
+            codes_free(codes, n);
+            have_table = (t.e != NULL || root != NULL);
+            tables++;
+        }
+        // 每個符號最多 HUFF_MAX_CODE_LEN 位元
+        if (!have_table || ch.orig_len > (1u<<30)
+            || ch.comp_len > (uint64_t)ch.orig_len*HUFF_MAX_CODE_LEN/8 + 16) {
+            log_error("decoder","invalid_chunk chunk=%d file_offset=%lld", chunks, in_off);
+            rc = -2; break;
+        }
+        if (ch.comp_len > src_cap) { src_cap = ch.comp_len; src = (unsigned char*)realloc(src, src_cap); }
+        if (ch.orig_len > dst_cap) { dst_cap = ch.orig_len; dst = (unsigned char*)realloc(dst, dst_cap); }
+        if (fread(src, 1, ch.comp_len, fin) != ch.comp_len) {
+            log_error("decoder","truncated_stream chunk=%d file_offset=%lld", chunks, in_off);
+            rc = -2; break;
         }
+        long long misses = 0;
+        long long bad = decode_block_mem(src, ch.comp_len, dst, ch.orig_len, &t, root, &misses);
+        metrics_count("table_misses", misses);
+        if (bad) {
+            log_error("decoder","invalid_traverse chunk=%d file_offset=%lld bit_position=%lld", chunks, in_off, bad);
+            rc = -2; break;
+        }
+        if (fwrite(dst, 1, ch.orig_len, fout) != ch.orig_len) { rc = -1; break; }
+        in_off += ch.comp_len;
+        total += ch.orig_len;
+        chunks++;
     }
-    fclose(fin); fclose(fout);
-    log_warn("decoder","no EOF_MARK found total_bits=%d decoded_symbols=%d", bit_count, outc);
-    return outc; // 若沒遇到 EOF_MARK，仍回傳已解碼數（視為不完整）
+    close_enc(fin);
+    if (close_out(fout) != 0 && rc == 0) rc = -1;
+    free(src); free(dst);
+    huff_dtable_free(&t, NULL); tree_free(root);
+    if (rc < 0) return rc;
+    metrics_count("chunks", chunks);
+    metrics_count("tables", tables);
+    log_info("decoder","decode_stream chunks=%d tables=%d decoded_bytes=%lld", chunks, tables, total);
+    return total;
 }
 
 int main(int argc, char **argv){
-    if(argc<4){
-        fprintf(stderr, "Usage: %s out_fn cb_fn enc_fn\n", argv[0]);
+    const char *pos[3]; int npos = 0;
+    bool use_tree = false;
+    int nthreads = huff_cpu_count();
+    bool ranged = false;
+    unsigned long long range_start = 0, range_len = 0;
+    const char *metrics_fn = NULL;
+    for (int i=1;i<argc;i++) {
+        if (strcmp(argv[i], "--decode=tree") == 0) use_tree = true;
+        else if (strcmp(argv[i], "--decode=table") == 0) use_tree = false;
+        else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            nthreads = atoi(argv[i]+10);
+            if (nthreads < 1) { npos = -1; break; }
+        }
+        else if (strncmp(argv[i], "--range=", 8) == 0) {
+            char *end;
+            range_start = strtoull(argv[i]+8, &end, 10);
+            if (*end != ':') { npos = -1; break; }
+            range_len = strtoull(end+1, &end, 10);
+            if (*end) { npos = -1; break; }
+            ranged = true;
+        }
+        else if (strncmp(argv[i], "--metrics-json=", 15) == 0) metrics_fn = argv[i]+15;
+        else if (strncmp(argv[i], "--", 2) == 0) { npos = -1; break; }
+        else if (npos < 3) pos[npos++] = argv[i];
+    }
+    // 3 個參數：raw 位元串 + codebook.csv；2 個參數：自帶檔頭的 container
+    if(npos<2){
+        fprintf(stderr, "Usage: %s [--decode=table|tree] out_fn cb_fn enc_fn\n"
+                        "       %s [--decode=table|tree] [--threads=N] out_fn enc_fn   (container format)\n"
+                        "       %s [--decode=table|tree] --range=START:LEN out_fn enc_fn   (blocks or sync index)\n"
+                        "out_fn / enc_fn may be - (stdout / stdin); logs then go to stderr\n"
+                        "Options: --metrics-json=FILE  write per-stage timings and counters as JSON\n",
+                argv[0], argv[0], argv[0]);
         return 1;
     }
-    const char *out_fn = argv[1];
-    const char *cb_fn  = argv[2];
-    const char *enc_fn = argv[3];
+    const char *out_fn = pos[0];
+    const char *cb_fn  = npos==3 ? pos[1] : NULL;
+    const char *enc_fn = pos[npos-1];
+    // "-"：由 stdin 循序讀入、寫到 stdout；資料走 stdout 時 log 改寫到 stderr
+    bool in_std = is_std(enc_fn), out_std = is_std(out_fn);
+    if(out_std) log_set_output(stderr);
+    if(in_std) setvbuf(stdin, NULL, _IOFBF, OUT_CHUNK);
+#ifdef _WIN32
+    if(in_std)  _setmode(_fileno(stdin),  _O_BINARY);
+    if(out_std) _setmode(_fileno(stdout), _O_BINARY);
+#endif
 
     log_info("decoder","start output_file=%s input_codebook=%s input_encoded=%s",
-             out_fn, cb_fn, enc_fn);
+             out_fn, cb_fn?cb_fn:"-", enc_fn);
+    double t0 = metrics_now();     // 亦為計時起點
 
     int entries=0;
-    Node *root = load_codebook_and_build_tree(cb_fn, &entries);
-    if(!root){ log_error("decoder","load_codebook failed status=error"); return 2; }
+    CodeEntry *codes = NULL;
+    long data_off = 0;
+    int flags = 0;
+    HuffHeader hdr;
+    HuffBlockIndex ix = {0};
+    HuffCrcIndex cx = {0};
+    const HuffCrcIndex *crc = NULL;     // 檔案帶檢查碼段
+    if(cb_fn){
+        if(ranged){ log_error("decoder","range unsupported reason=raw_format"); return 1; }
+        codes = load_codebook(cb_fn, &entries);
+    }else{
+        data_off = load_header_codebook(enc_fn, &codes, &entries, &hdr, &cx);
+        if(data_off < 0){ log_error("decoder","load_codebook failed status=error"); return 2; }
+        flags = hdr.flags;
+        if(flags & HUFF_FLAG_CRC) crc = &cx;
+        // 檢查碼段只用於整檔單一位元串與區塊模式
+        if(crc && ((flags & HUFF_NO_LEN_TABLE) || (flags & (HUFF_FLAG_X4|HUFF_FLAG_BLOCKS)) == HUFF_FLAG_X4)){
+            log_error("decoder","invalid_header flags=%d", flags);
+            codes_free(codes, entries); huff_crc_free(&cx); return 2;
+        }
+        if((flags & HUFF_FLAG_X4) && (flags & (HUFF_FLAG_STREAM|HUFF_FLAG_SYNC))){
+            log_error("decoder","invalid_header flags=%d", flags);
+            codes_free(codes, entries); return 2;
+        }
+        if((flags & HUFF_FLAG_CTX1) && (flags & ~(HUFF_FLAG_CTX1|HUFF_FLAG_CRC))){
+            log_error("decoder","invalid_header flags=%d", flags);
+            codes_free(codes, entries); return 2;
+        }
+        if((flags & HUFF_FLAG_TANS) && (flags & ~(HUFF_FLAG_TANS|HUFF_FLAG_CRC))){
+            log_error("decoder","invalid_header flags=%d", flags);
+            codes_free(codes, entries); return 2;
+        }
+        if((flags & HUFF_FLAG_DIGRAM) && (flags & ~(HUFF_FLAG_DIGRAM|HUFF_FLAG_CRC))){
+            log_error("decoder","invalid_header flags=%d", flags);
+            codes_free(codes, entries); return 2;
+        }
+        if(ranged && (flags & HUFF_FLAG_X4)){
+            log_error("decoder","range unsupported reason=interleaved flags=%d", flags);
+            codes_free(codes, entries); return 1;
+        }
+        if(ranged && in_std){
+            log_error("decoder","range unsupported reason=stdin_not_seekable");
+            codes_free(codes, entries); huff_crc_free(&cx); return 1;
+        }
+        // 整檔單一 4 路交錯單位與 tANS 須把整個輸入與輸出放在記憶體，不走 pipe
+        if((in_std || out_std) && ((flags & HUFF_FLAG_TANS) || (flags & (HUFF_FLAG_X4|HUFF_FLAG_BLOCKS)) == HUFF_FLAG_X4)){
+            log_error("decoder","pipe unsupported reason=whole_file_unit flags=%d", flags);
+            codes_free(codes, entries); huff_crc_free(&cx); return 1;
+        }
+        if(ranged && !(flags & (HUFF_FLAG_BLOCKS|HUFF_FLAG_SYNC))){
+            log_error("decoder","range unsupported reason=no_sync_points flags=%d", flags);
+            codes_free(codes, entries); return 1;
+        }
+        if(flags & HUFF_FLAG_CTX1){
+            codes_free(codes, entries);
+            if(use_tree) log_warn("decoder","tree_decode unsupported reason=context_tables fallback=table");
+            metrics_stage("load_codebook", t0);
+            long long n = decode_ctx(enc_fn, data_off, &hdr, crc, out_fn);
+            huff_crc_free(&cx);
+            if(n < 0){ log_error("decoder","decode failed status=error"); return 3; }
+            log_info("metrics","summary input_encoded=%s input_codebook=- output_file=%s decode_mode=context num_decoded_symbols=%lld status=ok",
+                     enc_fn, out_fn, n);
+            if(!is_std(enc_fn)) metrics_count("bytes_in", file_size(enc_fn));
+            metrics_count("bytes_out", n);
+            metrics_report("decoder", metrics_fn);
+            log_info("decoder","finish status=ok");
+            return 0;
+        }
+        if(flags & HUFF_FLAG_DIGRAM){
+            codes_free(codes, entries);
+            if(use_tree) log_warn("decoder","tree_decode unsupported reason=digram fallback=table");
+            metrics_stage("load_codebook", t0);
+            long long n = decode_digram(enc_fn, data_off, &hdr, crc, out_fn);
+            huff_crc_free(&cx);
+            if(n < 0){ log_error("decoder","decode failed status=error"); return 3; }
+            log_info("metrics","summary input_encoded=%s input_codebook=- output_file=%s decode_mode=digram num_decoded_symbols=%lld status=ok",
+                     enc_fn, out_fn, n);
+            if(!is_std(enc_fn)) metrics_count("bytes_in", file_size(enc_fn));
+            metrics_count("bytes_out", n);
+            metrics_report("decoder", metrics_fn);
+            log_info("decoder","finish status=ok");
+            return 0;
+        }
+        if(flags & HUFF_FLAG_TANS){
+            if(use_tree) log_warn("decoder","tree_decode unsupported reason=tans fallback=tans");
+            metrics_stage("load_codebook", t0);
+            t0 = metrics_now();
+            HuffTansModel tm;
+            long long n = decode_unit_file(enc_fn, data_off, out_fn, NULL, NULL, &tm);
+            if(n < 0){ log_error("decoder","decode failed status=error"); return 3; }
+            metrics_stage("decode", t0);
+            log_info("metrics","summary input_encoded=%s input_codebook=- output_file=%s decode_mode=tans num_decoded_symbols=%lld status=ok",
+                     enc_fn, out_fn, n);
+            if(!is_std(enc_fn)) metrics_count("bytes_in", file_size(enc_fn));
+            metrics_count("bytes_out", n);
+            metrics_report("decoder", metrics_fn);
+            log_info("decoder","finish status=ok");
+            return 0;
+        }
+        if(flags & HUFF_FLAG_STREAM){
+            metrics_stage("load_codebook", t0);
+            t0 = metrics_now();
+            long long n = decode_stream(enc_fn, data_off, hdr.nsym, out_fn, use_tree);
+            if(n < 0){ log_error("decoder","decode failed status=error"); return 3; }
+            metrics_stage("decode", t0);
+            log_info("metrics","summary input_encoded=%s input_codebook=- output_file=%s decode_mode=%s num_decoded_symbols=%lld status=ok",
+                     enc_fn, out_fn, use_tree ? "tree" : "table", n);
+            if(!is_std(enc_fn)) metrics_count("bytes_in", file_size(enc_fn));
+            metrics_count("bytes_out", n);
+            metrics_report("decoder", metrics_fn);
+            log_info("decoder","finish status=ok");
+            return 0;
+        }
+        if(crc && verify_header_crc(&hdr, crc, NULL, 0) != 0){ codes_free(codes, entries); codes = NULL; }
+        if(codes && (flags & HUFF_FLAG_BLOCKS)){
+            data_off = load_block_index(enc_fn, data_off, &ix);
+            if(data_off < 0){ codes_free(codes, entries); codes = NULL; }
+            else if(crc && (cx.block != ix.block_size || cx.orig_size != ix.orig_size)){
+                log_error("decoder","invalid_checksums crc_block=%u block_size=%u", cx.block, ix.block_size);
+                codes_free(codes, entries); codes = NULL;
+            }
+        }
+    }
+    if(!codes){ log_error("decoder","load_codebook failed status=error"); huff_index_free(&ix); huff_crc_free(&cx); return 2; }
+    metrics_stage("load_codebook", t0);
 
-    log_info("decoder","build_tree entries=%d", entries);
+    t0 = metrics_now();
+    DTable table = {0};
+    if (!use_tree && dtable_build(&table, codes, entries) != 0) {
+        log_warn("decoder","build_table unsupported_codebook fallback=tree");
+        use_tree = true;
+    }
+    Node *root = NULL;
+    if (use_tree) {
+        root = build_tree(codes, entries);
+        if(!root){ log_error("decoder","load_codebook failed status=error"); codes_free(codes, entries); return 2; }
+        log_info("decoder","build_tree entries=%d", entries);
+    } else {
+        log_info("decoder","build_table entries=%d root_bits=%d table_entries=%d max_code_len=%d single_lookup=%d",
+                 entries, HUFF_DT_ROOT_BITS, table.size, table.max_len, (int)(table.max_len <= HUFF_DT_ROOT_BITS));
+    }
+    codes_free(codes, entries);
+    metrics_stage(use_tree ? "build_tree" : "build_table", t0);
 
-    int n = decode_bitstream(enc_fn, out_fn, root);
+    t0 = metrics_now();
+    long long n;
+    // 部分範圍不比對檢查碼
+    if (crc && ranged) log_warn("decoder","verify_checksums skipped reason=range");
+    if (ranged) {
+        n = decode_range(enc_fn, data_off, &ix, range_start, range_len, out_fn, &table, root);
+    } else if ((flags & HUFF_FLAG_BLOCKS) && (in_std || out_std)) {
+        n = decode_blocks_seq(enc_fn, data_off, out_fn, &ix, crc, &table, root, (flags & HUFF_FLAG_X4) != 0);
+    } else if (flags & HUFF_FLAG_BLOCKS) {
+        n = decode_blocks(enc_fn, data_off, out_fn, &ix, crc, &table, root, nthreads, (flags & HUFF_FLAG_X4) != 0);
+        if (n >= 0) log_info("decoder","decode_blocks nblocks=%u threads=%d", ix.nblocks, nthreads);
+    } else if (flags & HUFF_FLAG_X4) {
+        n = decode_unit_file(enc_fn, data_off, out_fn, &table, root, NULL);
+    } else {
+        n = use_tree ? decode_bitstream(enc_fn, data_off, out_fn, root, crc)
+                     : decode_bitstream_table(enc_fn, data_off, out_fn, &table, NULL, NULL, crc);
+    }
     if(n < 0){
         log_error("decoder","decode failed status=error");
-        tree_free(root);
+        tree_free(root); huff_dtable_free(&table, NULL); huff_index_free(&ix); huff_crc_free(&cx);
         return 3;
     }
+    metrics_stage("decode", t0);
 
-    log_info("metrics","summary input_encoded=%s input_codebook=%s output_file=%s num_decoded_symbols=%d status=ok",
-             enc_fn, cb_fn, out_fn, n);
+    log_info("metrics","summary input_encoded=%s input_codebook=%s output_file=%s decode_mode=%s num_decoded_symbols=%lld status=ok",
+             enc_fn, cb_fn?cb_fn:"-", out_fn, use_tree ? "tree" : "table", n);
+    if(!is_std(enc_fn)) metrics_count("bytes_in", file_size(enc_fn));
+    metrics_count("bytes_out", n);
+    metrics_report("decoder", metrics_fn);
     log_info("decoder","finish status=ok");
 
-    tree_free(root);
+    tree_free(root); huff_dtable_free(&table, NULL); huff_index_free(&ix); huff_crc_free(&cx);
     return 0;
 }
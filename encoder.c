@@ -6,85 +6,27 @@
 #include <math.h>
 #include <stdbool.h>
 #include "logger.h"
+#include "huff.h"
+#include "mapio.h"
+#include "metrics.h"
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
 
 #define ALPHABET 256
 #define EOF_MARK 256           // Huffman 內部用的 EOF 符號
 #define MAX_SYMBOLS (ALPHABET+1)
 
-typedef struct Node {
-    long long freq;
-    int symbol;                // 0..255 或 EOF_MARK；內部節點為 -1
-    int minSym;                // 子樹中最小的 symbol（做 tie-break）
-    struct Node *l, *r;
-} Node;
+typedef HuffCode Code;
 
-typedef struct {
-    Node **a;
-    int n, cap;
-} MinHeap;
-
-/* ----------------- 小工具 ----------------- */
-static Node* node_new(long long f, int sym, Node *l, Node *r) {
-    Node *p = (Node*)malloc(sizeof(Node));
-    p->freq = f; p->symbol = sym; p->l = l; p->r = r;
-    int ml = l ? l->minSym : 1000000;
-    int mr = r ? r->minSym : 1000000;
-    if (sym >= 0) p->minSym = sym;
-    else p->minSym = (ml < mr ? ml : mr);
-    return p;
-}
-static void tree_free(Node *p){ if(!p) return; tree_free(p->l); tree_free(p->r); free(p); }
-static int cmp_node(Node *x, Node *y){
-    if (x->freq != y->freq) return (x->freq < y->freq) ? -1 : 1;
-    // tie-break：minSym 小者在前，確保可重現性
-    if (x->minSym != y->minSym) return (x->minSym < y->minSym) ? -1 : 1;
-    return 0;
-}
-
-/* ----------------- 最小堆 ----------------- */
-static void heap_init(MinHeap *h, int cap){ h->a=(Node**)malloc(sizeof(Node*)*cap); h->n=0; h->cap=cap; }
-static void heap_free(MinHeap *h){ free(h->a); }
-static void heap_push(MinHeap *h, Node *v){
-    if(h->n==h->cap){ h->cap*=2; h->a=(Node**)realloc(h->a,sizeof(Node*)*h->cap); }
-    int i=h->n++; h->a[i]=v;
-    while(i>0){
-        int p=(i-1)/2;
-        if (cmp_node(h->a[i], h->a[p])>=0) break;
-        Node* t=h->a[i]; h->a[i]=h->a[p]; h->a[p]=t; i=p;
-    }
-}
-static Node* heap_pop(MinHeap *h){
-    if(h->n==0) return NULL;
-    Node* ret=h->a[0];
-    h->a[0]=h->a[--h->n];
-    int i=0;
-    while(1){
-        int l=i*2+1, r=i*2+2, m=i;
-        if(l<h->n && cmp_node(h->a[l],h->a[m])<0) m=l;
-        if(r<h->n && cmp_node(h->a[r],h->a[m])<0) m=r;
-        if(m==i) break;
-        Node* t=h->a[i]; h->a[i]=h->a[m]; h->a[m]=t; i=m;
-    }
-    return ret;
-}
-
-/* ----------------- 產生 codeword ----------------- */
-typedef struct { char *s; } Str;
-static void gen_codes_rec(Node *p, char *buf, int d, Str code[MAX_SYMBOLS]){
-    if(!p) return;
-    if(p->l==NULL && p->r==NULL && p->symbol>=0){
-        buf[d]='\0';
-        code[p->symbol].s = (char*)malloc(d+1);
-        strcpy(code[p->symbol].s, d?buf:"0"); // 單一符號邊界：給 '0'
-        return;
-    }
-    buf[d]='0'; gen_codes_rec(p->l, buf, d+1, code);
-    buf[d]='1'; gen_codes_rec(p->r, buf, d+1, code);
-}
-static void gen_codes(Node *root, Str code[MAX_SYMBOLS]){
-    for(int i=0;i<MAX_SYMBOLS;i++) code[i].s=NULL;
-    char buf[2048];
-    gen_codes_rec(root, buf, 0, code);
+static void code_to_str(Code c, char *dst){
+    for(int k=0;k<c.len;k++) dst[k] = ((c.bits>>(c.len-1-k))&1) ? '1' : '0';
+    dst[c.len]='\0';
 }
 
 /* ----------------- CSV symbol 轉義 ----------------- */
@@ -109,53 +51,428 @@ static void symbol_to_esc(unsigned char b, char dst[8]) {
     }
 }
 
-/* ----------------- 位元寫出 ----------------- */
+#define OUT_BUF_SIZE (1<<20)
+typedef HuffBitWriter BitW;
+
+/* 同步點：每 interval 個原始位元組記錄一次目前的位元位置 */
 typedef struct {
-    FILE *f; unsigned acc; int nbits;
-    long long total_bits;
-} BitW;
+    HuffSyncIndex ix;
+    long long pos;          // 已編碼的原始位元組數
+} SyncRec;
 
-static void bw_init(BitW *bw, FILE *f){ bw->f=f; bw->acc=0; bw->nbits=0; bw->total_bits=0; }
-static void bw_put(BitW *bw, int bit){
-    bw->acc = (bw->acc<<1) | (bit&1);
-    bw->nbits++;
-    bw->total_bits++;
-    if(bw->nbits==8){
-        fputc((unsigned char)bw->acc, bw->f);
-        bw->acc=0; bw->nbits=0;
+static void encode_buffer_sync(BitW *bw, const Code code[MAX_SYMBOLS], const unsigned char *src, size_t n,
+                               SyncRec *sr){
+    if(!sr){ huff_bw_encode(bw, code, src, n); return; }
+    while(n>0){
+        size_t in_seg = (size_t)(sr->pos % sr->ix.interval);
+        if(in_seg==0) sr->ix.bitoff[sr->pos / sr->ix.interval] = (uint64_t)bw->total_bits;
+        size_t step = sr->ix.interval - in_seg;
+        if(step > n) step = n;
+        huff_bw_encode(bw, code, src, step);
+        src += step; n -= step; sr->pos += (long long)step;
     }
 }
-static void bw_put_code(BitW *bw, const char *code){
-    for(const char *p=code; *p; ++p) bw_put(bw, *p=='1');
+
+/* 檢查碼：依輸入順序每 ix.block 個位元組一個 CRC32C，跨讀取邊界接續 */
+typedef struct {
+    HuffCrcIndex ix;        // orig_size 與 count 隨輸入累加
+    uint32_t cap;           // ix.crc 已配置的項數
+    uint32_t fill, cur;     // 目前這段已累計的位元組數與 CRC
+} CrcRec;
+
+static void crc_push(CrcRec *c){
+    if(c->ix.count == c->cap){
+        c->cap = c->cap ? c->cap*2 : 64;
+        c->ix.crc = (uint32_t*)realloc(c->ix.crc, sizeof(uint32_t)*c->cap);
+    }
+    c->ix.crc[c->ix.count++] = c->cur;
+    c->fill = 0; c->cur = 0;
 }
-static void bw_flush_zero(BitW *bw){
-    if(bw->nbits>0){
-        while(bw->nbits!=0) bw_put(bw, 0);
+
+static void crc_feed(CrcRec *c, const unsigned char *src, size_t n){
+    while(n>0){
+        size_t step = c->ix.block - c->fill;
+        if(step > n) step = n;
+        c->cur = huff_crc32c(c->cur, src, step);
+        c->fill += (uint32_t)step; c->ix.orig_size += step;
+        src += step; n -= step;
+        if(c->fill == c->ix.block) crc_push(c);
     }
 }
 
-/* ----------------- 統計與建樹 ----------------- */
-static Node* build_huffman(long long freq[MAX_SYMBOLS], int *unique_out){
-    MinHeap h; heap_init(&h, 512);
-    int unique=0;
-    for(int s=0;s<MAX_SYMBOLS;s++){
-        if(freq[s]>0){
-            heap_push(&h, node_new(freq[s], s, NULL, NULL));
-            unique++;
+/* 最後一段不滿 ix.block 時補上；依最終檔頭與其後的表封上 header_crc，回傳編碼後的檢查碼段（*n 為長度） */
+static unsigned char *crc_section(CrcRec *c, const HuffHeader *hdr, const unsigned char *tab, size_t tn, size_t *n){
+    if(c->fill) crc_push(c);
+    c->ix.header_crc = huff_crc_header(hdr, &c->ix, tab, tn);
+    *n = huff_crc_size(&c->ix);
+    unsigned char *p = (unsigned char*)malloc(*n);
+    if(p) huff_crc_encode(&c->ix, p);
+    return p;
+}
+
+/* 讀滿 n 個位元組或到檔尾（pipe 可能一次只給一部分） */
+static size_t read_full(FILE *f, unsigned char *buf, size_t n){
+    size_t got = 0, r;
+    while(got < n && (r = fread(buf+got, 1, n-got, f)) > 0) got += r;
+    return got;
+}
+
+/* ----------------- order-1 context ----------------- */
+/* order-1 次數：f1[前一個 byte][byte]；*prev 跨呼叫保存（起始為 0） */
+static void count_order1(const unsigned char *src, size_t n, int *prev, long long (*f1)[MAX_SYMBOLS]){
+    int p = *prev;
+    for(size_t i=0;i<n;i++){ f1[p][src[i]]++; p = src[i]; }
+    *prev = p;
+}
+
+/* 每個 byte 以前一個 byte 所屬類別的表編碼；*prev 跨呼叫保存 */
+static void encode_buffer_ctx(BitW *bw, const Code (*ctab)[MAX_SYMBOLS], const uint8_t *map, int *prev,
+                              const unsigned char *src, size_t n){
+    int p = *prev;
+    for(size_t i=0;i<n;i++){ huff_bw_put(bw, ctab[map[p]][src[i]]); p = src[i]; }
+    *prev = p;
+}
+
+/* ----------------- 區塊平行編碼 ----------------- */
+/* 一批連續區塊：每個區塊由一條執行緒獨立編碼到自己的輸出緩衝 */
+typedef struct {
+    const Code *code;
+    const unsigned char *src;
+    size_t src_len, block_size;
+    unsigned char **dst;
+    size_t dst_cap, *dst_len;
+    long long *bits;        // -1：輸出緩衝不足
+    int x4;                 // 每個區塊編成 4 路交錯位元串
+} BlockBatch;
+
+static void encode_block_job(void *ctx, int j){
+    BlockBatch *b = (BlockBatch*)ctx;
+    size_t off = (size_t)j * b->block_size;
+    size_t n = b->src_len - off < b->block_size ? b->src_len - off : b->block_size;
+    const unsigned char *src = b->src + off;
+    if(b->x4){
+        long long w = huff_x4_encode(b->code, src, n, b->dst[j], b->dst_cap, &b->bits[j]);
+        b->dst_len[j] = w < 0 ? 0 : (size_t)w;
+        if(w < 0) b->bits[j] = -1;
+        return;
+    }
+    BitW bw; huff_bw_init_mem(&bw, b->dst[j], b->dst_cap);
+    huff_bw_encode(&bw, b->code, src, n);
+    huff_bw_flush(&bw);
+    b->dst_len[j] = bw.pos;
+    b->bits[j] = bw.total_bits;
+}
+
+/* 寫出檔頭、檢查碼段（cr 非 NULL，每個區塊一段）、區塊索引與各區塊位元串；索引先以 0 佔位，寫完區塊後回填。
+ * src_map 非 NULL 時直接由映射的輸入取資料，否則由 fin 讀入。
+ * 回傳 0 成功，-1 讀寫失敗 */
+static int encode_blocks(FILE *fin, const unsigned char *src_map, FILE *fenc, HuffHeader *hdr,
+                         const Code code[MAX_SYMBOLS], long long orig_size, size_t block_size,
+                         CrcRec *cr, int nthreads, long long *total_bits){
+    HuffBlockIndex ix;
+    ix.block_size = (uint32_t)block_size;
+    ix.orig_size  = (uint64_t)orig_size;
+    ix.nblocks    = (uint32_t)((orig_size + (long long)block_size - 1) / (long long)block_size);
+    ix.offsets    = (uint64_t*)calloc((size_t)ix.nblocks+1, sizeof(uint64_t));
+
+    hdr->flags |= HUFF_FLAG_BLOCKS;
+    if(huff_header_write(fenc, hdr)<0){ free(ix.offsets); return -1; }
+    if(cr){
+        size_t cn;
+        unsigned char *cs = crc_section(cr, hdr, NULL, 0, &cn);
+        int bad = !cs || fwrite(cs, 1, cn, fenc)!=cn;
+        free(cs);
+        if(bad){ free(ix.offsets); return -1; }
+    }
+    long index_pos = ftell(fenc);
+    if(huff_index_write(fenc, &ix)<0){ free(ix.offsets); return -1; }
+
+    int max_len = 0;
+    for(int s=0;s<MAX_SYMBOLS;s++) if(code[s].len>max_len) max_len=code[s].len;
+
+    int batch = nthreads*2;
+    BlockBatch b;
+    unsigned char *ibuf = src_map ? NULL : (unsigned char*)malloc(block_size*batch);
+    b.code = code; b.src = ibuf; b.block_size = block_size;
+    b.x4 = (hdr->flags & HUFF_FLAG_X4) != 0;
+    b.dst_cap = b.x4 ? huff_x4_bound(block_size, max_len) : block_size*(size_t)max_len/8 + 16;
+    b.dst = (unsigned char**)malloc(sizeof(unsigned char*)*batch);
+    b.dst_len = (size_t*)malloc(sizeof(size_t)*batch);
+    b.bits = (long long*)malloc(sizeof(long long)*batch);
+    for(int j=0;j<batch;j++) b.dst[j] = (unsigned char*)malloc(b.dst_cap);
+
+    int rc = 0;
+    uint32_t blk = 0;
+    uint64_t data_off = 0;
+    long long seen = 0;
+    *total_bits = 0;
+    while(rc==0 && seen < orig_size){
+        size_t got;
+        if(src_map){
+            long long left = orig_size - seen;
+            got = left < (long long)(block_size*batch) ? (size_t)left : block_size*batch;
+            b.src = src_map + seen;
+        }else{
+            got = fread(ibuf, 1, block_size*batch, fin);
         }
+        if(got==0) break;
+        seen += (long long)got;
+        if(seen > orig_size){ rc=-1; break; }       // 兩次讀取之間輸入檔被改動
+        int njobs = (int)((got + block_size - 1) / block_size);
+        b.src_len = got;
+        huff_parallel_for(nthreads, njobs, encode_block_job, &b);
+        for(int j=0;j<njobs;j++){
+            if(b.bits[j] < 0 || fwrite(b.dst[j], 1, b.dst_len[j], fenc)!=b.dst_len[j]){ rc=-1; break; }
+            ix.offsets[blk++] = data_off;
+            data_off += b.dst_len[j];
+            *total_bits += b.bits[j];
+        }
+    }
+    if(rc==0 && (seen!=orig_size || blk!=ix.nblocks)) rc=-1;
+    if(rc==0){
+        ix.offsets[ix.nblocks] = data_off;
+        if(fseek(fenc, index_pos, SEEK_SET)!=0 || huff_index_write(fenc, &ix)<0) rc=-1;
+        fseek(fenc, 0, SEEK_END);
     }
-    if(unique==0){ heap_free(&h); return NULL; }
-    while(h.n>=2){
-        Node *a=heap_pop(&h), *b=heap_pop(&h);
-        heap_push(&h, node_new(a->freq+b->freq, -1, a, b));
+
+    for(int j=0;j<batch;j++) free(b.dst[j]);
+    free(b.dst); free(b.dst_len); free(b.bits); free(ibuf); free(ix.offsets);
+    return rc;
+}
+
+/* 整檔編成單一 4 路交錯單位：檔頭、u64 orig_size、單位。src_map 為 NULL 時先將整個輸入讀進記憶體。
+ * 回傳 0 成功，-1 讀寫失敗 */
+static int encode_x4_file(FILE *fin, const unsigned char *src_map, FILE *fenc, const HuffHeader *hdr,
+                          const Code code[MAX_SYMBOLS], long long orig_size,
+                          long long *bytes_out, long long *total_bits){
+    unsigned char *ibuf = NULL;
+    const unsigned char *src = src_map;
+    if(!src){
+        ibuf = (unsigned char*)malloc(orig_size ? (size_t)orig_size : 1);
+        if(!ibuf || read_full(fin, ibuf, (size_t)orig_size)!=(size_t)orig_size){ free(ibuf); return -1; }
+        src = ibuf;
+    }
+    size_t cap = huff_x4_bound((size_t)orig_size, huff_max_code_len(code, MAX_SYMBOLS));
+    unsigned char *obuf = (unsigned char*)malloc(cap);
+    long long w = obuf ? huff_x4_encode(code, src, (size_t)orig_size, obuf, cap, total_bits) : -1;
+    unsigned char sz[8];
+    for(int i=0;i<8;i++) sz[i] = (unsigned char)((uint64_t)orig_size >> (8*i));
+    long hb = w < 0 ? -1 : huff_header_write(fenc, hdr);
+    int rc = (hb < 0 || fwrite(sz, 1, 8, fenc)!=8 || fwrite(obuf, 1, (size_t)w, fenc)!=(size_t)w) ? -1 : 0;
+    *bytes_out = rc==0 ? hb + 8 + w : 0;
+    free(obuf); free(ibuf);
+    return rc;
+}
+
+/* 整檔以 tANS 編碼：檔頭、模型、u64 orig_size、位元串。src_map 為 NULL 時先將整個輸入讀進記憶體。
+ * *total_bits 為位元串位元數（含最終狀態與哨兵）。回傳 0 成功，-1 讀寫失敗 */
+static int encode_tans_file(FILE *fin, const unsigned char *src_map, FILE *fenc, const HuffHeader *hdr,
+                            const HuffTansModel *m, long long orig_size,
+                            long long *bytes_out, long long *total_bits){
+    unsigned char *ibuf = NULL;
+    const unsigned char *src = src_map;
+    if(!src){
+        ibuf = (unsigned char*)malloc(orig_size ? (size_t)orig_size : 1);
+        if(!ibuf || read_full(fin, ibuf, (size_t)orig_size)!=(size_t)orig_size){ free(ibuf); return -1; }
+        src = ibuf;
     }
-    Node *root=heap_pop(&h);
-    heap_free(&h);
-    if(unique_out) *unique_out=unique;
-    return root;
+    size_t mb = huff_tans_model_size(m);
+    size_t cap = mb + 8 + huff_tans_bound((size_t)orig_size, m->table_log);
+    unsigned char *obuf = (unsigned char*)malloc(cap);
+    long long w = -1;
+    if(obuf){
+        huff_tans_model_encode(m, obuf);
+        for(int i=0;i<8;i++) obuf[mb+i] = (unsigned char)((uint64_t)orig_size >> (8*i));
+        w = huff_tans_encode(m, src, (size_t)orig_size, obuf + mb + 8, cap - mb - 8);
+    }
+    long hb = w < 0 ? -1 : huff_header_write(fenc, hdr);
+    int rc = (hb < 0 || fwrite(obuf, 1, mb + 8 + (size_t)w, fenc)!=mb + 8 + (size_t)w) ? -1 : 0;
+    *bytes_out = rc==0 ? hb + (long long)mb + 8 + w : 0;
+    *total_bits = rc==0 ? 8*w : 0;
+    free(obuf); free(ibuf);
+    return rc;
 }
 
-static int code_len(const char *s){ return (int)strlen(s); }
+/* ----------------- 擴充字母表（byte 對） ----------------- */
+typedef struct {
+    HuffDigrams *dg;
+    long long *freq;           // 貪婪切分後各符號次數（含 EOF_MARK）
+    uint8_t *len;
+    Code *code;
+    int nsym, pruned;          // nsym：byte、EOF_MARK 與使用中的 byte 對；pruned：用量不足而移除的 byte 對
+    long long symbols, bits;   // 切分後符號數（含 EOF_MARK）、位元串位元數（不含補位）
+} DigramModel;
+
+static void digram_free(DigramModel *dm){
+    free(dm->dg); free(dm->freq); free(dm->len); free(dm->code);
+    memset(dm, 0, sizeof *dm);
+}
+
+/* 取最多 max_pairs 個常見 byte 對並依貪婪切分重新統計；切分後用量不足的 byte 對移除後再切分一次。
+ * code 長度以 package-merge 限制在 max_len 內。位元串加上 byte 對表不比 base_bits（只用 byte 的位元數）少時
+ * （例如近乎均勻的資料）改為不用 byte 對。回傳 0 成功，-1 配置或建碼失敗 */
+static int digram_build(const unsigned char *src, size_t n, int max_pairs, int max_len, long long base_bits,
+                        DigramModel *dm){
+    memset(dm, 0, sizeof *dm);
+    dm->dg   = (HuffDigrams*)calloc(1, sizeof(HuffDigrams));
+    dm->freq = (long long*)calloc(HUFF_EXT_MAX_SYMBOLS, sizeof(long long));
+    dm->len  = (uint8_t*)calloc(HUFF_EXT_MAX_SYMBOLS, 1);
+    dm->code = (Code*)calloc(HUFF_EXT_MAX_SYMBOLS, sizeof(Code));
+    uint64_t *val = (uint64_t*)malloc(sizeof(uint64_t)*HUFF_EXT_MAX_SYMBOLS);
+    int rc = (dm->dg && dm->freq && dm->len && dm->code && val) ? 0 : -1;
+    if(rc==0 && huff_digram_select(src, n, max_pairs, dm->dg, NULL) < 0) rc = -1;
+    if(rc==0){
+        huff_digram_count(dm->dg, src, n, dm->freq);
+        dm->pruned = huff_digram_prune(dm->dg, dm->freq, HUFF_DIGRAM_MIN_COUNT);
+        if(dm->pruned){
+            memset(dm->freq, 0, sizeof(long long)*HUFF_EXT_MAX_SYMBOLS);
+            huff_digram_count(dm->dg, src, n, dm->freq);
+            dm->pruned += huff_digram_prune(dm->dg, dm->freq, 1);
+        }
+        dm->freq[EOF_MARK] = 1;
+        dm->nsym = MAX_SYMBOLS + dm->dg->n;
+        if(huff_limited_lengths(dm->freq, dm->nsym, max_len, dm->len, NULL)!=0 ||
+           huff_canonical_codes(dm->len, dm->nsym, val)!=0) rc = -1;
+    }
+    for(int s=0;rc==0 && s<dm->nsym;s++){
+        dm->code[s].bits = val[s]; dm->code[s].len = dm->len[s];
+        dm->symbols += dm->freq[s];
+        dm->bits += dm->freq[s]*dm->len[s];
+    }
+    free(val);
+    if(rc!=0) digram_free(dm);
+    else if(dm->dg->n && dm->bits + 24LL*dm->dg->n >= base_bits){
+        int pruned = dm->pruned + dm->dg->n;
+        digram_free(dm);
+        rc = digram_build(src, n, 0, max_len, base_bits, dm);
+        dm->pruned = pruned;
+    }
+    return rc;
+}
+
+/* 檔頭（byte 與 EOF_MARK 的長度）、檢查碼段（cr 非 NULL）、byte 對表、以 EOF_MARK 結尾的位元串。回傳 0 成功，-1 寫出失敗 */
+static int encode_digram_file(const unsigned char *src, size_t n, FILE *fenc, const HuffHeader *hdr,
+                              const DigramModel *dm, CrcRec *cr, long long *bytes_out, long long *total_bits){
+    size_t tb = huff_digram_size(dm->dg);
+    size_t bits_bytes = (size_t)((dm->bits + 7) / 8);
+    unsigned char *obuf = (unsigned char*)malloc(tb + bits_bytes + 8);
+    if(!obuf) return -1;
+    huff_digram_encode(dm->dg, dm->len, obuf);
+    BitW bw; huff_bw_init_mem(&bw, obuf + tb, bits_bytes + 8);
+    huff_bw_encode_digram(&bw, dm->code, dm->dg, src, n);
+    huff_bw_put(&bw, dm->code[EOF_MARK]);
+    huff_bw_flush(&bw);
+    size_t cn = 0;
+    unsigned char *cs = cr ? crc_section(cr, hdr, obuf, tb, &cn) : NULL;
+    long hb = huff_header_write(fenc, hdr);
+    int rc = (bw.overflow || bw.pos != bits_bytes || hb < 0 || (cr && !cs) || (cn && fwrite(cs, 1, cn, fenc)!=cn)
+              || fwrite(obuf, 1, tb + bw.pos, fenc)!=tb + bw.pos) ? -1 : 0;
+    *bytes_out = rc==0 ? hb + (long long)(cn + tb + bw.pos) : 0;
+    free(cs);
+    *total_bits = bw.total_bits;
+    free(obuf);
+    return rc;
+}
+
+/* ----------------- 單次讀取串流編碼 ----------------- */
+typedef struct {
+    long long in_bytes, out_bytes, bits;   // bits：不含補位的 Huffman 位元數
+    long long freq[MAX_SYMBOLS];           // 全部 chunk 的 histogram（僅供 metrics）
+    int chunks, tables;
+} StreamStats;
+
+/* 每讀入一個 chunk 就建表、編碼並立即寫出；若上一個 chunk 的表
+ * （含省下的長度表）不比新表差，就沿用舊表。記憶體用量只與 chunk_size 有關。
+ * 回傳 0 成功，-1 讀寫或建表失敗 */
+static int encode_stream(FILE *fin, FILE *fenc, size_t chunk_size, int max_code_len, StreamStats *st){
+    HuffHeader hdr = {0};
+    hdr.flags = HUFF_FLAG_STREAM;
+    hdr.nsym  = MAX_SYMBOLS;
+    long hb = huff_header_write(fenc, &hdr);
+    if(hb<0) return -1;
+    st->out_bytes = hb;
+
+    unsigned char *ibuf = (unsigned char*)malloc(chunk_size);
+    size_t obuf_cap = chunk_size*(size_t)HUFF_MAX_CODE_LEN/8 + 16;
+    unsigned char *obuf = (unsigned char*)malloc(obuf_cap);
+    Code cur[MAX_SYMBOLS], cand[MAX_SYMBOLS];
+    uint8_t cur_len[MAX_SYMBOLS], cand_len[MAX_SYMBOLS];
+    bool have_table = false;
+    int rc = 0;
+
+    size_t got;
+    double t0 = metrics_now();
+    while(rc==0 && (got = read_full(fin, ibuf, chunk_size)) > 0){
+        metrics_stage("read", t0);
+        t0 = metrics_now();
+        long long freq[MAX_SYMBOLS]={0};
+        huff_histogram(ibuf, got, freq);
+        metrics_stage("count_symbols", t0);
+
+        t0 = metrics_now();
+        if(huff_build_codes(freq, MAX_SYMBOLS, cand, NULL)!=0
+           || huff_canonicalize(cand, MAX_SYMBOLS, cand_len)!=0){ rc=-1; break; }
+        if(max_code_len && huff_limit_codes(freq, MAX_SYMBOLS, max_code_len, cand, cand_len, NULL)!=0){ rc=-1; break; }
+        metrics_stage("build_huffman_tree", t0);
+
+        // 新表的成本包含要多寫一份長度表；舊表缺少任何出現的符號就不能沿用
+        bool reusable = have_table;
+        long long new_bits = (long long)MAX_SYMBOLS*8, old_bits = 0;
+        for(int s=0;s<MAX_SYMBOLS;s++){
+            if(!freq[s]) continue;
+            new_bits += freq[s]*cand[s].len;
+            if(reusable && cur[s].len) old_bits += freq[s]*cur[s].len;
+            else reusable = false;
+        }
+        HuffChunk ch = { 0, (uint32_t)got, 0 };
+        if(!reusable || old_bits > new_bits){
+            memcpy(cur, cand, sizeof cur);
+            memcpy(cur_len, cand_len, sizeof cur_len);
+            have_table = true;
+            ch.flags |= HUFF_CHUNK_TABLE;
+            st->tables++;
+        }
+
+        t0 = metrics_now();
+        BitW bw; huff_bw_init_mem(&bw, obuf, obuf_cap);
+        huff_bw_encode(&bw, cur, ibuf, got);
+        long long bits = bw.total_bits;
+        huff_bw_flush(&bw);
+        ch.comp_len = (uint32_t)bw.pos;
+        metrics_stage("encode_to_bitstream", t0);
+
+        t0 = metrics_now();
+        if(huff_chunk_write(fenc, &ch)!=0
+           || ((ch.flags & HUFF_CHUNK_TABLE) && fwrite(cur_len, 1, MAX_SYMBOLS, fenc)!=MAX_SYMBOLS)
+           || fwrite(obuf, 1, bw.pos, fenc)!=bw.pos){ rc=-1; break; }
+        metrics_stage("write", t0);
+
+        for(int s=0;s<MAX_SYMBOLS;s++) st->freq[s] += freq[s];
+        st->in_bytes  += (long long)got;
+        st->bits      += bits;
+        st->out_bytes += HUFF_CHUNK_HEADER_BYTES + ((ch.flags & HUFF_CHUNK_TABLE) ? MAX_SYMBOLS : 0) + (long long)bw.pos;
+        st->chunks++;
+        t0 = metrics_now();
+    }
+    if(rc==0 && ferror(fin)) rc=-1;
+    if(rc==0){
+        HuffChunk last = { HUFF_CHUNK_LAST, 0, 0 };
+        if(huff_chunk_write(fenc, &last)!=0) rc=-1;
+        st->out_bytes += HUFF_CHUNK_HEADER_BYTES;
+    }
+    free(ibuf); free(obuf);
+    return rc;
+}
+
+/* "1048576"、"1024K"、"1M" → 位元組數；格式錯誤回傳 0 */
+static size_t parse_size(const char *s){
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if(*end=='K' || *end=='k'){ v <<= 10; end++; }
+    else if(*end=='M' || *end=='m'){ v <<= 20; end++; }
+    if(*end!='\0') return 0;
+    return (size_t)v;
+}
 
 /* 用於輸出 codebook 的排序：count asc，其次 symbol 字串 asc */
 typedef struct {
@@ -163,7 +480,7 @@ typedef struct {
     int symbol;
     long long cnt;
     double prob;
-    const char *code;
+    char code[HUFF_MAX_CODE_LEN+1];
     double selfinfo;
 } Row;
 
@@ -173,42 +490,954 @@ static int cmp_row(const void *A, const void *B){
     return strcmp(a->esc, b->esc);
 }
 
+/* 依 code[] 寫出 codebook.csv：出現過或帶有 code 的符號各一列。回傳 0 成功，-1 開檔失敗 */
+static int write_codebook(const char *cb_fn, const long long *freq, long long total, const Code *code){
+    FILE *cb = fopen(cb_fn, "wb");
+    if(!cb){ log_error("encoder","open codebook failed file=%s", cb_fn); return -1; }
+    Row *rows = (Row*)malloc(sizeof(Row)*MAX_SYMBOLS);
+    int nrows=0;
+    for(int s=0;s<MAX_SYMBOLS;s++){
+        if(freq[s]==0 && code[s].len==0) continue;
+        if(s==EOF_MARK){
+            strcpy(rows[nrows].esc, "<EOF>");
+        }else{
+            symbol_to_esc((unsigned char)s, rows[nrows].esc);
+        }
+        rows[nrows].symbol = s;
+        rows[nrows].cnt    = freq[s];
+        rows[nrows].prob   = (double)freq[s]/(double)total;
+        code_to_str(code[s], rows[nrows].code);
+        rows[nrows].selfinfo = (rows[nrows].prob>0)? (-log(rows[nrows].prob)/log(2.0)) : 0.0;
+        nrows++;
+    }
+    qsort(rows, nrows, sizeof(Row), cmp_row);
+
+    for(int i=0;i<nrows;i++){
+        fprintf(cb, "\"%s\",%lld,%.15f,\"%s\",%0.15f\n",
+            rows[i].esc, rows[i].cnt, rows[i].prob, rows[i].code, rows[i].selfinfo);
+    }
+    fclose(cb);
+    free(rows);
+    return 0;
+}
+
+/* --stream：in_fn / enc_fn 可為 "-"（stdin / stdout）；資料走 stdout 時 log 改寫到 stderr */
+static int run_stream(const char *in_fn, const char *enc_fn, size_t chunk_size, int max_code_len,
+                      const char *metrics_fn){
+    bool in_std = strcmp(in_fn, "-")==0, out_std = strcmp(enc_fn, "-")==0;
+    if(out_std) log_set_output(stderr);
+#ifdef _WIN32
+    if(in_std)  _setmode(_fileno(stdin),  _O_BINARY);
+    if(out_std) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    log_info("encoder", "start input_file=%s format=stream chunk_size=%zu", in_fn, chunk_size);
+
+    FILE *fin = in_std ? stdin : fopen(in_fn, "rb");
+    if(!fin){ log_error("encoder","open input failed file=%s", in_fn); return 2; }
+    FILE *fenc = out_std ? stdout : fopen(enc_fn, "wb");
+    if(!fenc){ if(!in_std) fclose(fin); log_error("encoder","open encoded failed file=%s", enc_fn); return 6; }
+
+    StreamStats *st = (StreamStats*)calloc(1, sizeof(StreamStats));
+    int rc = encode_stream(fin, fenc, chunk_size, max_code_len, st);
+    if(fflush(fenc)!=0) rc = -1;
+    if(!in_std) fclose(fin);
+    if(!out_std) fclose(fenc);
+    if(rc!=0){ log_error("encoder","encode_stream failed output_encoded=%s", enc_fn); free(st); return 6; }
+
+    double entropy = 0.0;
+    int unique = 0;
+    for(int s=0;s<MAX_SYMBOLS;s++){
+        if(!st->freq[s]) continue;
+        double p = (double)st->freq[s]/(double)st->in_bytes;
+        entropy -= p*log(p)/log(2.0);
+        unique++;
+    }
+    double huff_bps = st->in_bytes ? (double)st->bits/(double)st->in_bytes : 0.0;
+    double container_bps = st->in_bytes ? 8.0*(double)st->out_bytes/(double)st->in_bytes : 0.0;
+    log_info("encoder","encode_stream output_encoded=%s chunks=%d tables=%d total_bits=%lld",
+             enc_fn, st->chunks, st->tables, st->bits);
+    log_info("metrics","summary input_file=%s output_encoded=%s format=stream input_bytes=%lld output_bytes=%lld "
+                      "unique_symbols=%d chunks=%d tables=%d entropy_bits_per_symbol=%.6f "
+                      "huffman_bits_per_symbol=%.6f container_bits_per_symbol=%.6f",
+             in_fn, enc_fn, st->in_bytes, st->out_bytes, unique, st->chunks, st->tables,
+             entropy, huff_bps, container_bps);
+    metrics_count("bytes_in", st->in_bytes);
+    metrics_count("bytes_out", st->out_bytes);
+    metrics_count("bits_written", st->bits);
+    metrics_count("chunks", st->chunks);
+    metrics_count("tables", st->tables);
+    metrics_report("encoder", metrics_fn);
+    log_info("encoder","finish status=ok");
+    free(st);
+    return 0;
+}
+
+/* ----------------- 預先訓練的靜態 codebook ----------------- */
+/* 訓練出的 code 最長 TRAIN_MAX_CODE_LEN 位元，加上 escape 後的 8 位元仍在查表解碼的上限內 */
+#define TRAIN_MAX_CODE_LEN (HUFF_DT_MAX_CODE_LEN - 8)
+
+/* 逐檔累加 histogram；回傳 0 成功，-1 讀檔失敗 */
+static int count_file(const char *fn, long long freq[MAX_SYMBOLS], long long *total){
+    MappedFile m;
+    if(mf_open_read(fn, &m)==0){
+        huff_histogram(m.data, m.size, freq);
+        *total += (long long)m.size;
+        mf_close(&m);
+        return 0;
+    }
+    FILE *f = fopen(fn, "rb");
+    if(!f) return -1;
+    unsigned char *buf = (unsigned char*)malloc(OUT_BUF_SIZE);
+    size_t got;
+    while( (got=fread(buf, 1, OUT_BUF_SIZE, f)) > 0 ){
+        huff_histogram(buf, got, freq);
+        *total += (long long)got;
+    }
+    int rc = ferror(f) ? -1 : 0;
+    free(buf); fclose(f);
+    return rc;
+}
+
+/* --train：由樣本建 codebook。每則樣本視為一則訊息（各帶一個 EOF）；
+ * 樣本中沒出現的 byte 共用一個 escape 前綴，其後接 8 位元原始 byte，
+ * escape 的權重取只出現一次的符號數（Good-Turing：下一個符號是新符號的機率估計）。
+ * binary 時寫成只有 container 檔頭的二進位 codebook（code 依長度表以 canonical 規則重建） */
+static int run_train(const char **samples, int nsamples, const char *cb_fn, bool binary, const char *metrics_fn){
+    log_info("encoder","start mode=train samples=%d output_codebook=%s", nsamples, cb_fn);
+    double t0 = metrics_now();
+    long long freq[MAX_SYMBOLS]={0}, total=0;
+    for(int i=0;i<nsamples;i++){
+        if(count_file(samples[i], freq, &total)!=0){ log_error("encoder","open sample failed file=%s", samples[i]); return 2; }
+    }
+    metrics_stage("count_symbols", t0);
+    long long in_bytes = total;
+    freq[EOF_MARK] = nsamples; total += nsamples;
+
+    t0 = metrics_now();
+    long long w[MAX_SYMBOLS];
+    memcpy(w, freq, sizeof w);
+    int esc = -1, unseen = 0;
+    long long singletons = 0;
+    for(int s=0;s<ALPHABET;s++){
+        if(!freq[s]){ unseen++; if(esc<0) esc = s; }
+        else if(freq[s]==1) singletons++;
+    }
+    if(esc>=0) w[esc] = singletons ? singletons : 1;   // escape 暫借第一個未出現的 byte 的位置建樹
+    Code code[MAX_SYMBOLS];
+    HuffHeader hdr = {0};
+    hdr.nsym = MAX_SYMBOLS;
+    if(huff_build_codes(w, MAX_SYMBOLS, code, NULL)!=0 ||
+       huff_limit_codes(w, MAX_SYMBOLS, TRAIN_MAX_CODE_LEN, code, hdr.len, NULL)!=0){
+        log_error("encoder","train_codebook failed max_code_len=%d", TRAIN_MAX_CODE_LEN);
+        return 3;
+    }
+    Code prefix = esc>=0 ? code[esc] : (Code){0, 0};
+    for(int s=0;s<ALPHABET;s++){
+        if(freq[s]) continue;
+        code[s].bits = (prefix.bits<<8) | (uint64_t)s;
+        code[s].len  = prefix.len + 8;
+    }
+    long long bits = 0;
+    for(int s=0;s<MAX_SYMBOLS;s++){ hdr.len[s] = (uint8_t)code[s].len; bits += freq[s]*code[s].len; }
+    metrics_stage("build_huffman_tree", t0);
+
+    t0 = metrics_now();
+    if(binary){
+        FILE *f = fopen(cb_fn, "wb");
+        long hb = f ? huff_header_write(f, &hdr) : -1;
+        if(f && fclose(f)!=0) hb = -1;
+        if(hb<0){ log_error("encoder","write codebook failed file=%s", cb_fn); return 4; }
+    }else if(write_codebook(cb_fn, freq, total, code)!=0){
+        return 4;
+    }
+    metrics_stage("generate_codebook", t0);
+    log_info("metrics","summary mode=train samples=%d input_bytes=%lld output_codebook=%s codebook_format=%s "
+                      "seen_symbols=%d unseen_symbols=%d escape_len=%d sample_bits_per_symbol=%.6f",
+             nsamples, in_bytes, cb_fn, binary ? "binary" : "csv", ALPHABET - unseen, unseen,
+             esc>=0 ? prefix.len : 0, (double)bits/(double)total);
+    metrics_count("bytes_in", in_bytes);
+    metrics_report("encoder", metrics_fn);
+    log_info("encoder","finish status=ok");
+    return 0;
+}
+
+/* 讀入靜態 codebook：codebook.csv，或以 "HUFC" 開頭的二進位 codebook（--train --format=container 產生）。
+ * 回傳 0 成功，-1 格式錯誤或缺少 EOF 碼 */
+static int load_static_codebook(const char *fn, Code code[MAX_SYMBOLS]){
+    FILE *fp = fopen(fn, "rb");
+    if(!fp) return -1;
+    memset(code, 0, sizeof(Code)*MAX_SYMBOLS);
+    HuffHeader h;
+    long hb = huff_header_read(fp, &h);
+    if(hb!=0){
+        fclose(fp);
+        uint64_t val[MAX_SYMBOLS];
+        if(hb<0 || (h.flags & HUFF_NO_LEN_TABLE) || h.nsym!=MAX_SYMBOLS || huff_canonical_codes(h.len, h.nsym, val)!=0) return -1;
+        for(int s=0;s<MAX_SYMBOLS;s++){ code[s].bits = val[s]; code[s].len = h.len[s]; }
+        return code[EOF_MARK].len ? 0 : -1;
+    }
+    rewind(fp);
+    char line[4096];
+    int rc = 0;
+    while(rc==0 && fgets(line, sizeof line, fp)){
+        if(line[0]=='\r' || line[0]=='\n' || line[0]=='\0') continue;
+        char *cur = line;
+        char f0[256], f1[64], f2[128], f3[2048];
+        huff_csv_field(&cur, f0, sizeof f0);   // symbol
+        huff_csv_field(&cur, f1, sizeof f1);   // count
+        huff_csv_field(&cur, f2, sizeof f2);   // prob
+        huff_csv_field(&cur, f3, sizeof f3);   // codeword
+        if(f0[0]=='\0' || f3[0]=='\0') continue;
+        int sym = huff_csv_symbol(f0);
+        size_t L = strlen(f3);
+        if(L > HUFF_MAX_CODE_LEN || code[sym].len){ rc = -1; break; }
+        for(size_t k=0;k<L;k++){
+            if(f3[k]!='0' && f3[k]!='1'){ rc = -1; break; }
+            code[sym].bits = (code[sym].bits<<1) | (uint64_t)(f3[k]=='1');
+        }
+        code[sym].len = (int)L;
+    }
+    fclose(fp);
+    return (rc==0 && code[EOF_MARK].len) ? 0 : -1;
+}
+
+/* --codebook：以現成 codebook 單次讀取編碼，只輸出 raw 位元串（codebook 不隨檔案保存）。
+ * 輸入含 codebook 沒有的 byte 時失敗 */
+static int run_static(const char *cb_path, const char *in_fn, const char *enc_fn, const char *metrics_fn){
+    log_info("encoder","start input_file=%s mode=static codebook=%s", in_fn, cb_path);
+    double t0 = metrics_now();
+    Code code[MAX_SYMBOLS];
+    if(load_static_codebook(cb_path, code)!=0){ log_error("encoder","load_codebook failed file=%s", cb_path); return 3; }
+    int entries = 0;
+    for(int s=0;s<MAX_SYMBOLS;s++) entries += code[s].len > 0;
+    metrics_stage("load_codebook", t0);
+    log_info("encoder","load_codebook file=%s entries=%d", cb_path, entries);
+
+    t0 = metrics_now();
+    MappedFile min;
+    bool mapped = mf_open_read(in_fn, &min)==0;
+    FILE *fin = mapped ? NULL : fopen(in_fn, "rb");
+    if(!mapped && !fin){ log_error("encoder","open input failed file=%s", in_fn); return 2; }
+    FILE *fenc = fopen(enc_fn, "wb");
+    if(!fenc){ if(mapped) mf_close(&min); else fclose(fin); log_error("encoder","open encoded failed file=%s", enc_fn); return 6; }
+    BitW bw;
+    huff_bw_init(&bw, fenc);
+    long long total = 0;
+    int missing = -1;
+    unsigned char *ibuf = mapped ? NULL : (unsigned char*)malloc(OUT_BUF_SIZE);
+    size_t got = mapped ? min.size : 0;
+    const unsigned char *src = mapped ? min.data : ibuf;
+    while(missing<0 && (mapped ? got>0 : (got=fread(ibuf, 1, OUT_BUF_SIZE, fin)) > 0)){
+        for(size_t i=0;i<got;i++) if(!code[src[i]].len){ missing = src[i]; break; }
+        if(missing<0) huff_bw_encode(&bw, code, src, got);
+        total += (long long)got;
+        if(mapped) got = 0;
+    }
+    huff_bw_put(&bw, code[EOF_MARK]);
+    huff_bw_flush(&bw);
+    huff_bw_free(&bw);
+    int rc = (missing>=0 || bw.overflow) ? -1 : 0;
+    if(fclose(fenc)!=0) rc = -1;
+    free(ibuf);
+    if(mapped) mf_close(&min); else fclose(fin);
+    metrics_stage("encode_to_bitstream", t0);
+    if(missing>=0){ log_error("encoder","symbol_not_in_codebook symbol=%d codebook=%s", missing, cb_path); return 6; }
+    if(rc!=0){ log_error("encoder","encode failed file=%s", enc_fn); return 6; }
+
+    long long bytes_out = (bw.total_bits + 7) / 8;
+    log_info("metrics","summary input_file=%s codebook=%s output_encoded=%s format=static num_symbols=%lld "
+                      "output_bytes=%lld bits_per_symbol=%.6f",
+             in_fn, cb_path, enc_fn, total + 1, bytes_out, (double)bw.total_bits/(double)(total + 1));
+    metrics_count("bytes_in", total);
+    metrics_count("bytes_out", bytes_out);
+    metrics_count("bits_written", bw.total_bits);
+    metrics_count("symbols", total + 1);
+    metrics_report("encoder", metrics_fn);
+    log_info("encoder","finish status=ok");
+    return 0;
+}
+
+/* ----------------- 批次模式 ----------------- */
+/* 一個檔案的工作與結果；工作執行緒只寫自己的項目，結束後由主執行緒彙總 */
+typedef struct {
+    const char *in_fn;
+    char *enc_fn, *cb_fn;          // cb_fn：raw 且不共用表時的 codebook.csv，其餘為 NULL
+    long long bytes_in, bytes_out, bits;
+    double sec;
+    int rc;                        // 0 成功；其餘與單檔執行的結束碼相同
+} BatchItem;
+
+typedef struct {
+    BatchItem *items;
+    bool container;
+    const Code *shared;            // 非 NULL：全批共用的 codebook，各檔只輸出 raw 位元串
+} Batch;
+
+/* 讀入整個檔案（映射失敗時退回 stdio）；回傳 0 成功，-1 失敗 */
+static int load_file(const char *fn, MappedFile *m, unsigned char **buf, const unsigned char **src, size_t *n){
+    *buf = NULL;
+    if(mf_open_read(fn, m)==0){ *src = m->data; *n = m->size; return 0; }
+    FILE *f = fopen(fn, "rb");
+    if(!f) return -1;
+    long long sz = fseek(f, 0, SEEK_END)==0 ? (long long)ftell(f) : -1;
+    *buf = sz >= 0 ? (unsigned char*)malloc(sz ? (size_t)sz : 1) : NULL;
+    int rc = (*buf && fseek(f, 0, SEEK_SET)==0 && read_full(f, *buf, (size_t)sz)==(size_t)sz) ? 0 : -1;
+    fclose(f);
+    if(rc!=0){ free(*buf); *buf = NULL; return -1; }
+    *src = *buf; *n = (size_t)sz;
+    return 0;
+}
+
+/* 與單檔執行相同的流程（統計 → 建表 → 編碼）整個在記憶體內完成，輸出逐位元組相同；
+ * 不寫 log 也不碰 metrics，可在工作執行緒上執行 */
+static void batch_job(void *ctx, int j){
+    Batch *b = (Batch*)ctx;
+    BatchItem *it = &b->items[j];
+    double t0 = metrics_now();
+    MappedFile m;
+    unsigned char *ibuf;
+    const unsigned char *src;
+    size_t n;
+    it->rc = 0;
+    if(load_file(it->in_fn, &m, &ibuf, &src, &n)!=0){ it->rc = 2; return; }
+    it->bytes_in = (long long)n;
+
+    long long freq[MAX_SYMBOLS]={0};
+    Code own[MAX_SYMBOLS];
+    const Code *code = b->shared;
+    HuffHeader hdr = {0};
+    if(code){
+        for(size_t i=0;i<n && it->rc==0;i++) if(!code[src[i]].len) it->rc = 6;   // codebook 沒有的 byte
+    }else{
+        huff_histogram(src, n, freq);
+        freq[EOF_MARK] = 1;
+        hdr.nsym = MAX_SYMBOLS;
+        if(huff_build_codes(freq, MAX_SYMBOLS, own, NULL)!=0 ||
+           (b->container && huff_canonicalize(own, MAX_SYMBOLS, hdr.len)!=0)) it->rc = 3;
+        code = own;
+    }
+    if(it->rc==0 && it->cb_fn && write_codebook(it->cb_fn, freq, (long long)n + 1, code)!=0) it->rc = 4;
+
+    unsigned char hd[HUFF_HEADER_MAX_BYTES];
+    long hb = (b->container && !b->shared) ? huff_header_encode(&hdr, hd) : 0;
+    size_t cap = n*(size_t)huff_max_code_len(code, MAX_SYMBOLS)/8 + 16 + (size_t)code[EOF_MARK].len/8;
+    unsigned char *obuf = it->rc==0 ? (unsigned char*)malloc(cap) : NULL;
+    if(it->rc==0 && !obuf) it->rc = 6;
+    if(it->rc==0){
+        BitW bw;
+        huff_bw_init_mem(&bw, obuf, cap);
+        huff_bw_encode(&bw, code, src, n);
+        huff_bw_put(&bw, code[EOF_MARK]);
+        huff_bw_flush(&bw);
+        it->bits = bw.total_bits;
+        FILE *f = bw.overflow ? NULL : fopen(it->enc_fn, "wb");
+        if(!f || fwrite(hd, 1, (size_t)hb, f)!=(size_t)hb || fwrite(obuf, 1, bw.pos, f)!=bw.pos) it->rc = 6;
+        if(f && fclose(f)!=0) it->rc = 6;
+        it->bytes_out = hb + (long long)bw.pos;
+    }
+    free(obuf);
+    if(ibuf) free(ibuf); else mf_close(&m);
+    it->sec = metrics_now() - t0;
+}
+
+static int cmp_str(const void *A, const void *B){ return strcmp(*(char* const*)A, *(char* const*)B); }
+static int cmp_double(const void *A, const void *B){
+    double a = *(const double*)A, b = *(const double*)B;
+    return (a > b) - (a < b);
+}
+
+/* 批次清單：src 為目錄時取其中的一般檔案（不遞迴、依名稱排序），否則為每行一個路徑的清單檔
+ * （略過空行與 # 開頭的行）。回傳檔案數，失敗回傳 -1 */
+static int batch_list(const char *src, char ***out){
+    char **names = NULL;
+    int n = 0, cap = 0;
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat st;
+    if(stat(src, &st)==0 && S_ISDIR(st.st_mode)){
+        DIR *d = opendir(src);
+        if(!d) return -1;
+        struct dirent *e;
+        while( (e = readdir(d)) ){
+            size_t len = strlen(src) + strlen(e->d_name) + 2;
+            char *path = (char*)malloc(len);
+            snprintf(path, len, "%s/%s", src, e->d_name);
+            if(stat(path, &st)!=0 || !S_ISREG(st.st_mode)){ free(path); continue; }
+            if(n==cap){ cap = cap ? cap*2 : 64; names = (char**)realloc(names, sizeof(char*)*cap); }
+            names[n++] = path;
+        }
+        closedir(d);
+        qsort(names, n, sizeof(char*), cmp_str);
+        *out = names;
+        return n;
+    }
+#endif
+    FILE *f = fopen(src, "r");
+    if(!f) return -1;
+    char line[4096];
+    while(fgets(line, sizeof line, f)){
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if(len==0 || line[0]=='#') continue;
+        if(n==cap){ cap = cap ? cap*2 : 64; names = (char**)realloc(names, sizeof(char*)*cap); }
+        names[n] = (char*)malloc(len+1);
+        memcpy(names[n++], line, len+1);
+    }
+    fclose(f);
+    *out = names;
+    return n;
+}
+
+static char* join_path(const char *dir, const char *base, const char *ext){
+    size_t len = strlen(dir) + strlen(base) + strlen(ext) + 2;
+    char *p = (char*)malloc(len);
+    snprintf(p, len, "%s/%s%s", dir, base, ext);
+    return p;
+}
+
+/* --batch：一個行程以工作執行緒池處理整批檔案，輸出到 out_dir/<檔名>：
+ * raw 為 .csv + .bin，container 為 .huf，共用 codebook（shared_cb）時只有 .bin。
+ * 不逐檔寫 log，最後輸出一行彙總（失敗的檔案各記一行 ERROR） */
+static int run_batch(const char *list, const char *out_dir, bool container, const char *shared_cb,
+                     int nthreads, const char *metrics_fn){
+    log_info("encoder","start mode=batch list=%s out_dir=%s format=%s threads=%d",
+             list, out_dir, shared_cb ? "static" : container ? "container" : "raw", nthreads);
+    double t0 = metrics_now();
+    Code shared[MAX_SYMBOLS];
+    if(shared_cb && load_static_codebook(shared_cb, shared)!=0){
+        log_error("encoder","load_codebook failed file=%s", shared_cb); return 3;
+    }
+    char **names = NULL;
+    int n = batch_list(list, &names);
+    if(n < 0){ log_error("encoder","open batch list failed file=%s", list); return 2; }
+    BatchItem *items = (BatchItem*)calloc(n ? (size_t)n : 1, sizeof(BatchItem));
+    char **bases = (char**)malloc(sizeof(char*)*(n ? (size_t)n : 1));
+    for(int i=0;i<n;i++){
+        const char *base = names[i];
+        for(const char *p = names[i]; *p; p++) if(*p=='/' || *p=='\\') base = p+1;
+        bases[i] = (char*)base;
+        items[i].in_fn  = names[i];
+        items[i].enc_fn = join_path(out_dir, base, container && !shared_cb ? ".huf" : ".bin");
+        items[i].cb_fn  = (!container && !shared_cb) ? join_path(out_dir, base, ".csv") : NULL;
+    }
+    // 不同目錄下的同名檔案會寫到同一個輸出
+    qsort(bases, n, sizeof(char*), cmp_str);
+    int rc = 0;
+    for(int i=1;i<n;i++) if(strcmp(bases[i-1], bases[i])==0){
+        log_error("encoder","batch duplicate_output_name name=%s", bases[i]); rc = 1;
+    }
+    metrics_stage("batch_list", t0);
+
+    if(rc==0){
+        t0 = metrics_now();
+        Batch b = { items, container, shared_cb ? shared : NULL };
+        huff_parallel_for(nthreads, n, batch_job, &b);
+        metrics_stage("batch_encode", t0);
+
+        long long bytes_in = 0, bytes_out = 0, bits = 0;
+        int failed = 0;
+        double *lat = (double*)malloc(sizeof(double)*(n ? (size_t)n : 1));
+        for(int i=0;i<n;i++){
+            lat[i] = items[i].sec;
+            if(items[i].rc){
+                failed++;
+                log_error("encoder","batch_file failed input_file=%s status=%d", items[i].in_fn, items[i].rc);
+                continue;
+            }
+            bytes_in += items[i].bytes_in; bytes_out += items[i].bytes_out; bits += items[i].bits;
+        }
+        qsort(lat, n, sizeof(double), cmp_double);
+        double wall = metrics_now() - t0;
+        #define LAT_MS(q) (n ? 1e3*lat[(size_t)((q)*(double)(n-1) + 0.5)] : 0.0)
+        log_info("metrics","summary mode=batch files=%d failed=%d input_bytes=%lld output_bytes=%lld "
+                          "bits_per_symbol=%.6f tables_built=%d threads=%d wall_ms=%.3f files_per_sec=%.1f "
+                          "file_ms_p50=%.3f file_ms_p90=%.3f file_ms_p99=%.3f file_ms_max=%.3f",
+                 n, failed, bytes_in, bytes_out, bytes_in ? (double)bits/(double)bytes_in : 0.0,
+                 shared_cb ? 0 : n - failed, nthreads, wall*1e3, wall > 0 ? (double)n/wall : 0.0,
+                 LAT_MS(0.50), LAT_MS(0.90), LAT_MS(0.99), LAT_MS(1.0));
+        #undef LAT_MS
+        metrics_count("files", n);
+        metrics_count("failed", failed);
+        metrics_count("bytes_in", bytes_in);
+        metrics_count("bytes_out", bytes_out);
+        metrics_count("bits_written", bits);
+        free(lat);
+        if(failed) rc = 6;
+    }
+    metrics_report("encoder", metrics_fn);
+    if(rc==0) log_info("encoder","finish status=ok");
+    for(int i=0;i<n;i++){ free(names[i]); free(items[i].enc_fn); free(items[i].cb_fn); }
+    free(names); free(items); free(bases);
+    return rc;
+}
+
 /* ----------------- 主流程 ----------------- */
+/* ----------------- 只估計、不輸出 ----------------- */
+typedef struct {
+    size_t block;              // 取樣單位（位元組）
+    double rate;               // 取樣比例；1 為全部區塊
+    bool random;               // true：各區塊獨立以 rate 的機率抽中；false：等間隔
+    uint64_t seed;
+} SampleSpec;
+
+typedef struct {
+    long long freq[MAX_SYMBOLS];
+    double (*m)[256];          // m[a][b]（a<=b）= Σ 各取樣區塊 f(a)·f(b)，估計區塊間的變異
+    long long bytes, blocks, sampled_bytes, sampled;
+} Sample;
+
+static uint64_t splitmix64(uint64_t *s){
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static bool sample_pick(const SampleSpec *sp, long long i, uint64_t *rng){
+    if(sp->rate >= 1.0) return true;
+    if(sp->random) return (double)(splitmix64(rng) >> 11) * (1.0/9007199254740992.0) < sp->rate;
+    return floor((double)i*sp->rate) > floor((double)(i-1)*sp->rate);   // 第 0 塊起每 1/rate 塊取一塊
+}
+
+static void sample_block(Sample *s, const unsigned char *p, size_t n){
+    long long f[256] = {0};
+    int nz[256], k = 0;
+    huff_histogram(p, n, f);
+    for(int a=0;a<256;a++) if(f[a]){ nz[k++] = a; s->freq[a] += f[a]; }
+    for(int i=0;i<k;i++)
+        for(int j=i;j<k;j++) s->m[nz[i]][nz[j]] += (double)f[nz[i]]*(double)f[nz[j]];
+    s->sampled++;
+    s->sampled_bytes += (long long)n;
+}
+
+/* 一般檔案以映射只碰抽中的區塊；pipe 與 "-"（stdin）逐塊讀完、只統計抽中的區塊。
+ * 隨機抽樣一塊都沒抽中時改統計最後一塊，估計值才有意義 */
+static int sample_file(const char *fn, const SampleSpec *sp, Sample *s){
+    uint64_t rng = sp->seed;
+    MappedFile m;
+    bool in_std = strcmp(fn, "-")==0;
+    if(!in_std && mf_open_read(fn, &m)==0){
+        s->bytes = (long long)m.size;
+        size_t off = 0, n = 0;
+        for(; off<m.size; off+=sp->block, s->blocks++){
+            n = m.size - off < sp->block ? m.size - off : sp->block;
+            if(sample_pick(sp, s->blocks, &rng)) sample_block(s, m.data + off, n);
+        }
+        if(s->sampled == 0 && n) sample_block(s, m.data + off - sp->block, n);
+        mf_close(&m);
+        return 0;
+    }
+#ifdef _WIN32
+    if(in_std) _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    FILE *f = in_std ? stdin : fopen(fn, "rb");
+    unsigned char *buf = f ? (unsigned char*)malloc(sp->block) : NULL;
+    if(!buf){ if(f && !in_std) fclose(f); return -1; }
+    size_t got, last = 0;
+    while((got = read_full(f, buf, sp->block)) > 0){
+        if(sample_pick(sp, s->blocks, &rng)) sample_block(s, buf, got);
+        s->bytes += (long long)got; s->blocks++;
+        last = got;
+    }
+    if(s->sampled == 0 && last) sample_block(s, buf, last);
+    free(buf);
+    if(!in_std) fclose(f);
+    return 0;
+}
+
+/* 比例估計 R = Σx_i / Σn_i（x_i = Σ_s w(s)·f_i(s)，n_i 為區塊位元組數）的 95% 信賴區間半寬。
+ * Σ(x_i - R·n_i)² 由 m 以 v = w - R 計算，並乘上有限母體校正 1 - k/K；k < 2 時無法估計，回傳 NAN */
+static double ratio_halfwidth(const Sample *s, const double *w, double R){
+    long long k = s->sampled;
+    if(k >= s->blocks) return 0.0;
+    if(k < 2) return NAN;
+    double v[256], q = 0.0;
+    for(int a=0;a<256;a++) v[a] = w[a] - R;
+    for(int a=0;a<256;a++){
+        if(!s->freq[a]) continue;
+        for(int b=a;b<256;b++) if(s->freq[b]) q += (a==b ? 1.0 : 2.0) * v[a]*v[b]*s->m[a][b];
+    }
+    double nbar = (double)s->sampled_bytes / (double)k;
+    double fpc = 1.0 - (double)k/(double)s->blocks;
+    return 1.96 * sqrt(fpc * (q > 0 ? q : 0.0) / (double)(k-1) / (double)k) / nbar;
+}
+
+/* --estimate：只由（抽樣的）histogram 計算與 metrics summary 相同的指標，不建位元串、不寫任何檔案。
+ * 每個輸入一行 summary，另附抽樣資訊與 95% 信賴區間 */
+static int run_estimate(const char **files, int nfiles, const SampleSpec *sp, const char *metrics_fn){
+    int rc = 0;
+    long long bytes_in = 0, sampled_in = 0;
+    Sample s;
+    s.m = (double(*)[256])malloc(sizeof(double[256][256]));
+    if(!s.m){ log_error("encoder","estimate failed reason=nomem"); return 3; }
+    log_info("encoder","start mode=estimate files=%d sample_rate=%.6f sample_block=%zu sample_mode=%s",
+             nfiles, sp->rate, sp->block, sp->random ? "random" : "stride");
+    for(int i=0;i<nfiles;i++){
+        double t0 = metrics_now();
+        memset(s.freq, 0, sizeof s.freq);
+        memset(s.m, 0, sizeof(double[256][256]));
+        s.bytes = s.blocks = s.sampled_bytes = s.sampled = 0;
+        if(sample_file(files[i], sp, &s)!=0){
+            log_error("encoder","open input failed file=%s", files[i]);
+            rc = 2; continue;
+        }
+        metrics_stage("count_symbols", t0);
+        bytes_in += s.bytes; sampled_in += s.sampled_bytes;
+
+        // 與完整編碼相同：EOF 出現一次，指標以「每個符號」計（含 EOF）
+        t0 = metrics_now();
+        long long freq[MAX_SYMBOLS];
+        memcpy(freq, s.freq, sizeof freq);
+        freq[EOF_MARK] = 1;
+        long long stotal = s.sampled_bytes + 1, total = s.bytes + 1;
+        Code code[MAX_SYMBOLS];
+        int unique = 0;
+        if(huff_build_codes(freq, MAX_SYMBOLS, code, &unique)!=0){
+            log_error("encoder","generate_codes failed file=%s max_code_len=%d", files[i], HUFF_MAX_CODE_LEN);
+            rc = 3; continue;
+        }
+        double entropy = 0.0, wl[256], we[256];
+        long long bits = 0;
+        for(int a=0;a<MAX_SYMBOLS;a++){
+            double p = (double)freq[a]/(double)stotal;
+            if(a < 256){ wl[a] = code[a].len; we[a] = freq[a] ? -log(p)/log(2.0) : 0.0; }
+            if(!freq[a]) continue;
+            entropy += -p*log(p)/log(2.0);
+            bits += freq[a]*code[a].len;
+        }
+        int fixed_bits = 0;
+        while ((1 << fixed_bits) < unique) fixed_bits++;
+        double huff_bps = (double)bits/(double)stotal;
+        double fixed_bps = (double)fixed_bits;
+        // 信賴區間以每個原始 byte 的平均位元數估計（EOF 只有一個，不影響變異）
+        double xl = 0.0, xe = 0.0, sb = s.sampled_bytes ? (double)s.sampled_bytes : 1.0;
+        for(int a=0;a<256;a++){ xl += (double)s.freq[a]*wl[a]; xe += (double)s.freq[a]*we[a]; }
+        double hw_h = ratio_halfwidth(&s, wl, xl/sb);
+        double hw_e = ratio_halfwidth(&s, we, xe/sb);
+        double h_lo = huff_bps - hw_h, h_hi = huff_bps + hw_h;
+        if(h_lo < 1.0) h_lo = 1.0;       // Huffman 每個符號至少 1 位元
+        metrics_stage("build_huffman_tree", t0);
+
+        log_info("metrics","summary input_file=%s output_codebook=- output_encoded=- format=estimate "
+                           "num_symbols=%lld unique_symbols=%d fixed_code_bits_per_symbol=%.1f "
+                           "entropy_bits_per_symbol=%.6f perplexity=%.6f "
+                           "huffman_bits_per_symbol=%.6f total_bits_fixed=%lld total_bits_huffman=%lld "
+                           "compression_ratio=%.6f compression_factor=%.6f saving_percentage=%.6f "
+                           "sample_mode=%s sample_rate=%.6f sampled_bytes=%lld blocks=%lld sampled_blocks=%lld "
+                           "entropy_low=%.6f entropy_high=%.6f huffman_bits_low=%.6f huffman_bits_high=%.6f "
+                           "saving_low=%.6f saving_high=%.6f",
+                 files[i], total, unique, fixed_bps, entropy, pow(2.0, entropy),
+                 huff_bps, (long long)fixed_bits * total, (long long)llround(huff_bps * (double)total),
+                 fixed_bps / huff_bps, huff_bps / fixed_bps, 1.0 - huff_bps / fixed_bps,
+                 sp->random ? "random" : "stride", s.bytes ? (double)s.sampled_bytes/(double)s.bytes : 1.0,
+                 s.sampled_bytes, s.blocks, s.sampled,
+                 entropy - hw_e, entropy + hw_e, h_lo, h_hi,
+                 1.0 - h_hi / fixed_bps, 1.0 - h_lo / fixed_bps);
+    }
+    free(s.m);
+    metrics_count("files", nfiles);
+    metrics_count("bytes_in", bytes_in);
+    metrics_count("sampled_bytes", sampled_in);
+    metrics_report("encoder", metrics_fn);
+    if(rc==0) log_info("encoder","finish status=ok");
+    return rc;
+}
+
 int main(int argc, char **argv){
-    if(argc<4){
-        fprintf(stderr, "Usage: %s in_fn cb_fn enc_fn\n", argv[0]);
+    const char **pos = (const char**)malloc(sizeof(char*)*(size_t)argc); int npos = 0;
+    bool container = false;
+    size_t block_size = 0;                 // 0：整檔單一位元串
+    size_t chunk_size = 0;                 // >0：單次讀取串流模式
+    int max_code_len = 0;                  // >0：限制 code 長度
+    size_t sync_interval = 0;              // >0：每隔多少原始位元組記錄一個同步點
+    const char *metrics_fn = NULL;         // 各階段耗時與計數器另存成 JSON
+    int interleave = 1;                    // 4：每個解碼單位拆成 4 路交錯位元串
+    bool order1 = false;                   // 依前一個 byte 選用 context 碼表
+    bool tans = false;                     // 以 tANS 取代 Huffman 編碼
+    int alphabet = MAX_SYMBOLS;            // >MAX_SYMBOLS：常見 byte 對升為額外符號
+    bool train = false;                    // 由樣本訓練靜態 codebook
+    const char *static_cb = NULL;          // 以現成 codebook 編碼，不建表也不存表
+    const char *batch = NULL;              // 清單檔或目錄：一個行程處理整批檔案
+    const char *out_dir = NULL;            // 批次輸出目錄
+    bool estimate = false;                 // 只由 histogram 估計指標，不寫任何輸出
+    size_t crc_block = 0;                  // >0：每隔多少原始位元組記錄一個 CRC32C
+    SampleSpec sp = { 1u<<16, 1.0, false, 0 };
+    bool sample_opt = false;               // 抽樣選項只用於 --estimate
+    int nthreads = huff_cpu_count();
+    for (int i=1;i<argc;i++) {
+        if (strcmp(argv[i], "--format=container") == 0) container = true;
+        else if (strcmp(argv[i], "--format=raw") == 0) container = false;
+        else if (strncmp(argv[i], "--block-size=", 13) == 0) {
+            block_size = parse_size(argv[i]+13);
+            if (block_size == 0 || block_size > (1u<<30)) { npos = -1; break; }
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            nthreads = atoi(argv[i]+10);
+            if (nthreads < 1) { npos = -1; break; }
+        }
+        else if (strncmp(argv[i], "--max-code-len=", 15) == 0) {
+            max_code_len = atoi(argv[i]+15);
+            if (max_code_len < 1 || max_code_len > HUFF_MAX_CODE_LEN) { npos = -1; break; }
+        }
+        else if (strncmp(argv[i], "--sync-interval=", 16) == 0) {
+            sync_interval = parse_size(argv[i]+16);
+            if (sync_interval == 0 || sync_interval > (1u<<30)) { npos = -1; break; }
+        }
+        else if (strncmp(argv[i], "--metrics-json=", 15) == 0) metrics_fn = argv[i]+15;
+        else if (strncmp(argv[i], "--interleave=", 13) == 0) {
+            interleave = atoi(argv[i]+13);
+            if (interleave != 1 && interleave != HUFF_X4_STREAMS) { npos = -1; break; }
+        }
+        else if (strcmp(argv[i], "--context=order0") == 0) order1 = false;
+        else if (strcmp(argv[i], "--context=order1") == 0) order1 = true;
+        else if (strcmp(argv[i], "--coder=huffman") == 0) tans = false;
+        else if (strcmp(argv[i], "--coder=tans") == 0) tans = true;
+        else if (strncmp(argv[i], "--alphabet=", 11) == 0) {
+            alphabet = atoi(argv[i]+11);
+            if (alphabet < MAX_SYMBOLS || alphabet > HUFF_EXT_MAX_SYMBOLS) { npos = -1; break; }
+        }
+        else if (strcmp(argv[i], "--train") == 0) train = true;
+        else if (strncmp(argv[i], "--codebook=", 11) == 0) static_cb = argv[i]+11;
+        else if (strncmp(argv[i], "--batch=", 8) == 0) batch = argv[i]+8;
+        else if (strncmp(argv[i], "--out-dir=", 10) == 0) out_dir = argv[i]+10;
+        else if (strcmp(argv[i], "--estimate") == 0) estimate = true;
+        else if (strncmp(argv[i], "--sample=", 9) == 0) {
+            sample_opt = true;
+            char *end;
+            sp.rate = strtod(argv[i]+9, &end);
+            if (*end == '%') { sp.rate /= 100.0; end++; }
+            if (*end || !(sp.rate > 0.0 && sp.rate <= 1.0)) { npos = -1; break; }
+        }
+        else if (strncmp(argv[i], "--sample-block=", 15) == 0) {
+            sample_opt = true;
+            sp.block = parse_size(argv[i]+15);
+            if (sp.block == 0 || sp.block > (1u<<30)) { npos = -1; break; }
+        }
+        else if (strcmp(argv[i], "--sample-mode=stride") == 0) { sp.random = false; sample_opt = true; }
+        else if (strcmp(argv[i], "--sample-mode=random") == 0) { sp.random = true; sample_opt = true; }
+        else if (strncmp(argv[i], "--seed=", 7) == 0) { sp.seed = strtoull(argv[i]+7, NULL, 10); sample_opt = true; }
+        else if (strcmp(argv[i], "--checksum") == 0) crc_block = HUFF_CRC_DEFAULT_BLOCK;
+        else if (strncmp(argv[i], "--checksum=", 11) == 0) {
+            crc_block = parse_size(argv[i]+11);
+            if (crc_block == 0 || crc_block > (1u<<30)) { npos = -1; break; }
+        }
+        else if (strcmp(argv[i], "--stream") == 0) chunk_size = 1u<<20;
+        else if (strncmp(argv[i], "--stream=", 9) == 0) {
+            chunk_size = parse_size(argv[i]+9);
+            if (chunk_size == 0 || chunk_size > (1u<<30)) { npos = -1; break; }
+        }
+        else if (strncmp(argv[i], "--", 2) == 0) { npos = -1; break; }
+        else pos[npos++] = argv[i];
+    }
+    if (npos > 3 && !train) npos = -1;
+    // 訓練與靜態 codebook 各自只接受 --format（訓練時選 codebook 格式）與 --metrics-json
+    bool digram = alphabet > MAX_SYMBOLS;
+    bool other = block_size || chunk_size || max_code_len || sync_interval || interleave > 1 || order1 || tans || digram || crc_block;
+    if (sample_opt && !estimate) npos = -1;
+    if (estimate){
+        if (npos < 1 || other || container || train || static_cb || batch){
+            fprintf(stderr, "Usage: %s --estimate [--sample=RATE] [--sample-block=SIZE] [--sample-mode=stride|random] [--seed=N] in_fn...\n", argv[0]);
+            free(pos); return 1;
+        }
+        int rc = run_estimate(pos, npos, &sp, metrics_fn);
+        free(pos); return rc;
+    }
+    if (train && (other || static_cb || batch || npos < 2)) npos = -1;
+    if (static_cb && !batch && (other || container || npos != 2)) npos = -1;
+    if (batch){
+        int rc = 1;
+        if (!other && npos == 0 && out_dir && !(static_cb && container))
+            rc = run_batch(batch, out_dir, container, static_cb, nthreads, metrics_fn);
+        else
+            fprintf(stderr, "Usage: %s --batch=LIST_FN|DIR --out-dir=DIR [--format=container | --codebook=CB_FN] [--threads=N]\n", argv[0]);
+        free(pos); return rc;
+    }
+    if (train && npos >= 2){
+        int rc = run_train(pos, npos-1, pos[npos-1], container, metrics_fn);
+        free(pos); return rc;
+    }
+    if (static_cb && npos == 2){
+        int rc = run_static(static_cb, pos[0], pos[1], metrics_fn);
+        free(pos); return rc;
+    }
+    if (block_size || sync_interval || interleave > 1) container = true;   // 區塊、同步點索引與交錯位元串都需要 container 檔頭
+    if (sync_interval && (block_size || chunk_size)) npos = -1;  // 區塊本身即為同步點；串流不支援索引
+    if (interleave > 1 && (chunk_size || sync_interval)) npos = -1;  // 同步點位移只對單一位元串有意義
+    if (order1 && (block_size || chunk_size || sync_interval || interleave > 1 || max_code_len)) npos = -1;  // context 表只用於整檔單一位元串
+    if (tans && (block_size || chunk_size || sync_interval || interleave > 1 || order1 || max_code_len)) npos = -1;  // tANS 只支援整檔單一位元串
+    if (digram && (block_size || chunk_size || sync_interval || interleave > 1 || order1 || tans)) npos = -1;  // byte 對切分只用於整檔單一位元串
+    if (crc_block && (chunk_size || tans || (interleave > 1 && !block_size))) npos = -1;  // 檢查碼段只用於整檔單一位元串與區塊
+    if (order1 || tans || digram || crc_block) container = true;
+    if (block_size && crc_block) crc_block = block_size;   // 區塊模式每個區塊一個檢查碼
+    // raw：codebook.csv 為解碼必要檔案；container：codebook.csv 僅為選用報表；
+    // stream：每個 chunk 各自帶表，沒有單一 codebook 可輸出
+    if(npos<2 || (npos==2 && !container && !chunk_size) || (chunk_size && (npos!=2 || block_size))){
+        fprintf(stderr, "Usage: %s [--format=raw] in_fn cb_fn enc_fn\n"
+                        "       %s --format=container [--block-size=SIZE [--threads=N] | --sync-interval=SIZE] [--interleave=1|4] in_fn [cb_fn] enc_fn\n"
+                        "       %s --context=order1 in_fn [cb_fn] enc_fn   (container, order-1 context tables)\n"
+                        "       %s --coder=tans in_fn [cb_fn] enc_fn       (container, tANS instead of Huffman)\n"
+                        "       %s --alphabet=N in_fn [cb_fn] enc_fn       (container, up to N-257 frequent byte pairs as extra symbols, N<=4096)\n"
+                        "       %s --stream[=CHUNK] in_fn|- enc_fn|-\n"
+                        "       %s --train [--format=container] sample_fn... cb_fn   (csv, or binary codebook)\n"
+                        "       %s --codebook=CB_FN in_fn enc_fn                     (raw, pre-trained codebook)\n"
+                        "       %s --batch=LIST_FN|DIR --out-dir=DIR [--format=container | --codebook=CB_FN] [--threads=N]\n"
+                        "       %s --estimate [--sample=RATE] [--sample-block=SIZE] [--sample-mode=stride|random] in_fn...   (metrics only, no output)\n"
+                        "Options: --max-code-len=N  limit codeword length (length-limited Huffman)\n"
+                        "         --checksum[=SIZE]  CRC32C per SIZE original bytes (default 1M; per block with --block-size)\n"
+                        "         --metrics-json=FILE  write per-stage timings and counters as JSON\n",
+                argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
-    const char *in_fn = argv[1];
-    const char *cb_fn = argv[2];
-    const char *enc_fn= argv[3];
+    const char *in_fn = pos[0];
+    const char *cb_fn = npos==3 ? pos[1] : NULL;
+    const char *enc_fn= pos[npos-1];
 
-    log_info("encoder", "start input_file=%s", in_fn);
+    metrics_now();     // 計時起點
+    if(chunk_size) return run_stream(in_fn, enc_fn, chunk_size, max_code_len, metrics_fn);
 
-    /* 讀檔 → 統計 histogram */
-    FILE *fin = fopen(in_fn, "rb");
-    if(!fin){ log_error("encoder","open input failed file=%s", in_fn); return 2; }
+    log_info("encoder", "start input_file=%s", in_fn);
 
+    /* 讀檔 → 統計 histogram；一般檔案以記憶體映射讀取，其餘退回 stdio */
+    double t0 = metrics_now();
+    MappedFile min;
+    bool mapped = mf_open_read(in_fn, &min)==0;
+    FILE *fin = NULL;
     long long freq[MAX_SYMBOLS]={0};
     long long total=0;
-    int c;
-    while( (c=fgetc(fin)) != EOF ){
-        freq[(unsigned char)c]++;
-        total++;
+    long long (*f1)[MAX_SYMBOLS] = order1 ? (long long(*)[MAX_SYMBOLS])calloc(256, sizeof *f1) : NULL;
+    int last = 0;                          // 最後一個 byte（order-1 的 EOF context）
+    CrcRec crc = {0}, *cr = NULL;          // 檢查碼與 histogram 在同一趟讀取中計算
+    if(crc_block){ crc.ix.block = (uint32_t)crc_block; cr = &crc; }
+    if(mapped){
+        metrics_stage("read", t0);
+        t0 = metrics_now();
+        huff_histogram_mt(min.data, min.size, freq, nthreads);   // 含映射頁面的首次讀取
+        if(f1) count_order1(min.data, min.size, &last, f1);
+        if(cr) crc_feed(cr, min.data, min.size);
+        metrics_stage("count_symbols", t0);
+        total = (long long)min.size;
+    }else{
+        fin = fopen(in_fn, "rb");
+        if(!fin){ log_error("encoder","open input failed file=%s", in_fn); return 2; }
+        unsigned char *ibuf = (unsigned char*)malloc(OUT_BUF_SIZE);
+        size_t got;
+        while( (got=fread(ibuf, 1, OUT_BUF_SIZE, fin)) > 0 ){
+            metrics_stage("read", t0);
+            t0 = metrics_now();
+            huff_histogram(ibuf, got, freq);
+            if(f1) count_order1(ibuf, got, &last, f1);
+            if(cr) crc_feed(cr, ibuf, got);
+            metrics_stage("count_symbols", t0);
+            total += (long long)got;
+            t0 = metrics_now();
+        }
+        free(ibuf);
+        fclose(fin);
     }
+    metrics_count("bytes_in", total);
+    log_info("encoder","read_input input_file=%s mapped=%d bytes=%lld histogram=%s",
+             in_fn, (int)mapped, total, huff_histogram_name(HUFF_HIST_AUTO));
     // EOF 當作一種 symbol（Method 2），出現一次
     freq[EOF_MARK]=1; total+=1;
-    fclose(fin);
 
     log_info("encoder","count_symbols num_symbols=%lld (including EOF) ", total);
 
+    /* 建樹並產生 codeword */
+    t0 = metrics_now();
     int unique=0;
-    Node *root = build_huffman(freq, &unique);
-    if(!root){ log_error("encoder","huffman build failed"); return 3; }
+    Code code[MAX_SYMBOLS];
+    if(huff_build_codes(freq, MAX_SYMBOLS, code, &unique)!=0){
+        log_error("encoder","generate_codes failed max_code_len=%d", HUFF_MAX_CODE_LEN);
+        return 3;
+    }
     log_info("encoder","build_huffman_tree unique_symbols=%d done", unique);
+    HuffHeader hdr = {0};
+    if(interleave > 1) hdr.flags |= HUFF_FLAG_X4;
+    if(cr) hdr.flags |= HUFF_FLAG_CRC;
+    if(container){
+        hdr.nsym = MAX_SYMBOLS;
+        if(huff_canonicalize(code, MAX_SYMBOLS, hdr.len)!=0){
+            log_error("encoder","canonical_codes failed max_code_len=%d", HUFF_MAX_CODE_LEN);
+            return 3;
+        }
+    }
+    if(max_code_len){
+        int unlimited_max = huff_max_code_len(code, MAX_SYMBOLS);
+        long long unlimited_bits=0, limited_bits=0;
+        for(int s=0;s<MAX_SYMBOLS;s++) unlimited_bits += freq[s]*code[s].len;
+        if(huff_limit_codes(freq, MAX_SYMBOLS, max_code_len, code, hdr.len, NULL)!=0){
+            log_error("encoder","length_limit failed max_code_len=%d unique_symbols=%d", max_code_len, unique);
+            return 3;
+        }
+        for(int s=0;s<MAX_SYMBOLS;s++) limited_bits += freq[s]*code[s].len;
+        log_info("encoder","length_limit max_code_len=%d unlimited_max_len=%d unlimited_bits=%lld limited_bits=%lld "
+                           "loss_percent=%.6f", max_code_len, unlimited_max, unlimited_bits, limited_bits,
+                 100.0*(double)(limited_bits-unlimited_bits)/(double)unlimited_bits);
+    }
+    metrics_stage("build_huffman_tree", t0);
+
+    /* order-1：依前一個 byte 分類建表，檔頭長度表換成第 0 類（合併的 context） */
+    HuffCtxTables ctx = {0};
+    Code (*ctab)[MAX_SYMBOLS] = NULL;
+    long long ctx_bits = 0;
+    size_t ctx_bytes = 0;
+    if(order1){
+        t0 = metrics_now();
+        ctab = (Code(*)[MAX_SYMBOLS])calloc(HUFF_CTX_MAX_CLASSES, sizeof *ctab);
+        if(!ctab || huff_ctx_build((const long long(*)[MAX_SYMBOLS])f1, last, &ctx, ctab, &ctx_bits, NULL)!=0){
+            log_error("encoder","build_context_tables failed");
+            return 3;
+        }
+        memcpy(hdr.len, ctx.len[0], MAX_SYMBOLS);
+        hdr.flags |= HUFF_FLAG_CTX1;
+        ctx_bytes = huff_ctx_size(&ctx);
+        int merged = 0;
+        for(int p=0;p<256;p++) merged += ctx.map[p]==0;
+        metrics_stage("build_context_tables", t0);
+        log_info("encoder","build_context_tables classes=%d merged_contexts=%d table_bytes=%zu bits=%lld",
+                 ctx.nclass, merged, ctx_bytes + MAX_SYMBOLS, ctx_bits);
+    }
+    free(f1);
+
+    /* tANS：以同一份 histogram 正規化成狀態表份數，檔頭不帶長度表 */
+    HuffTansModel tm = {0};
+    if(tans){
+        t0 = metrics_now();
+        if(huff_tans_normalize(freq, HUFF_TANS_DEFAULT_LOG, &tm)!=0){
+            log_error("encoder","tans_normalize failed table_log=%d", HUFF_TANS_DEFAULT_LOG);
+            return 3;
+        }
+        hdr.flags |= HUFF_FLAG_TANS;
+        memset(hdr.len, 0, sizeof hdr.len);
+        metrics_stage("build_tans_table", t0);
+        log_info("encoder","build_tans_table table_log=%d model_bytes=%zu", tm.table_log, huff_tans_model_size(&tm));
+    }
 
-    /* 產生 codeword */
-    Str code[MAX_SYMBOLS]; gen_codes(root, code);
+    /* 擴充字母表：整個輸入須在記憶體內（貪婪切分要看下一個 byte），非一般檔案先整個讀入 */
+    DigramModel dm = {0};
+    MappedFile dmin;
+    unsigned char *dbuf = NULL;
+    const unsigned char *dsrc = NULL;
+    size_t dn = 0;
+    if(digram){
+        if(mapped){ dsrc = min.data; dn = min.size; }
+        else if(load_file(in_fn, &dmin, &dbuf, &dsrc, &dn)!=0 || dn != (size_t)(total-1)){
+            log_error("encoder","reopen input failed"); return 5;
+        }
+        t0 = metrics_now();
+        int limit = max_code_len && max_code_len < HUFF_DT_MAX_CODE_LEN ? max_code_len : HUFF_DT_MAX_CODE_LEN;
+        long long base_bits = 0;
+        for(int s=0;s<MAX_SYMBOLS;s++) base_bits += freq[s]*code[s].len;
+        if(digram_build(dsrc, dn, alphabet - MAX_SYMBOLS, limit, base_bits, &dm)!=0){
+            log_error("encoder","build_digram_table failed alphabet=%d max_code_len=%d", alphabet, limit);
+            return 3;
+        }
+        memcpy(hdr.len, dm.len, MAX_SYMBOLS);
+        hdr.flags |= HUFF_FLAG_DIGRAM;
+        metrics_stage("build_digram_table", t0);
+        log_info("encoder","build_digram_table alphabet=%d pairs=%d pruned_pairs=%d symbols=%lld table_bytes=%zu max_code_len=%d",
+                 alphabet, dm.dg->n, dm.pruned, dm.symbols, huff_digram_size(dm.dg),
+                 huff_max_code_len(dm.code, dm.nsym));
+    }
 
     /* 統計各種指標 */
     double entropy=0.0;
@@ -216,8 +1445,8 @@ int main(int argc, char **argv){
     for(int s=0;s<MAX_SYMBOLS;s++){
         if(freq[s]==0) continue;
         double p=(double)freq[s]/(double)total;
-        entropy += (p>0)? (-log(p)/log(2.0)):0.0;
-        total_bits_huff += freq[s]*code_len(code[s].s?code[s].s:"");
+        entropy += (p>0)? (-p*log(p)/log(2.0)):0.0;
+        total_bits_huff += freq[s]*code[s].len;
     }
     double perplexity = pow(2.0, entropy);
 
@@ -233,68 +1462,210 @@ int main(int argc, char **argv){
     double compression_factor  = (double)total_bits_huff/(double)total_bits_fixed;
     double saving_percentage   = 1.0 - compression_factor;
 
-    /* 輸出 codebook.csv */
-    FILE *cb = fopen(cb_fn, "wb");
-    if(!cb){ log_error("encoder","open codebook failed file=%s", cb_fn); return 4; }
+    /* 輸出 codebook.csv（container 格式下為選用報表） */
+    if(cb_fn){
+        t0 = metrics_now();
+        if(write_codebook(cb_fn, freq, total, code)!=0) return 4;
+        metrics_stage("generate_codebook", t0);
+        log_info("encoder","generate_codebook output_codebook=%s", cb_fn);
+    }
 
-    Row *rows = (Row*)malloc(sizeof(Row)*unique);
-    int ridx=0;
-    for(int s=0;s<MAX_SYMBOLS;s++){
-        if(freq[s]==0) continue;
-        if(s==EOF_MARK){
-            strcpy(rows[ridx].esc, "<EOF>");
+    /* 輸出 encoded.bin */
+    t0 = metrics_now();
+    long long bytes_out = 0;
+    if(!mapped){
+        fin = fopen(in_fn, "rb");
+        if(!fin){ log_error("encoder","reopen input failed"); return 5; }
+    }
+
+    long long total_bits_written = 0;
+    int rc = 0;
+    if(block_size){
+        FILE *fenc = fopen(enc_fn, "wb");
+        if(!fenc){ if(fin) fclose(fin); log_error("encoder","open encoded failed file=%s", enc_fn); return 6; }
+        rc = encode_blocks(fin, mapped ? min.data : NULL, fenc, &hdr, code, total-1, block_size, cr, nthreads,
+                           &total_bits_written);
+        bytes_out = (long long)ftell(fenc);
+        if(fclose(fenc)!=0) rc = -1;
+        if(rc==0)
+            log_info("encoder","encode_blocks block_size=%zu nblocks=%lld threads=%d interleave=%d",
+                     block_size, (total-1 + (long long)block_size - 1) / (long long)block_size, nthreads, interleave);
+    }else if(digram){
+        FILE *fenc = fopen(enc_fn, "wb");
+        if(!fenc){ if(fin) fclose(fin); log_error("encoder","open encoded failed file=%s", enc_fn); return 6; }
+        rc = encode_digram_file(dsrc, dn, fenc, &hdr, &dm, cr, &bytes_out, &total_bits_written);
+        if(fclose(fenc)!=0) rc = -1;
+        if(rc==0)
+            log_info("encoder","write_output output_encoded=%s format=container alphabet=%d bytes=%lld",
+                     enc_fn, dm.nsym, bytes_out);
+    }else if(tans){
+        FILE *fenc = fopen(enc_fn, "wb");
+        if(!fenc){ if(fin) fclose(fin); log_error("encoder","open encoded failed file=%s", enc_fn); return 6; }
+        rc = encode_tans_file(fin, mapped ? min.data : NULL, fenc, &hdr, &tm, total-1, &bytes_out, &total_bits_written);
+        if(fclose(fenc)!=0) rc = -1;
+        if(rc==0)
+            log_info("encoder","write_output output_encoded=%s format=container coder=tans bytes=%lld",
+                     enc_fn, bytes_out);
+    }else if(interleave > 1){
+        FILE *fenc = fopen(enc_fn, "wb");
+        if(!fenc){ if(fin) fclose(fin); log_error("encoder","open encoded failed file=%s", enc_fn); return 6; }
+        rc = encode_x4_file(fin, mapped ? min.data : NULL, fenc, &hdr, code, total-1, &bytes_out, &total_bits_written);
+        if(fclose(fenc)!=0) rc = -1;
+        if(rc==0)
+            log_info("encoder","write_output output_encoded=%s format=container interleave=%d bytes=%lld",
+                     enc_fn, interleave, bytes_out);
+    }else{
+        // 整檔模式建表後輸出大小即已知：檔頭 [+ context 表] + ceil(位元數/8) [+ 同步點索引]，可先預留再映射寫入
+        SyncRec sync, *sr = NULL;
+        if(sync_interval){
+            sync.pos = 0;
+            sync.ix.interval  = (uint32_t)sync_interval;
+            sync.ix.orig_size = (uint64_t)(total-1);
+            sync.ix.count     = (uint32_t)((total-1 + (long long)sync_interval - 1) / (long long)sync_interval);
+            sync.ix.bitoff    = (uint64_t*)calloc(sync.ix.count ? sync.ix.count : 1, sizeof(uint64_t));
+            sr = &sync;
+            hdr.flags |= HUFF_FLAG_SYNC;
+        }
+        size_t sync_bytes = sr ? huff_sync_size(&sr->ix) : 0;
+        unsigned char hd[HUFF_HEADER_MAX_BYTES];
+        long header_bytes = container ? huff_header_encode(&hdr, hd) : 0;
+        size_t bits_bytes = (size_t)(((ctab ? ctx_bits : total_bits_huff) + 7) / 8);
+        unsigned char *cs = ctx_bytes ? (unsigned char*)malloc(ctx_bytes) : NULL;
+        if(cs) huff_ctx_encode(&ctx, cs);
+        size_t crc_bytes = 0;
+        unsigned char *ks = cr ? crc_section(cr, &hdr, cs, ctx_bytes, &crc_bytes) : NULL;
+        if(cr && !ks) rc = -1;
+        size_t pre = (size_t)header_bytes + crc_bytes + ctx_bytes;   // 位元串之前的位元組數
+        size_t out_size = pre + bits_bytes + sync_bytes;
+        int prev = 0;                      // order-1：前一個 byte
+        MappedFile mout;
+        BitW bw;
+        bool mapped_out = mapped && mf_create(enc_fn, out_size, &mout)==0;
+        if(mapped_out){
+            memcpy(mout.data, hd, (size_t)header_bytes);
+            if(ks) memcpy(mout.data + header_bytes, ks, crc_bytes);
+            if(cs) memcpy(mout.data + header_bytes + crc_bytes, cs, ctx_bytes);
+            huff_bw_init_mem(&bw, mout.data + pre, bits_bytes);
+            if(ctab) encode_buffer_ctx(&bw, (const Code(*)[MAX_SYMBOLS])ctab, ctx.map, &prev, min.data, min.size);
+            else     encode_buffer_sync(&bw, code, min.data, min.size, sr);
+            // 寫入 EOF 碼
+            huff_bw_put(&bw, ctab ? ctab[ctx.map[prev]][EOF_MARK] : code[EOF_MARK]);
+            huff_bw_flush(&bw);
+            if(bw.overflow || bw.pos != bits_bytes) rc = -1;   // 輸入在兩次讀取間被改動
+            if(rc==0 && sr) huff_sync_encode(&sr->ix, mout.data + pre + bits_bytes);
+            if(mf_close(&mout)!=0) rc = -1;
         }else{
-            symbol_to_esc((unsigned char)s, rows[ridx].esc);
+            FILE *fenc = fopen(enc_fn, "wb");
+            if(!fenc){ if(fin) fclose(fin); log_error("encoder","open encoded failed file=%s", enc_fn); return 6; }
+            if(fwrite(hd, 1, (size_t)header_bytes, fenc)!=(size_t)header_bytes) rc = -1;
+            if(ks && fwrite(ks, 1, crc_bytes, fenc)!=crc_bytes) rc = -1;
+            if(cs && fwrite(cs, 1, ctx_bytes, fenc)!=ctx_bytes) rc = -1;
+            huff_bw_init(&bw, fenc);
+            if(mapped){
+                if(ctab) encode_buffer_ctx(&bw, (const Code(*)[MAX_SYMBOLS])ctab, ctx.map, &prev, min.data, min.size);
+                else     encode_buffer_sync(&bw, code, min.data, min.size, sr);
+            }else{
+                unsigned char *ibuf = (unsigned char*)malloc(OUT_BUF_SIZE);
+                size_t got;
+                while( (got=fread(ibuf, 1, OUT_BUF_SIZE, fin)) > 0 ){
+                    if(ctab) encode_buffer_ctx(&bw, (const Code(*)[MAX_SYMBOLS])ctab, ctx.map, &prev, ibuf, got);
+                    else     encode_buffer_sync(&bw, code, ibuf, got, sr);
+                }
+                free(ibuf);
+            }
+            // 寫入 EOF 碼
+            huff_bw_put(&bw, ctab ? ctab[ctx.map[prev]][EOF_MARK] : code[EOF_MARK]);
+            huff_bw_flush(&bw);
+            huff_bw_free(&bw);
+            if(sr && (sr->pos != total-1)) rc = -1;
+            if(rc==0 && sr){
+                unsigned char *sb = (unsigned char*)malloc(sync_bytes);
+                huff_sync_encode(&sr->ix, sb);
+                if(fwrite(sb, 1, sync_bytes, fenc)!=sync_bytes) rc = -1;
+                free(sb);
+            }
+            if(fclose(fenc)!=0) rc = -1;
         }
-        rows[ridx].symbol = s;
-        rows[ridx].cnt    = freq[s];
-        rows[ridx].prob   = (double)freq[s]/(double)total;
-        rows[ridx].code   = code[s].s?code[s].s:"";
-        rows[ridx].selfinfo = (rows[ridx].prob>0)? (-log(rows[ridx].prob)/log(2.0)) : 0.0;
-        ridx++;
+        free(cs); free(ks);
+        if(sr){
+            log_info("encoder","write_sync_index interval=%zu sync_points=%u index_bytes=%zu",
+                     sync_interval, sr->ix.count, sync_bytes);
+            huff_sync_free(&sr->ix);
+        }
+        if(container)
+            log_info("encoder","write_header format=container nsym=%d header_bytes=%ld context_bytes=%zu",
+                     hdr.nsym, header_bytes, ctx_bytes);
+        log_info("encoder","write_output output_encoded=%s mapped=%d bytes=%zu", enc_fn, (int)mapped_out, out_size);
+        total_bits_written = bw.total_bits;
+        bytes_out = (long long)out_size;
     }
-    qsort(rows, unique, sizeof(Row), cmp_row);
-
-    for(int i=0;i<unique;i++){
-        fprintf(cb, "\"%s\",%lld,%.15f,\"%s\",%0.15f\n",
-            rows[i].esc, rows[i].cnt, rows[i].prob, rows[i].code, rows[i].selfinfo);
+    metrics_stage("encode_to_bitstream", t0);
+    if(cr){
+        if(crc.ix.orig_size != (uint64_t)(total-1)) rc = -1;   // 兩次讀取之間輸入檔被改動
+        if(rc==0)
+            log_info("encoder","write_checksums crc_block=%u count=%u section_bytes=%zu impl=%s",
+                     crc.ix.block, crc.ix.count, huff_crc_size(&crc.ix), huff_crc32c_name());
+        metrics_count("checksum_blocks", crc.ix.count);
+        huff_crc_free(&crc.ix);
     }
-    fclose(cb);
-    log_info("encoder","generate_codebook output_codebook=%s", cb_fn);
-
-    /* 輸出 encoded.bin */
-    fin = fopen(in_fn, "rb");
-    if(!fin){ log_error("encoder","reopen input failed"); return 5; }
-    FILE *fenc = fopen(enc_fn, "wb");
-    if(!fenc){ fclose(fin); log_error("encoder","open encoded failed file=%s", enc_fn); return 6; }
-
-    BitW bw; bw_init(&bw, fenc);
-    while( (c=fgetc(fin)) != EOF ){
-        bw_put_code(&bw, code[(unsigned char)c].s);
+    if(fin) fclose(fin);
+    if(mapped) mf_close(&min);
+    if(dbuf) free(dbuf);
+    else if(dsrc && !mapped) mf_close(&dmin);
+    if(rc!=0){
+        log_error("encoder","encode failed file=%s", enc_fn);
+        return 6;
     }
-    // 寫入 EOF 碼
-    bw_put_code(&bw, code[EOF_MARK].s);
-    bw_flush_zero(&bw);
-    fclose(fin);
-    fclose(fenc);
 
     log_info("encoder","encode_to_bitstream output_encoded=%s total_bits=%lld",
-             enc_fn, bw.total_bits);
+             enc_fn, total_bits_written);
 
     /* metrics summary */
-    log_info("metrics","summary input_file=%s output_codebook=%s output_encoded=%s "
+    log_info("metrics","summary input_file=%s output_codebook=%s output_encoded=%s format=%s "
                       "num_symbols=%lld unique_symbols=%d fixed_code_bits_per_symbol=%.1f "
                       "entropy_bits_per_symbol=%.6f perplexity=%.6f "
                       "huffman_bits_per_symbol=%.6f total_bits_fixed=%lld total_bits_huffman=%lld "
                       "compression_ratio=%.6f compression_factor=%.6f saving_percentage=%.6f",
-             in_fn, cb_fn, enc_fn, total, unique, (double)fixed_bits,
+             in_fn, cb_fn?cb_fn:"-", enc_fn, block_size?"blocks":interleave>1?"x4":order1?"order1":tans?"tans":digram?"digram":container?"container":"raw",
+             total, unique, (double)fixed_bits,
              entropy, perplexity, huff_bps, total_bits_fixed, total_bits_huff,
              compression_ratio, compression_factor, saving_percentage);
+    if(ctab){
+        // 兩種模式並列；with_tables 另計入檔頭長度表與 context 表
+        log_info("metrics","context_model order0_bits_per_symbol=%.6f order1_bits_per_symbol=%.6f "
+                           "order0_with_tables_bits_per_symbol=%.6f order1_with_tables_bits_per_symbol=%.6f context_classes=%d",
+                 huff_bps, (double)ctx_bits/(double)total,
+                 (double)(total_bits_huff + 8LL*MAX_SYMBOLS)/(double)total,
+                 (double)(ctx_bits + 8LL*(MAX_SYMBOLS + (long long)ctx_bytes))/(double)total, ctx.nclass);
+    }
+
+    if(tans){
+        // tANS 的位元數含最終狀態與哨兵；with_model 另計入模型
+        log_info("metrics","tans_model huffman_bits_per_symbol=%.6f tans_bits_per_symbol=%.6f "
+                           "tans_with_model_bits_per_symbol=%.6f table_log=%d",
+                 huff_bps, (double)total_bits_written/(double)total,
+                 (double)(total_bits_written + 8LL*(long long)huff_tans_model_size(&tm))/(double)total, tm.table_log);
+    }
 
+    if(digram){
+        // 每個原始 byte 的位元數與每個符號平均涵蓋的 byte 數；with_tables 另計入檔頭長度表與 byte 對表
+        log_info("metrics","digram_model order0_bits_per_byte=%.6f digram_bits_per_byte=%.6f "
+                           "order0_with_tables_bits_per_byte=%.6f digram_with_tables_bits_per_byte=%.6f "
+                           "bytes_per_symbol=%.6f pairs=%d",
+                 huff_bps, (double)dm.bits/(double)total,
+                 (double)(total_bits_huff + 8LL*MAX_SYMBOLS)/(double)total,
+                 (double)(dm.bits + 8LL*(MAX_SYMBOLS + (long long)huff_digram_size(dm.dg)))/(double)total,
+                 (double)(total-1)/(double)(dm.symbols > 1 ? dm.symbols-1 : 1), dm.dg->n);
+        metrics_count("digram_symbols", dm.symbols);
+    }
+
+    metrics_count("bytes_out", bytes_out);
+    metrics_count("bits_written", total_bits_written);
+    metrics_count("symbols", total);
+    metrics_report("encoder", metrics_fn);
     log_info("encoder","finish status=ok");
+    digram_free(&dm);
 
-    for(int s=0;s<MAX_SYMBOLS;s++) if(code[s].s) free(code[s].s);
-    tree_free(root);
-    free(rows);
+    free(ctab); huff_ctx_free(&ctx, NULL);
     return 0;
 }
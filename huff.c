@@ -0,0 +1,703 @@
+#define _POSIX_C_SOURCE 200809L
+#include "huff.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+static void put_le(unsigned char *p, uint64_t v, int n) {
+    for (int i=0;i<n;i++) p[i] = (unsigned char)(v >> (8*i));
+}
+static uint64_t get_le(const unsigned char *p, int n) {
+    uint64_t v = 0;
+    for (int i=n-1;i>=0;i--) v = (v<<8) | p[i];
+    return v;
+}
+
+void *huff_alloc(const HuffAllocator *a, size_t size) {
+    return a && a->alloc ? a->alloc(a->opaque, size) : malloc(size);
+}
+void huff_free(const HuffAllocator *a, void *ptr) {
+    if (!ptr) return;
+    if (a && a->free) a->free(a->opaque, ptr);
+    else free(ptr);
+}
+
+int huff_canonical_codes(const uint8_t *len, int nsym, uint64_t *code) {
+    int bl_count[HUFF_MAX_CODE_LEN+1] = {0};
+    for (int s=0;s<nsym;s++) {
+        if (len[s] > HUFF_MAX_CODE_LEN) return -1;
+        bl_count[len[s]]++;
+    }
+    bl_count[0] = 0;
+
+    // Kraft 檢查：sum 2^-len <= 1（以剩餘可用葉數計算，避免溢位）
+    uint64_t left = 1;
+    for (int L=1;L<=HUFF_MAX_CODE_LEN;L++) {
+        if (left > (UINT64_C(1)<<32)) left = UINT64_C(1)<<32;  // 已遠大於剩餘符號數
+        left <<= 1;
+        if ((uint64_t)bl_count[L] > left) return -1;
+        left -= (uint64_t)bl_count[L];
+    }
+
+    // 每個長度的第一個 code（RFC 1951 3.2.2）
+    uint64_t next[HUFF_MAX_CODE_LEN+1];
+    uint64_t c = 0;
+    for (int L=1;L<=HUFF_MAX_CODE_LEN;L++) {
+        c = (c + (uint64_t)bl_count[L-1]) << 1;
+        next[L] = c;
+    }
+    for (int s=0;s<nsym;s++) {
+        code[s] = len[s] ? next[len[s]]++ : 0;
+    }
+    return 0;
+}
+
+/* ---------- 長度限制（package-merge） ---------- */
+typedef struct {
+    long long w;
+    int leaf;       // >=0：葉（符號索引）；-1：由上一層 a、b 兩項組成的 package
+    int a, b;
+} PMItem;
+
+static int cmp_leaf(const void *A, const void *B) {
+    const PMItem *x = (const PMItem*)A, *y = (const PMItem*)B;
+    if (x->w != y->w) return x->w < y->w ? -1 : 1;
+    return x->leaf - y->leaf;   // 同權重依符號排序，確保可重現
+}
+
+static void pm_count(PMItem **lv, int level, int idx, uint8_t *len) {
+    const PMItem *it = &lv[level][idx];
+    if (it->leaf >= 0) { len[it->leaf]++; return; }
+    pm_count(lv, level-1, it->a, len);
+    pm_count(lv, level-1, it->b, len);
+}
+
+int huff_limited_lengths(const long long *freq, int nsym, int max_len, uint8_t *len, const HuffAllocator *a) {
+    memset(len, 0, (size_t)nsym);
+    PMItem *leaves = (PMItem*)huff_alloc(a, sizeof(PMItem)*(nsym ? nsym : 1));
+    if (!leaves) return -1;
+    int n = 0;
+    for (int s=0;s<nsym;s++) {
+        if (freq[s] <= 0) continue;
+        leaves[n].w = freq[s]; leaves[n].leaf = s; leaves[n].a = leaves[n].b = -1;
+        n++;
+    }
+    if (n == 0) { huff_free(a, leaves); return 0; }
+    if (n == 1) { len[leaves[0].leaf] = 1; huff_free(a, leaves); return 0; }
+    if (max_len < 1 || max_len > HUFF_MAX_CODE_LEN || (max_len < 31 && n > (1 << max_len))) {
+        huff_free(a, leaves); return -1;
+    }
+    qsort(leaves, (size_t)n, sizeof(PMItem), cmp_leaf);
+
+    // lv[0] = 葉；lv[i] = 葉 與 lv[i-1] 兩兩打包後依權重合併。
+    // 每層最多 n + (n-1) 項，全部層一次配置
+    PMItem **lv = (PMItem**)huff_alloc(a, sizeof(PMItem*)*max_len);
+    int *cnt = (int*)huff_alloc(a, sizeof(int)*max_len);
+    PMItem *pool = (PMItem*)huff_alloc(a, sizeof(PMItem)*(size_t)(2*n)*(size_t)(max_len-1) + 1);
+    if (!lv || !cnt || !pool) {
+        huff_free(a, lv); huff_free(a, cnt); huff_free(a, pool); huff_free(a, leaves);
+        return -1;
+    }
+    lv[0] = leaves; cnt[0] = n;
+    for (int i=1;i<max_len;i++) {
+        int np = cnt[i-1] / 2;
+        lv[i] = pool + (size_t)(i-1)*(size_t)(2*n);
+        int li = 0, pi = 0, k = 0;
+        while (li < n || pi < np) {
+            long long pw = pi < np ? lv[i-1][2*pi].w + lv[i-1][2*pi+1].w : 0;
+            if (pi >= np || (li < n && leaves[li].w <= pw)) {
+                lv[i][k++] = leaves[li++];
+            } else {
+                PMItem pk = { pw, -1, 2*pi, 2*pi+1 };
+                lv[i][k++] = pk;
+                pi++;
+            }
+        }
+        cnt[i] = k;
+    }
+    // 取最後一層最小的 2n-2 項；每個符號被涵蓋的次數即其 code 長度
+    for (int j=0;j<2*n-2;j++) pm_count(lv, max_len-1, j, len);
+
+    huff_free(a, pool); huff_free(a, lv); huff_free(a, cnt); huff_free(a, leaves);
+    return 0;
+}
+
+long huff_header_encode(const HuffHeader *h, unsigned char *dst) {
+    memcpy(dst, HUFF_MAGIC, 4);
+    dst[4] = (unsigned char)HUFF_VERSION;
+    dst[5] = (unsigned char)h->flags;
+    dst[6] = (unsigned char)(h->nsym & 0xFF);
+    dst[7] = (unsigned char)((h->nsym >> 8) & 0xFF);
+    if (h->flags & HUFF_NO_LEN_TABLE) return 8;
+    memcpy(dst+8, h->len, (size_t)h->nsym);
+    return 8L + h->nsym;
+}
+
+long huff_header_write(FILE *f, const HuffHeader *h) {
+    unsigned char hd[HUFF_HEADER_MAX_BYTES];
+    long n = huff_header_encode(h, hd);
+    if (fwrite(hd, 1, (size_t)n, f) != (size_t)n) return -1;
+    return n;
+}
+
+/* 解析固定 8 bytes；回傳 0 magic 不符，-1 格式錯誤，1 成功 */
+static int header_fixed(const unsigned char *hd, HuffHeader *h) {
+    if (memcmp(hd, HUFF_MAGIC, 4) != 0) return 0;
+    h->version = hd[4];
+    h->flags   = hd[5];
+    h->nsym    = hd[6] | (hd[7] << 8);
+    if (h->version != HUFF_VERSION || h->nsym <= 0 || h->nsym > HUFF_MAX_SYMBOLS) return -1;
+    if (h->flags & HUFF_NO_LEN_TABLE) memset(h->len, 0, sizeof h->len);
+    return 1;
+}
+
+long huff_header_read(FILE *f, HuffHeader *h) {
+    unsigned char hd[8];
+    if (fread(hd, 1, sizeof hd, f) != sizeof hd) return 0;
+    int r = header_fixed(hd, h);
+    if (r <= 0) return r;
+    if (h->flags & HUFF_NO_LEN_TABLE) return (long)sizeof hd;
+    if (fread(h->len, 1, (size_t)h->nsym, f) != (size_t)h->nsym) return -1;
+    return (long)sizeof hd + h->nsym;
+}
+
+long huff_header_decode(const unsigned char *p, size_t n, HuffHeader *h) {
+    if (n < 8) return 0;
+    int r = header_fixed(p, h);
+    if (r <= 0) return r;
+    if (h->flags & HUFF_NO_LEN_TABLE) return 8;
+    if (n < 8 + (size_t)h->nsym) return -1;
+    memcpy(h->len, p+8, (size_t)h->nsym);
+    return 8L + h->nsym;
+}
+
+/* ---------- 串流 chunk ---------- */
+int huff_chunk_write(FILE *f, const HuffChunk *c) {
+    unsigned char hd[HUFF_CHUNK_HEADER_BYTES];
+    hd[0] = (unsigned char)c->flags;
+    put_le(hd+1, c->orig_len, 4);
+    put_le(hd+5, c->comp_len, 4);
+    return fwrite(hd, 1, sizeof hd, f) == sizeof hd ? 0 : -1;
+}
+
+int huff_chunk_read(FILE *f, HuffChunk *c) {
+    unsigned char hd[HUFF_CHUNK_HEADER_BYTES];
+    if (fread(hd, 1, sizeof hd, f) != sizeof hd) return -1;
+    c->flags    = hd[0];
+    c->orig_len = (uint32_t)get_le(hd+1, 4);
+    c->comp_len = (uint32_t)get_le(hd+5, 4);
+    return 0;
+}
+
+/* ---------- 區塊索引 ---------- */
+long huff_index_write(FILE *f, const HuffBlockIndex *ix) {
+    unsigned char hd[16], ent[8];
+    put_le(hd, ix->block_size, 4);
+    put_le(hd+4, ix->orig_size, 8);
+    put_le(hd+12, ix->nblocks, 4);
+    if (fwrite(hd, 1, sizeof hd, f) != sizeof hd) return -1;
+    for (uint32_t i=0;i<=ix->nblocks;i++) {
+        put_le(ent, ix->offsets ? ix->offsets[i] : 0, 8);
+        if (fwrite(ent, 1, sizeof ent, f) != sizeof ent) return -1;
+    }
+    return (long)sizeof hd + 8L*((long)ix->nblocks+1);
+}
+
+long huff_index_read(FILE *f, HuffBlockIndex *ix) {
+    unsigned char hd[16], ent[8];
+    ix->offsets = NULL;
+    if (fread(hd, 1, sizeof hd, f) != sizeof hd) return -1;
+    ix->block_size = (uint32_t)get_le(hd, 4);
+    ix->orig_size  = get_le(hd+4, 8);
+    ix->nblocks    = (uint32_t)get_le(hd+12, 4);
+    if (ix->block_size == 0) return -1;
+    if ((ix->orig_size + ix->block_size - 1) / ix->block_size != ix->nblocks) return -1;
+    ix->offsets = (uint64_t*)malloc(sizeof(uint64_t)*((size_t)ix->nblocks+1));
+    if (!ix->offsets) return -1;
+    for (uint32_t i=0;i<=ix->nblocks;i++) {
+        if (fread(ent, 1, sizeof ent, f) != sizeof ent) { huff_index_free(ix); return -1; }
+        ix->offsets[i] = get_le(ent, 8);
+        if (i && ix->offsets[i] < ix->offsets[i-1]) { huff_index_free(ix); return -1; }
+    }
+    return (long)sizeof hd + 8L*((long)ix->nblocks+1);
+}
+
+void huff_index_free(HuffBlockIndex *ix) { free(ix->offsets); ix->offsets = NULL; }
+
+/* ---------- 同步點索引 ---------- */
+size_t huff_sync_size(const HuffSyncIndex *sx) {
+    return (size_t)sx->count*8 + HUFF_SYNC_FOOTER_BYTES;
+}
+
+void huff_sync_encode(const HuffSyncIndex *sx, unsigned char *dst) {
+    for (uint32_t k=0;k<sx->count;k++) put_le(dst + 8*(size_t)k, sx->bitoff[k], 8);
+    dst += (size_t)sx->count*8;
+    put_le(dst, sx->interval, 4);
+    put_le(dst+4, sx->orig_size, 8);
+    put_le(dst+12, sx->count, 4);
+    memcpy(dst+16, HUFF_SYNC_MAGIC, 4);
+}
+
+int huff_sync_read(FILE *f, HuffSyncIndex *sx) {
+    unsigned char ft[HUFF_SYNC_FOOTER_BYTES], ent[8];
+    sx->bitoff = NULL;
+    if (fseek(f, -(long)HUFF_SYNC_FOOTER_BYTES, SEEK_END) != 0) return -1;
+    if (fread(ft, 1, sizeof ft, f) != sizeof ft || memcmp(ft+16, HUFF_SYNC_MAGIC, 4) != 0) return -1;
+    long fsize = ftell(f);   /* 讀完結尾後位置即檔案大小 */
+    sx->interval  = (uint32_t)get_le(ft, 4);
+    sx->orig_size = get_le(ft+4, 8);
+    sx->count     = (uint32_t)get_le(ft+12, 4);
+    if (sx->interval == 0 || (sx->orig_size + sx->interval - 1) / sx->interval != sx->count) return -1;
+    /* count 來自檔案本身，配置前先確認索引放得進檔案 */
+    if (fsize < 0 || (uint64_t)sx->count > ((uint64_t)fsize - HUFF_SYNC_FOOTER_BYTES) / 8) return -1;
+    if (fseek(f, -(long)(HUFF_SYNC_FOOTER_BYTES + 8*(long)sx->count), SEEK_END) != 0) return -1;
+    sx->bitoff = (uint64_t*)malloc(sizeof(uint64_t)*(sx->count ? sx->count : 1));
+    if (!sx->bitoff) return -1;
+    for (uint32_t k=0;k<sx->count;k++) {
+        if (fread(ent, 1, sizeof ent, f) != sizeof ent) { huff_sync_free(sx); return -1; }
+        sx->bitoff[k] = get_le(ent, 8);
+    }
+    return 0;
+}
+
+void huff_sync_free(HuffSyncIndex *sx) { free(sx->bitoff); sx->bitoff = NULL; }
+
+/* ---------- 檢查碼段 ---------- */
+size_t huff_crc_size(const HuffCrcIndex *cx) {
+    return 16 + (size_t)cx->count*4 + 4;
+}
+
+void huff_crc_encode(const HuffCrcIndex *cx, unsigned char *dst) {
+    put_le(dst, cx->block, 4);
+    put_le(dst+4, cx->orig_size, 8);
+    put_le(dst+12, cx->count, 4);
+    dst += 16;
+    for (uint32_t k=0;k<cx->count;k++) put_le(dst + 4*(size_t)k, cx->crc[k], 4);
+    put_le(dst + 4*(size_t)cx->count, cx->header_crc, 4);
+}
+
+long huff_crc_read(FILE *f, HuffCrcIndex *cx) {
+    unsigned char hd[16], ent[4];
+    cx->crc = NULL;
+    if (fread(hd, 1, sizeof hd, f) != sizeof hd) return -1;
+    cx->block     = (uint32_t)get_le(hd, 4);
+    cx->orig_size = get_le(hd+4, 8);
+    cx->count     = (uint32_t)get_le(hd+12, 4);
+    if (cx->block == 0 || (cx->orig_size + cx->block - 1) / cx->block != cx->count) return -1;
+    cx->crc = (uint32_t*)malloc(sizeof(uint32_t)*(cx->count ? cx->count : 1));
+    if (!cx->crc) return -1;
+    for (uint32_t k=0;k<=cx->count;k++) {
+        if (fread(ent, 1, sizeof ent, f) != sizeof ent) { huff_crc_free(cx); return -1; }
+        if (k < cx->count) cx->crc[k] = (uint32_t)get_le(ent, 4);
+        else cx->header_crc = (uint32_t)get_le(ent, 4);
+    }
+    return (long)huff_crc_size(cx);
+}
+
+void huff_crc_free(HuffCrcIndex *cx) { free(cx->crc); cx->crc = NULL; }
+
+uint32_t huff_crc_header(const HuffHeader *h, const HuffCrcIndex *cx, const unsigned char *tab, size_t tn) {
+    unsigned char hd[HUFF_HEADER_MAX_BYTES], ent[16];
+    uint32_t crc = huff_crc32c(0, hd, (size_t)huff_header_encode(h, hd));
+    put_le(ent, cx->block, 4);
+    put_le(ent+4, cx->orig_size, 8);
+    put_le(ent+12, cx->count, 4);
+    crc = huff_crc32c(crc, ent, sizeof ent);
+    for (uint32_t k=0;k<cx->count;k++) {
+        put_le(ent, cx->crc[k], 4);
+        crc = huff_crc32c(crc, ent, 4);
+    }
+    return tn ? huff_crc32c(crc, tab, tn) : crc;
+}
+
+/* ---------- order-1 context 表 ---------- */
+static size_t ctx_table_size(const uint8_t *len) {
+    size_t k = 0;
+    for (int s=0;s<HUFF_MAX_SYMBOLS;s++) k += len[s] != 0;
+    return HUFF_CTX_BITMAP_BYTES + (k+1)/2;
+}
+
+size_t huff_ctx_size(const HuffCtxTables *c) {
+    size_t n = 256 + 2;
+    for (int k=1;k<c->nclass;k++) n += ctx_table_size(c->len[k]);
+    return n;
+}
+
+void huff_ctx_encode(const HuffCtxTables *c, unsigned char *dst) {
+    memcpy(dst, c->map, 256);
+    put_le(dst+256, (uint64_t)c->nclass, 2);
+    dst += 258;
+    for (int k=1;k<c->nclass;k++) {
+        const uint8_t *len = c->len[k];
+        memset(dst, 0, HUFF_CTX_BITMAP_BYTES);
+        unsigned char *nib = dst + HUFF_CTX_BITMAP_BYTES;
+        int j = 0;
+        for (int s=0;s<HUFF_MAX_SYMBOLS;s++) {
+            if (!len[s]) continue;
+            dst[s>>3] |= (unsigned char)(1u << (s&7));
+            if (j & 1) nib[j>>1] |= (unsigned char)(len[s] << 4);
+            else       nib[j>>1]  = len[s];
+            j++;
+        }
+        dst += ctx_table_size(len);
+    }
+}
+
+long huff_ctx_read(FILE *f, const HuffHeader *h, HuffCtxTables *c, const HuffAllocator *a) {
+    unsigned char hd[258], tab[HUFF_CTX_BITMAP_BYTES + (HUFF_MAX_SYMBOLS+1)/2];
+    c->len = NULL;
+    if (h->nsym != HUFF_MAX_SYMBOLS || fread(hd, 1, sizeof hd, f) != sizeof hd) return -1;
+    memcpy(c->map, hd, 256);
+    c->nclass = (int)get_le(hd+256, 2);
+    if (c->nclass < 1 || c->nclass > HUFF_CTX_MAX_CLASSES) return -1;
+    for (int p=0;p<256;p++) if (c->map[p] >= c->nclass) return -1;
+    c->len = (uint8_t(*)[HUFF_MAX_SYMBOLS])huff_alloc(a, (size_t)c->nclass*sizeof *c->len);
+    if (!c->len) return -1;
+    memset(c->len, 0, (size_t)c->nclass*sizeof *c->len);
+    memcpy(c->len[0], h->len, HUFF_MAX_SYMBOLS);
+    long n = (long)sizeof hd;
+    for (int k=1;k<c->nclass;k++) {
+        if (fread(tab, 1, HUFF_CTX_BITMAP_BYTES, f) != HUFF_CTX_BITMAP_BYTES) { huff_ctx_free(c, a); return -1; }
+        if (tab[HUFF_CTX_BITMAP_BYTES-1] & 0xfe) { huff_ctx_free(c, a); return -1; }   // 超出 nsym 的位元
+        int cnt = 0;
+        for (int s=0;s<HUFF_MAX_SYMBOLS;s++) cnt += (tab[s>>3] >> (s&7)) & 1;
+        size_t nb = (size_t)(cnt+1)/2;
+        unsigned char *nib = tab + HUFF_CTX_BITMAP_BYTES;
+        if (fread(nib, 1, nb, f) != nb) { huff_ctx_free(c, a); return -1; }
+        for (int s=0, j=0;s<HUFF_MAX_SYMBOLS;s++) {
+            if (!((tab[s>>3] >> (s&7)) & 1)) continue;
+            uint8_t L = (uint8_t)((j & 1) ? nib[j>>1] >> 4 : nib[j>>1] & 15);
+            if (!L) { huff_ctx_free(c, a); return -1; }
+            c->len[k][s] = L;
+            j++;
+        }
+        n += HUFF_CTX_BITMAP_BYTES + (long)nb;
+    }
+    return n;
+}
+
+void huff_ctx_free(HuffCtxTables *c, const HuffAllocator *a) { huff_free(a, c->len); c->len = NULL; }
+
+/* ---------- 擴充字母表的 byte 對表 ---------- */
+size_t huff_digram_size(const HuffDigrams *dg) { return 2 + 3*(size_t)dg->n; }
+
+void huff_digram_encode(const HuffDigrams *dg, const uint8_t *len, unsigned char *dst) {
+    put_le(dst, (uint64_t)dg->n, 2);
+    for (int k=0;k<dg->n;k++) {
+        dst[2+3*k]   = dg->pair[k][0];
+        dst[2+3*k+1] = dg->pair[k][1];
+        dst[2+3*k+2] = len[HUFF_MAX_SYMBOLS+k];
+    }
+}
+
+long huff_digram_read(FILE *f, const HuffHeader *h, HuffDigrams *dg, uint8_t *len) {
+    unsigned char hd[2], ent[3];
+    if (h->nsym != HUFF_MAX_SYMBOLS || fread(hd, 1, sizeof hd, f) != sizeof hd) return -1;
+    dg->n = (int)get_le(hd, 2);
+    if (dg->n > HUFF_DIGRAM_MAX) return -1;
+    memset(dg->sym, 0, sizeof dg->sym);
+    memcpy(len, h->len, HUFF_MAX_SYMBOLS);
+    for (int k=0;k<dg->n;k++) {
+        if (fread(ent, 1, sizeof ent, f) != sizeof ent || ent[2] > HUFF_MAX_CODE_LEN) return -1;
+        dg->pair[k][0] = ent[0]; dg->pair[k][1] = ent[1];
+        dg->sym[ent[0]<<8 | ent[1]] = (uint16_t)(HUFF_MAX_SYMBOLS+k);
+        len[HUFF_MAX_SYMBOLS+k] = ent[2];
+    }
+    return 2L + 3L*dg->n;
+}
+
+/* ---------- codebook.csv 欄位解析 ---------- */
+void huff_csv_field(char **cursor, char *dst, size_t dstsz) {
+    char *p = *cursor;
+    size_t k = 0;
+    int quoted = 0;
+
+    // 跳過前導空格
+    while (*p == ' ' || *p == '\t') p++;
+    
+    // 檢查是否為引號開頭
+    if (*p == '"') { 
+        quoted = 1; 
+        p++; 
+    }
+
+    while (*p && k + 1 < dstsz) {
+        if (quoted) {
+            if (*p == '\\' && *(p+1)) {
+                // 反斜線逃脫：\", \\, \n, \r, \t, \x, \,
+                p++;
+                switch (*p) {
+                    case '"':  dst[k++] = '"';  p++; break;
+                    case '\\': dst[k++] = '\\'; p++; break;
+                    case 'n':  dst[k++] = '\n'; p++; break;
+                    case 'r':  dst[k++] = '\r'; p++; break;
+                    case 't':  dst[k++] = '\t'; p++; break;
+                    case ',':  dst[k++] = ',';  p++; break;
+                    case 'x':
+                        // \xNN 保留原文交給 huff_csv_symbol 轉換（\x00 轉成字元會截斷字串）
+                        dst[k++] = '\\';
+                        break;
+                    default:
+                        dst[k++] = *p; // 其他情況保留反斜線
+                        p++;
+                        break;
+                }
+            } else if (*p == '"') {
+                // 結束引號
+                p++;
+                // 跳過後續空格直到逗號
+                while (*p && (*p == ' ' || *p == '\t')) p++;
+                if (*p == ',') p++;
+                break;
+            } else {
+                // 引號內的普通字符
+                dst[k++] = *p;
+                p++;
+            }
+        } else {
+            // 不帶引號的欄位
+            if (*p == ',' || *p == '\r' || *p == '\n') {
+                if (*p == ',') p++;
+                break;
+            } else {
+                dst[k++] = *p;
+                p++;
+            }
+        }
+    }
+    
+    dst[k] = '\0';
+    *cursor = p;
+}
+
+/* 轉回單一位元組/特殊符號 */
+int huff_csv_symbol(const char *s) {
+    if (strcmp(s, "<EOF>") == 0) return HUFF_EOF_MARK;
+    if (strcmp(s, "\\n")  == 0) return '\n';
+    if (strcmp(s, "\\r")  == 0) return '\r';
+    if (strcmp(s, "\\t")  == 0) return '\t';
+    if (strcmp(s, "\\\\") == 0) return '\\';
+    if (strcmp(s, "\\,")  == 0) return ',';
+    if (strcmp(s, "\\\"") == 0) return '\"';
+    if (s[0]=='\\' && s[1]=='x' && isxdigit((unsigned char)s[2]) && isxdigit((unsigned char)s[3]) && s[4]=='\0'){
+        int hi = isdigit((unsigned char)s[2]) ? s[2]-'0' : 10 + (tolower(s[2])-'a');
+        int lo = isdigit((unsigned char)s[3]) ? s[3]-'0' : 10 + (tolower(s[3])-'a');
+        return (hi<<4)|lo;
+    }
+    return (unsigned char)s[0];
+}
+
+/* ---------- 符號統計 ---------- */
+/* 同一 byte 連續出現時，單一計數器會形成 store-to-load 相依鏈；
+ * 改成 8 張子表輪流累加，最後再合併。子表用 uint32_t，因此每段最多處理 HIST_SEGMENT bytes。 */
+#define HIST_TABLES  8
+#define HIST_SEGMENT ((size_t)1 << 30)
+
+static void hist_ref(const unsigned char *p, size_t n, long long *freq) {
+    for (size_t i=0;i<n;i++) freq[p[i]]++;
+}
+
+static void hist_merge(uint32_t t[HIST_TABLES][256], long long *freq) {
+    for (int s=0;s<256;s++) {
+        long long v = 0;
+        for (int k=0;k<HIST_TABLES;k++) v += t[k][s];
+        freq[s] += v;
+    }
+}
+
+#define HIST_ADD_WORD(t, w) do {                                   \
+        t[0][(w)       & 0xFF]++; t[1][((w)>>8)  & 0xFF]++;        \
+        t[2][((w)>>16) & 0xFF]++; t[3][((w)>>24) & 0xFF]++;        \
+        t[4][((w)>>32) & 0xFF]++; t[5][((w)>>40) & 0xFF]++;        \
+        t[6][((w)>>48) & 0xFF]++; t[7][((w)>>56)       ]++;        \
+    } while (0)
+
+static void hist_x8_segment(const unsigned char *p, size_t n, long long *freq) {
+    uint32_t t[HIST_TABLES][256];
+    memset(t, 0, sizeof t);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint64_t a, b;
+        memcpy(&a, p+i, 8);
+        memcpy(&b, p+i+8, 8);
+        HIST_ADD_WORD(t, a);
+        HIST_ADD_WORD(t, b);
+    }
+    for (; i < n; i++) t[0][p[i]]++;
+    hist_merge(t, freq);
+}
+
+/* 瓶頸在分散的計數器累加而非載入；AVX2 沒有 scatter/conflict 偵測，向量載入後仍得逐 byte 累加，不另做 SIMD 版 */
+static HuffHistImpl hist_resolve(HuffHistImpl impl) {
+    return impl == HUFF_HIST_AUTO ? HUFF_HIST_X8 : impl;
+}
+
+const char* huff_histogram_name(HuffHistImpl impl) {
+    switch (hist_resolve(impl)) {
+        case HUFF_HIST_REF: return "ref";
+        default:            return "x8";
+    }
+}
+
+void huff_histogram_impl(HuffHistImpl impl, const unsigned char *p, size_t n, long long *freq) {
+    impl = hist_resolve(impl);
+    if (impl == HUFF_HIST_REF) { hist_ref(p, n, freq); return; }
+    while (n > 0) {
+        size_t seg = n < HIST_SEGMENT ? n : HIST_SEGMENT;
+        hist_x8_segment(p, seg, freq);
+        p += seg; n -= seg;
+    }
+}
+
+void huff_histogram(const unsigned char *p, size_t n, long long *freq) {
+    huff_histogram_impl(HUFF_HIST_AUTO, p, n, freq);
+}
+
+#define HIST_MT_MIN ((size_t)8 << 20)   // 小於 8 MiB 不值得開執行緒
+
+typedef struct {
+    const unsigned char *p;
+    size_t n, part;
+    long long (*freq)[256];
+} HistJob;
+
+static void hist_job(void *ctx, int j) {
+    HistJob *h = (HistJob*)ctx;
+    size_t off = (size_t)j * h->part;
+    if (off >= h->n) return;
+    size_t len = h->n - off < h->part ? h->n - off : h->part;
+    huff_histogram(h->p + off, len, h->freq[j]);
+}
+
+void huff_histogram_mt(const unsigned char *p, size_t n, long long *freq, int nthreads) {
+    if (nthreads <= 1 || n < HIST_MT_MIN) { huff_histogram(p, n, freq); return; }
+    HistJob h;
+    h.p = p; h.n = n;
+    h.part = (n + (size_t)nthreads - 1) / (size_t)nthreads;
+    h.freq = (long long (*)[256])calloc((size_t)nthreads, sizeof *h.freq);
+    if (!h.freq) { huff_histogram(p, n, freq); return; }   // 配置失敗退回單執行緒
+    huff_parallel_for(nthreads, nthreads, hist_job, &h);
+    for (int j=0;j<nthreads;j++)
+        for (int s=0;s<256;s++) freq[s] += h.freq[j][s];
+    free(h.freq);
+}
+
+/* ---------- CRC32C ---------- */
+/* 反射多項式 0x82F63B78；slice-by-8 表在第一次使用時建立 */
+static uint32_t crc_tab[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_tab_init(void) {
+    for (uint32_t b=0;b<256;b++) {
+        uint32_t c = b;
+        for (int k=0;k<8;k++) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+        crc_tab[0][b] = c;
+    }
+    for (int t=1;t<8;t++)
+        for (int b=0;b<256;b++) crc_tab[t][b] = (crc_tab[t-1][b] >> 8) ^ crc_tab[0][crc_tab[t-1][b] & 0xff];
+}
+
+static uint32_t crc_sw(uint32_t c, const unsigned char *p, size_t n) {
+    pthread_once(&crc_once, crc_tab_init);
+    for (; n >= 8; p += 8, n -= 8) {
+        uint32_t lo = c ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        c = crc_tab[7][lo & 0xff] ^ crc_tab[6][(lo >> 8) & 0xff] ^ crc_tab[5][(lo >> 16) & 0xff] ^ crc_tab[4][lo >> 24]
+          ^ crc_tab[3][p[4]] ^ crc_tab[2][p[5]] ^ crc_tab[1][p[6]] ^ crc_tab[0][p[7]];
+    }
+    while (n--) c = (c >> 8) ^ crc_tab[0][(c ^ *p++) & 0xff];
+    return c;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_CRC_SSE42 1
+/* crc32 指令每 8 bytes 一次；延遲約 3 cycles，單一串流已遠快於解碼，不再做多路合併 */
+__attribute__((target("sse4.2")))
+static uint32_t crc_sse42(uint32_t c, const unsigned char *p, size_t n) {
+    uint64_t c64 = c;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        c64 = _mm_crc32_u64(c64, w);
+    }
+    c = (uint32_t)c64;
+    while (n--) c = _mm_crc32_u8(c, *p++);
+    return c;
+}
+static int cpu_has_sse42(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}
+#else
+#define HAVE_CRC_SSE42 0
+static int cpu_has_sse42(void) { return 0; }
+#endif
+
+/* 區塊平行解碼時多條執行緒同時呼叫，CPU 偵測與查表一樣只做一次 */
+static int crc_hw;
+static pthread_once_t crc_hw_once = PTHREAD_ONCE_INIT;
+static void crc_hw_init(void) { crc_hw = cpu_has_sse42(); }
+
+uint32_t huff_crc32c(uint32_t crc, const void *p, size_t n) {
+    pthread_once(&crc_hw_once, crc_hw_init);
+#if HAVE_CRC_SSE42
+    if (crc_hw) return ~crc_sse42(~crc, (const unsigned char*)p, n);
+#endif
+    return ~crc_sw(~crc, (const unsigned char*)p, n);
+}
+
+const char* huff_crc32c_name(void) {
+    pthread_once(&crc_hw_once, crc_hw_init);
+    return crc_hw ? "sse42" : "sw";
+}
+
+/* ---------- 執行緒 ---------- */
+int huff_cpu_count(void) {
+#if defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#else
+    return 1;
+#endif
+}
+
+typedef struct {
+    void (*fn)(void *ctx, int job);
+    void *ctx;
+    int njobs, next;
+    pthread_mutex_t mu;
+} ParallelFor;
+
+static void* parallel_worker(void *arg) {
+    ParallelFor *pf = (ParallelFor*)arg;
+    for (;;) {
+        pthread_mutex_lock(&pf->mu);
+        int job = pf->next++;
+        pthread_mutex_unlock(&pf->mu);
+        if (job >= pf->njobs) break;
+        pf->fn(pf->ctx, job);
+    }
+    return NULL;
+}
+
+void huff_parallel_for(int nthreads, int njobs, void (*fn)(void *ctx, int job), void *ctx) {
+    if (nthreads > njobs) nthreads = njobs;
+    if (nthreads <= 1) {
+        for (int j=0;j<njobs;j++) fn(ctx, j);
+        return;
+    }
+    ParallelFor pf;
+    pf.fn = fn; pf.ctx = ctx; pf.njobs = njobs; pf.next = 0;
+    pthread_mutex_init(&pf.mu, NULL);
+    pthread_t *th = (pthread_t*)malloc(sizeof(pthread_t)*nthreads);
+    int started = 0;
+    while (started < nthreads && pthread_create(&th[started], NULL, parallel_worker, &pf) == 0) started++;
+    if (started == 0) parallel_worker(&pf);   // 無法建立執行緒：由呼叫端自行完成
+    for (int i=0;i<started;i++) pthread_join(th[i], NULL);
+    pthread_mutex_destroy(&pf.mu);
+    free(th);
+}
@@ -0,0 +1,458 @@
+#ifndef HUFF_H
+#define HUFF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define HUFF_ALPHABET    256
+#define HUFF_EOF_MARK    256                  // Huffman 內部用的 EOF 符號
+#define HUFF_MAX_SYMBOLS (HUFF_ALPHABET+1)
+#define HUFF_MAX_CODE_LEN 64                  // canonical code 以 uint64_t 保存
+
+/* 呼叫端提供的配置器；各 API 傳入 NULL 時使用 malloc/free */
+typedef struct {
+    void *(*alloc)(void *opaque, size_t size);
+    void  (*free)(void *opaque, void *ptr);
+    void *opaque;
+} HuffAllocator;
+
+void *huff_alloc(const HuffAllocator *a, size_t size);
+void  huff_free(const HuffAllocator *a, void *ptr);
+
+/* encoded.bin 容器檔頭：
+ *   "HUFC"  magic
+ *   u8      version
+ *   u8      flags（HUFF_FLAG_*）
+ *   u16 LE  nsym：字母表大小（含 EOF_MARK）
+ *   u8[nsym] 每個符號的 code 長度（0 = 未出現）
+ * 未設 flags 時，之後緊接與原本 encoded.bin 相同的位元串（以 EOF_MARK 結尾）。
+ *
+ * HUFF_FLAG_BLOCKS：檔頭後接區塊索引，再接各區塊位元串
+ *   u32 LE  block_size：每個區塊的原始位元組數（最後一塊可較短）
+ *   u64 LE  orig_size：原始檔案大小
+ *   u32 LE  nblocks
+ *   u64 LE  offsets[nblocks+1]：各區塊位元串相對於資料起點的位元組偏移，最後一項為資料總長
+ * 每個區塊從 byte 邊界開始、補 0 到 byte 邊界，不含 EOF_MARK（長度由索引決定），
+ * 因此各區塊可獨立、平行解碼。
+ *
+ * HUFF_FLAG_STREAM：單次讀取的串流格式，檔頭不含 code 長度表，之後為一連串 chunk：
+ *   u8      chunk flags（HUFF_CHUNK_*）
+ *   u32 LE  orig_len：此 chunk 的原始位元組數
+ *   u32 LE  comp_len：此 chunk 位元串的位元組數
+ *   u8[nsym] code 長度表（僅在 HUFF_CHUNK_TABLE 時出現；否則沿用上一個 chunk 的表）
+ *   位元串（byte 對齊，不含 EOF_MARK）
+ * 以帶 HUFF_CHUNK_LAST 且 orig_len=0 的 chunk 結束。
+ *
+ * HUFF_FLAG_SYNC：整檔單一位元串之後（EOF_MARK 與補位之後）附加同步點索引，供隨機存取：
+ *   u64 LE  bitoff[count]：原始位移 k*interval 的符號在位元串中的起始位元（相對於資料起點）
+ *   u32 LE  interval
+ *   u64 LE  orig_size
+ *   u32 LE  count = ceil(orig_size / interval)
+ *   "HSYN"
+ * 固定 20 bytes 的結尾放在檔案最後，decoder 可直接由檔尾讀回。
+ *
+ * HUFF_FLAG_X4：每個解碼單位的符號平分成 4 段，各段各自編成獨立位元串（4 路交錯解碼）。
+ * 與 HUFF_FLAG_BLOCKS 並用時每個區塊是一個單位；單獨使用時檔頭後接 u64 LE orig_size，整檔為一個單位。
+ * 單位格式：
+ *   u32 LE  jump[3]：第 0..2 段位元串的位元組數（第 3 段直到單位結尾）
+ *   4 段位元串，各自 byte 對齊、不含 EOF_MARK
+ * n 個符號時第 k 段為原始位移 [k*q, min((k+1)*q, n))，q = ceil(n/4)。
+ *
+ * HUFF_FLAG_CTX1：order-1 context 碼表（只用於整檔單一位元串）。檔頭的長度表為第 0 類
+ * （出現太少、不值得獨立成表的 context 合併而成）的表，之後接：
+ *   u8[256] map：前一個 byte → context 類別（第一個符號的前一個 byte 視為 0）
+ *   u16 LE  nclass（含第 0 類，最多 256）
+ *   第 1..nclass-1 類各一張表：u8[33] 符號 bitmap（符號 s 在 byte s>>3 的第 s&7 位元），
+ *           再接出現符號的 code 長度，每個 4 位元、低半位元組在前
+ * 位元串中每個符號以前一個 byte 所屬類別的 canonical code 編碼，最後以該類別的 EOF_MARK 結尾。
+ *
+ * HUFF_FLAG_TANS：以 tANS 取代 Huffman（整檔單一位元串），檔頭不含 code 長度表，之後接：
+ *   u8      table_log：狀態表大小 1<<table_log
+ *   u8[32]  符號 bitmap（符號 s 在 byte s>>3 的第 s&7 位元）
+ *   u16 LE  出現符號的正規化頻率（總和為 1<<table_log）
+ *   u64 LE  orig_size
+ *   位元串直到檔尾：符號由後往前編碼、位元 LSB 先寫，最後是兩個最終狀態與一個哨兵 1 位元。
+ *
+ * HUFF_FLAG_DIGRAM：擴充字母表（只用於整檔單一位元串）。符號 nsym+k 代表第 k 個常見 byte 對，
+ * 檔頭的長度表只含 byte 與 EOF_MARK，之後接：
+ *   u16 LE  npair（0..HUFF_DIGRAM_MAX）
+ *   每個 byte 對 3 bytes：第一個 byte、第二個 byte、code 長度
+ * canonical code 依 (長度, 符號) 對全部 nsym+npair 個符號指定。位元串由前往後貪婪切分：
+ * 目前的 byte 與下一個 byte 是表中的 byte 對就編成該符號並前進 2，否則編成單一 byte；最後以 EOF_MARK 結尾。
+ *
+ * HUFF_FLAG_CRC：可與整檔（含 SYNC、CTX1、DIGRAM）及區塊模式並用。長度表之後、各模式的表之前接檢查碼段：
+ *   u32 LE  crc_block：每個檢查碼涵蓋的原始位元組數（區塊模式即 block_size；最後一段可較短）
+ *   u64 LE  orig_size
+ *   u32 LE  count = ceil(orig_size / crc_block)
+ *   u32 LE  crc[count]：各段原始位元組的 CRC32C
+ *   u32 LE  header_crc：檔頭、上述欄位，再接 context 表或 byte 對表（有的話）的 CRC32C
+ * 區塊索引不在 header_crc 內：索引錯誤會使對應區塊的檢查碼不符。 */
+#define HUFF_MAGIC   "HUFC"
+#define HUFF_VERSION 1
+
+#define HUFF_FLAG_BLOCKS 0x01
+#define HUFF_FLAG_STREAM 0x02
+#define HUFF_FLAG_SYNC   0x04
+#define HUFF_FLAG_X4     0x08
+#define HUFF_FLAG_CTX1   0x10
+#define HUFF_FLAG_TANS   0x20
+#define HUFF_FLAG_DIGRAM 0x40
+#define HUFF_FLAG_CRC    0x80
+#define HUFF_NO_LEN_TABLE (HUFF_FLAG_STREAM|HUFF_FLAG_TANS)   // 檔頭不含長度表的模式
+
+#define HUFF_SYNC_MAGIC        "HSYN"
+#define HUFF_SYNC_FOOTER_BYTES 20
+
+#define HUFF_CHUNK_TABLE 0x01
+#define HUFF_CHUNK_LAST  0x02
+#define HUFF_CHUNK_HEADER_BYTES 9
+
+#define HUFF_X4_STREAMS    4
+#define HUFF_X4_JUMP_BYTES 12
+
+#define HUFF_CTX_MAX_CODE_LEN 15      // 長度以 4 位元保存
+#define HUFF_CTX_MAX_CLASSES  256
+#define HUFF_CTX_BITMAP_BYTES 33
+
+#define HUFF_TANS_MIN_LOG     5
+#define HUFF_TANS_MAX_LOG     12
+#define HUFF_TANS_DEFAULT_LOG 12
+
+#define HUFF_CRC_DEFAULT_BLOCK (1u<<20)
+
+#define HUFF_DIGRAM_MAX        (4096 - HUFF_MAX_SYMBOLS)   // 擴充後字母表最多 4096 個符號
+#define HUFF_DIGRAM_MIN_COUNT  8                           // 出現少於此次數的 byte 對不值得佔表
+#define HUFF_EXT_MAX_SYMBOLS   (HUFF_MAX_SYMBOLS + HUFF_DIGRAM_MAX)
+
+typedef struct {
+    int version;
+    int flags;
+    int nsym;
+    uint8_t len[HUFF_MAX_SYMBOLS];
+} HuffHeader;
+
+typedef struct {
+    uint32_t block_size;
+    uint64_t orig_size;
+    uint32_t nblocks;
+    uint64_t *offsets;     // nblocks+1 項
+} HuffBlockIndex;
+
+typedef struct {
+    uint32_t interval;
+    uint64_t orig_size;
+    uint32_t count;
+    uint64_t *bitoff;      // count 項
+} HuffSyncIndex;
+
+typedef struct {
+    uint32_t block;
+    uint64_t orig_size;
+    uint32_t count;
+    uint32_t *crc;         // count 項
+    uint32_t header_crc;
+} HuffCrcIndex;
+
+typedef struct {
+    int nclass;
+    uint8_t map[256];
+    uint8_t (*len)[HUFF_MAX_SYMBOLS];  // nclass 張長度表；len[0] 即檔頭的長度表
+} HuffCtxTables;
+
+typedef struct {
+    int flags;
+    uint32_t orig_len;
+    uint32_t comp_len;
+} HuffChunk;
+
+/* 依 (長度, 符號) 順序指定 canonical code；長度 0 的符號不給 code。
+ * 回傳 0 成功；-1 長度超出範圍或不滿足 Kraft 不等式 */
+int huff_canonical_codes(const uint8_t *len, int nsym, uint64_t *code);
+
+#define HUFF_HEADER_MAX_BYTES (8+HUFF_MAX_SYMBOLS)
+
+/* 將檔頭編碼到 dst（至少 HUFF_HEADER_MAX_BYTES），回傳位元組數 */
+long huff_header_encode(const HuffHeader *h, unsigned char *dst);
+/* 長度限制的最佳前綴碼（package-merge）：freq[0..nsym) 中出現的符號得到
+ * 不超過 max_len 的 code 長度，其餘為 0。暫存記憶體由 a 配置。
+ * 回傳 0 成功；-1 max_len 不足以容納所有符號或配置失敗 */
+int huff_limited_lengths(const long long *freq, int nsym, int max_len, uint8_t *len, const HuffAllocator *a);
+
+/* 寫出檔頭（HUFF_FLAG_STREAM 時不含長度表），回傳寫出的位元組數；失敗回傳 -1 */
+long huff_header_write(FILE *f, const HuffHeader *h);
+/* 讀入並驗證檔頭，回傳讀入的位元組數；magic 不符回傳 0；格式錯誤回傳 -1 */
+long huff_header_read(FILE *f, HuffHeader *h);
+/* 同上，由記憶體 p[0..n) 解析 */
+long huff_header_decode(const unsigned char *p, size_t n, HuffHeader *h);
+
+/* chunk 標頭（不含長度表與位元串）：寫出回傳 0；讀入回傳 0，檔尾或截斷回傳 -1 */
+int huff_chunk_write(FILE *f, const HuffChunk *c);
+int huff_chunk_read(FILE *f, HuffChunk *c);
+
+/* 區塊索引：寫出回傳位元組數，失敗回傳 -1；讀入時配置 offsets，格式錯誤回傳 -1 */
+long huff_index_write(FILE *f, const HuffBlockIndex *ix);
+long huff_index_read(FILE *f, HuffBlockIndex *ix);
+void huff_index_free(HuffBlockIndex *ix);
+
+/* 同步點索引：size 回傳編碼後位元組數；encode 寫進 dst；
+ * read 由檔尾讀回並配置 bitoff，格式錯誤回傳 -1 */
+size_t huff_sync_size(const HuffSyncIndex *sx);
+void   huff_sync_encode(const HuffSyncIndex *sx, unsigned char *dst);
+int    huff_sync_read(FILE *f, HuffSyncIndex *sx);
+void   huff_sync_free(HuffSyncIndex *sx);
+
+/* 檢查碼段：size 回傳編碼後位元組數；encode 寫進 dst；read 配置 crc，格式錯誤回傳 -1，成功回傳讀入的位元組數。
+ * header 依 h、cx（header_crc 以外的欄位）與其後的表 tab[0..tn) 算出 header_crc 應有的值 */
+size_t   huff_crc_size(const HuffCrcIndex *cx);
+void     huff_crc_encode(const HuffCrcIndex *cx, unsigned char *dst);
+long     huff_crc_read(FILE *f, HuffCrcIndex *cx);
+void     huff_crc_free(HuffCrcIndex *cx);
+uint32_t huff_crc_header(const HuffHeader *h, const HuffCrcIndex *cx, const unsigned char *tab, size_t tn);
+
+/* order-1 context 表（不含檔頭中的第 0 類）：size 回傳編碼後位元組數；encode 寫進 dst；
+ * read 以 a 配置 len 並把 h->len 複製為第 0 類，回傳讀入的位元組數，格式錯誤回傳 -1；free 以同一個 a 釋放 */
+size_t huff_ctx_size(const HuffCtxTables *c);
+void   huff_ctx_encode(const HuffCtxTables *c, unsigned char *dst);
+long   huff_ctx_read(FILE *f, const HuffHeader *h, HuffCtxTables *c, const HuffAllocator *a);
+void   huff_ctx_free(HuffCtxTables *c, const HuffAllocator *a);
+
+/* byte 對表：符號 HUFF_MAX_SYMBOLS+k 代表 pair[k]；sym 供編碼時查表 */
+typedef struct {
+    int n;
+    uint8_t pair[HUFF_DIGRAM_MAX][2];
+    uint16_t sym[1<<16];   // (第一個 byte<<8 | 第二個 byte) → 符號，0 表示不是 byte 對
+} HuffDigrams;
+
+/* byte 對表：size 回傳編碼後位元組數；encode 以 len[HUFF_MAX_SYMBOLS..] 為各 byte 對的 code 長度寫進 dst；
+ * read 讀入 byte 對並把 h->len 與各 byte 對的長度寫進 len（HUFF_EXT_MAX_SYMBOLS 項），
+ * 回傳讀入的位元組數，格式錯誤回傳 -1 */
+size_t huff_digram_size(const HuffDigrams *dg);
+void   huff_digram_encode(const HuffDigrams *dg, const uint8_t *len, unsigned char *dst);
+long   huff_digram_read(FILE *f, const HuffHeader *h, HuffDigrams *dg, uint8_t *len);
+
+/* codebook.csv："符號",次數,機率,"codeword",自資訊。
+ * field 取出 *cursor 起的下一個欄位（引號內支援 \" \\ \n \r \t \, 逃脫，\xNN 保留原文）並前進 *cursor；
+ * symbol 把符號欄位轉回 byte 值，"<EOF>" 為 HUFF_EOF_MARK */
+void huff_csv_field(char **cursor, char *dst, size_t cap);
+int  huff_csv_symbol(const char *field);
+
+/* ---------- 符號統計 ---------- */
+typedef enum {
+    HUFF_HIST_AUTO = 0,   // 目前即 X8
+    HUFF_HIST_REF,        // 原本的逐 byte 單一表迴圈（基準）
+    HUFF_HIST_X8          // 8 張交錯子表 + 64-bit 展開讀取
+} HuffHistImpl;
+
+/* 將 p[0..n) 的 byte 次數「累加」到 freq[0..255] */
+void huff_histogram(const unsigned char *p, size_t n, long long *freq);
+void huff_histogram_impl(HuffHistImpl impl, const unsigned char *p, size_t n, long long *freq);
+/* 大輸入切成 nthreads 段平行統計後合併；小輸入直接走單執行緒 */
+void huff_histogram_mt(const unsigned char *p, size_t n, long long *freq, int nthreads);
+/* 實際會使用的實作名稱（"ref" / "x8"），供 log 與基準測試 */
+const char* huff_histogram_name(HuffHistImpl impl);
+
+/* ---------- CRC32C（Castagnoli） ---------- */
+/* 接續 crc 計算 p[0..n)（起始值 0）；CPU 支援 SSE4.2 時用 crc32 指令，否則 slice-by-8 查表 */
+uint32_t huff_crc32c(uint32_t crc, const void *p, size_t n);
+/* 實際會使用的實作名稱（"sse42" / "sw"），供 log 與基準測試 */
+const char* huff_crc32c_name(void);
+
+/* ---------- 執行緒 ---------- */
+/* 線上 CPU 數（無法取得時回傳 1） */
+int huff_cpu_count(void);
+/* 以 nthreads 條執行緒執行 fn(ctx, 0..njobs-1)，各工作由共用計數器依序領取；
+ * 建立執行緒失敗時由已啟動的執行緒（或呼叫端本身）做完全部工作 */
+void huff_parallel_for(int nthreads, int njobs, void (*fn)(void *ctx, int job), void *ctx);
+
+/* ---------- 建碼（huffcode.c） ---------- */
+/* codeword 以 (bits, len) 整數保存：bits 的低 len 位元即 code，MSB 先寫出 */
+typedef struct { uint64_t bits; int len; } HuffCode;
+
+/* 葉節點排序後以兩個佇列 O(n) 合併建 Huffman 樹（同頻率時子樹最小符號小者優先，結果可重現），
+ * 依樹形指定 code（左 0 右 1；只有一種符號時給 "0"）。未出現的符號 len=0。
+ * unique 非 NULL 時回傳出現的符號數。回傳 0 成功，-1 樹深度超過 HUFF_MAX_CODE_LEN */
+int huff_build_codes(const long long *freq, int nsym, HuffCode *code, int *unique);
+/* 保留 code 長度、改以 canonical 規則重新指定 codeword，長度寫入 len_out。回傳 0 成功，-1 長度不合法 */
+int huff_canonicalize(HuffCode *code, int nsym, uint8_t *len_out);
+/* 最長 code 超過 max_len 時改用 package-merge 的最佳長度並指定 canonical code；
+ * 未超過時不變。回傳 0 成功，-1 max_len 容納不下所有符號 */
+int huff_limit_codes(const long long *freq, int nsym, int max_len, HuffCode *code, uint8_t *len_out,
+                     const HuffAllocator *a);
+int huff_max_code_len(const HuffCode *code, int nsym);
+/* order-1 context 碼表：freq[p][s] 為前一個 byte 是 p 時符號 s 的次數（不含 EOF_MARK），
+ * last 為最後一個 byte（EOF_MARK 算在它的 context；空輸入時為 0）。
+ * 獨立成表能省下的位元數超過表本身大小的 context 各自一類（最多 255 個，省最多者優先），
+ * 其餘合併成第 0 類；各類長度不超過 HUFF_CTX_MAX_CODE_LEN，canonical code 寫進 code[類別][s]。
+ * c->len 與暫存空間皆以 a 配置（c->len 以同一個 a 經 huff_ctx_free 釋放）；*bits 為位元串位元數（含 EOF_MARK、不含補位）。
+ * 回傳 0 成功，-1 配置失敗 */
+int huff_ctx_build(const long long (*freq)[HUFF_MAX_SYMBOLS], int last, HuffCtxTables *c,
+                   HuffCode (*code)[HUFF_MAX_SYMBOLS], long long *bits, const HuffAllocator *a);
+
+/* 擴充字母表：select 由 src 的相鄰 byte 次數取出現最多的 max_pairs 個 byte 對
+ * （至少 HUFF_DIGRAM_MIN_COUNT 次，同次數時值小者優先；暫存空間以 a 配置），回傳 byte 對數，配置失敗回傳 -1；
+ * count 依貪婪切分把各符號次數「累加」到 freq[0..HUFF_MAX_SYMBOLS+dg->n)（不含 EOF_MARK）；
+ * prune 移除 freq 少於 min 的 byte 對並同步壓縮 freq，回傳移除數（移除未用到的 byte 對不改變切分） */
+int  huff_digram_select(const unsigned char *src, size_t n, int max_pairs, HuffDigrams *dg, const HuffAllocator *a);
+void huff_digram_count(const HuffDigrams *dg, const unsigned char *src, size_t n, long long *freq);
+int  huff_digram_prune(HuffDigrams *dg, long long *freq, long long min);
+
+/* ---------- 位元寫出 ---------- */
+/* 64-bit 累加器：code 以整數一次放入，湊滿 64 位元才以 big-endian 寫進輸出緩衝 */
+typedef struct {
+    FILE *f; uint64_t acc; int nbits;     // acc 由 MSB 往下填，nbits < 64
+    unsigned char *buf; size_t pos, cap;  // f==NULL 時直接寫進呼叫端的 buf
+    long long total_bits;
+    int overflow;                         // f==NULL 且 buf 已滿：後續位元被丟棄
+} HuffBitWriter;
+
+void huff_bw_init(HuffBitWriter *bw, FILE *f);      // 配置 1 MiB 緩衝，滿了寫到 f
+void huff_bw_init_mem(HuffBitWriter *bw, unsigned char *buf, size_t cap);
+void huff_bw_put(HuffBitWriter *bw, HuffCode c);
+void huff_bw_encode(HuffBitWriter *bw, const HuffCode *code, const unsigned char *src, size_t n);
+/* 同上，但依 dg 貪婪切分，byte 對以擴充符號的 code 寫出 */
+void huff_bw_encode_digram(HuffBitWriter *bw, const HuffCode *code, const HuffDigrams *dg,
+                           const unsigned char *src, size_t n);
+/* 補 0 到 byte 邊界並寫出剩餘位元組（補的位元也計入 total_bits） */
+void huff_bw_flush(HuffBitWriter *bw);
+void huff_bw_free(HuffBitWriter *bw);
+
+/* ---------- 位元讀取與查表解碼 ---------- */
+typedef struct {
+    FILE *f;            // NULL：直接讀 buf 指向的記憶體
+    unsigned char *chunk;
+    const unsigned char *buf;
+    size_t pos, len;
+    uint64_t bits;      // MSB 對齊的位元緩衝
+    int nbits;          // bits 中的有效位元數（含檔尾補的 0）
+    long long avail;    // 尚未消耗、來自檔案的真實位元數
+    int eof;
+    long long misses;   // 查表解碼時第一層未命中、需查第二層的次數
+} HuffBitReader;
+
+void huff_br_init(HuffBitReader *br, FILE *f);      // 配置 64 KiB 讀取緩衝
+void huff_br_init_mem(HuffBitReader *br, const unsigned char *data, size_t n);
+void huff_br_free(HuffBitReader *br);
+/* 補到至少 57 位元；檔案讀完後以 0 補齊，avail 只計真實位元 */
+void huff_br_refill(HuffBitReader *br);
+void huff_br_skip(HuffBitReader *br, int n);        // n <= 56
+
+/* 兩層解碼表：第一層以 HUFF_DT_ROOT_BITS 位元索引直接得到 (symbol, code 長度)；
+ * 較長的 code 依其前綴連到第二層表，第二層大小依該前綴下最長 code 決定。 */
+#define HUFF_DT_ROOT_BITS    11
+#define HUFF_DT_MAX_CODE_LEN 32
+
+typedef struct {
+    uint16_t symbol;    // 葉：符號
+    uint8_t  len;       // 葉：code 總長度；0 表示此索引不對應任何 code
+    uint8_t  sub_bits;  // >0：連到第二層表，值為第二層索引位元數
+    uint32_t sub_off;   // 第二層表於 e[] 中的起點
+} HuffDEntry;
+
+typedef struct {
+    HuffDEntry *e;      // 第一層 (1<<HUFF_DT_ROOT_BITS) 項，其後接各第二層表
+    int size, cap;      // cap：e 已配置的項數，重建時足夠就沿用
+    int max_len;
+} HuffDTable;
+
+/* 由各符號的 (len, val) 建表，len=0 的符號略過。回傳 0 成功；
+ * -1 code 超過 HUFF_DT_MAX_CODE_LEN 或配置失敗 */
+int  huff_dtable_build(HuffDTable *t, const uint8_t *len, const uint64_t *val, int nsym, const HuffAllocator *a);
+void huff_dtable_free(HuffDTable *t, const HuffAllocator *a);
+
+static inline const HuffDEntry* huff_dt_lookup(const HuffDTable *t, uint64_t bits){
+    const HuffDEntry *e = &t->e[bits >> (64-HUFF_DT_ROOT_BITS)];
+    if (e->sub_bits)
+        e = &t->e[e->sub_off + (uint32_t)((bits << HUFF_DT_ROOT_BITS) >> (64 - e->sub_bits))];
+    return e;
+}
+
+/* 解碼剛好 n 個符號到 dst（NULL 表示丟棄），*bitpos 累計已消耗位元。
+ * 回傳 0 成功，否則為出錯的位元位置（從 1 起算） */
+long long huff_br_decode(HuffBitReader *br, const HuffDTable *t, unsigned char *dst, size_t n, long long *bitpos);
+/* 解碼到 EOF_MARK 為止，最多寫 cap 個符號，*outn 為寫出數。回傳 0 遇到 EOF_MARK；
+ * 1 真實位元用盡仍未遇到 EOF_MARK；HUFF_E_DST_SMALL dst 已滿（清空後可再呼叫）；HUFF_E_CORRUPT 無效 code */
+int huff_br_decode_eof(HuffBitReader *br, const HuffDTable *t, unsigned char *dst, size_t cap,
+                       size_t *outn, long long *bitpos);
+
+/* order-1 context：同 huff_br_decode_eof，但每個符號以 tabs[map[*prev]] 解碼；
+ * *prev 為前一個 byte，跨呼叫保存（起始為 0） */
+int huff_br_decode_ctx_eof(HuffBitReader *br, const HuffDTable *tabs, const uint8_t *map, int *prev,
+                           unsigned char *dst, size_t cap, size_t *outn, long long *bitpos);
+
+/* 擴充字母表：同 huff_br_decode_eof，但 byte 對符號一次寫出 2 bytes（dst 剩 1 byte 時回傳 HUFF_E_DST_SMALL） */
+int huff_br_decode_digram_eof(HuffBitReader *br, const HuffDTable *t, const HuffDigrams *dg,
+                              unsigned char *dst, size_t cap, size_t *outn, long long *bitpos);
+
+/* ---------- 4 路交錯位元串（HUFF_FLAG_X4） ---------- */
+/* n 個符號的單位中第 k 段的起點與符號數 */
+static inline size_t huff_x4_start(size_t n, int k){
+    size_t s = (size_t)k * ((n + HUFF_X4_STREAMS - 1) / HUFF_X4_STREAMS);
+    return s < n ? s : n;
+}
+static inline size_t huff_x4_count(size_t n, int k){ return huff_x4_start(n, k+1) - huff_x4_start(n, k); }
+/* code 最長 max_len 位元時，n 個符號編成一個單位的最大位元組數 */
+size_t huff_x4_bound(size_t n, int max_len);
+/* 將 src[0..n) 編成一個單位寫進 dst，*bits 為 4 段位元串的總位元數（含補位）。
+ * 回傳寫出的位元組數；cap 不足回傳 -1 */
+long long huff_x4_encode(const HuffCode *code, const unsigned char *src, size_t n,
+                         unsigned char *dst, size_t cap, long long *bits);
+/* 解析跳躍表：off[k]..off[k+1] 為第 k 段位元串在 src 中的範圍。回傳 0 成功，-1 超出 srclen */
+int huff_x4_offsets(const unsigned char *src, size_t srclen, size_t off[HUFF_X4_STREAMS+1]);
+/* 由一個單位解出剛好 n 個符號：4 段在同一個迴圈裡輪流前進，彼此沒有資料相依。
+ * *misses 累加第二層查表次數。回傳 0 成功，否則為單位內出錯的位元位置（從 1 起算） */
+long long huff_x4_decode(const unsigned char *src, size_t srclen, const HuffDTable *t,
+                         unsigned char *dst, size_t n, long long *misses);
+
+/* ---------- tANS（HUFF_FLAG_TANS，tans.c） ---------- */
+typedef struct {
+    int table_log;
+    uint16_t norm[HUFF_ALPHABET];   // 正規化頻率，出現過的符號至少 1，總和 1<<table_log
+} HuffTansModel;
+
+/* 將 byte 頻率正規化成總和 1<<table_log 的份數。回傳 0 成功；-1 table_log 超出範圍或符號數多於狀態數 */
+int    huff_tans_normalize(const long long *freq, int table_log, HuffTansModel *m);
+size_t huff_tans_model_size(const HuffTansModel *m);
+void   huff_tans_model_encode(const HuffTansModel *m, unsigned char *dst);
+/* 回傳讀掉的位元組數；-1 格式錯誤 */
+long   huff_tans_model_decode(const unsigned char *p, size_t n, HuffTansModel *m);
+/* n 個符號編碼後的最大位元組數 */
+size_t huff_tans_bound(size_t n, int table_log);
+/* 回傳寫出的位元組數；cap 不足或 src 含模型外的符號回傳 -1 */
+long long huff_tans_encode(const HuffTansModel *m, const unsigned char *src, size_t n,
+                           unsigned char *dst, size_t cap);
+/* 解出剛好 n 個符號；位元串須剛好用完。回傳 0 成功，-1 資料錯誤 */
+long long huff_tans_decode(const HuffTansModel *m, const unsigned char *src, size_t srclen,
+                           unsigned char *dst, size_t n);
+
+/* ---------- 記憶體對記憶體 API ---------- */
+/* 輸出即 container 格式（檔頭 + 以 EOF_MARK 結尾的單一位元串），與 encoder --format=container 相容。
+ * 編解碼 context 可重複使用：保留碼表與解碼表的記憶體，解碼時碼表相同就不重建。
+ * 同一個 context 不可同時由多條執行緒使用。 */
+enum {
+    HUFF_OK          =  0,
+    HUFF_E_PARAM     = -1,
+    HUFF_E_NOMEM     = -2,
+    HUFF_E_DST_SMALL = -3,   // dst 容量不足
+    HUFF_E_FORMAT    = -4,   // 不是 container，或含此 API 不支援的旗標 / 超過 32 位元的 code
+    HUFF_E_CORRUPT   = -5
+};
+const char *huff_strerror(int rc);
+
+typedef struct HuffEncoder HuffEncoder;
+typedef struct HuffDecoder HuffDecoder;
+
+HuffEncoder *huff_encoder_new(const HuffAllocator *a);
+void huff_encoder_free(HuffEncoder *e);
+/* code 長度上限（1..HUFF_DT_MAX_CODE_LEN，預設 HUFF_DT_MAX_CODE_LEN 使查表解碼一定可用） */
+int  huff_encoder_set_max_code_len(HuffEncoder *e, int max_len);
+/* n 位元組輸入編碼後的最大長度 */
+size_t huff_encode_bound(size_t n);
+/* 回傳寫入 dst 的位元組數，失敗回傳 HUFF_E_* */
+long long huff_encode(HuffEncoder *e, const void *src, size_t n, void *dst, size_t cap);
+
+HuffDecoder *huff_decoder_new(const HuffAllocator *a);
+void huff_decoder_free(HuffDecoder *d);
+/* 回傳寫入 dst 的位元組數，失敗回傳 HUFF_E_* */
+long long huff_decode(HuffDecoder *d, const void *src, size_t n, void *dst, size_t cap);
+
+#endif
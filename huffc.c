@@ -0,0 +1,255 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include "logger.h"
+#include "huff.h"
+#include "huffd.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#define HAVE_UNIX_SOCKET 1
+#endif
+
+/* huffd 的測試用 client：
+ *   --encode in out / --decode in out  單次請求
+ *   --stats                            印出伺服器的計數器與延遲百分位數
+ *   --load=N [--concurrency=C] in      C 條連線共送 N 次 encode + decode，逐次比對還原結果 */
+
+static double now_sec(void){
+    struct timespec ts;
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+static unsigned char *load_file(const char *fn, size_t *n){
+    FILE *f = fopen(fn, "rb");
+    if(!f) return NULL;
+    size_t cap = 1<<16, len = 0;
+    unsigned char *p = (unsigned char*)malloc(cap);
+    for(;;){
+        if(len == cap){ cap *= 2; p = (unsigned char*)realloc(p, cap); }
+        size_t r = fread(p+len, 1, cap-len, f);
+        if(r == 0) break;
+        len += r;
+    }
+    fclose(f);
+    *n = len;
+    return p;
+}
+
+#ifdef HAVE_UNIX_SOCKET
+static const char *sock_path = NULL;
+
+static int connect_sock(void){
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if(strlen(sock_path) >= sizeof addr.sun_path) return -1;
+    strcpy(addr.sun_path, sock_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+    if(connect(fd, (struct sockaddr*)&addr, sizeof addr) != 0){ close(fd); return -1; }
+    return fd;
+}
+
+static int io_full(int fd, unsigned char *p, size_t n, bool wr){
+    while(n){
+        ssize_t r = wr ? write(fd, p, n) : read(fd, p, n);
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) return -1;
+        p += r; n -= (size_t)r;
+    }
+    return 0;
+}
+
+/* 送出一個請求並讀回回應到 *resp（必要時放大）。回傳 status，連線錯誤回傳 -1 */
+static int call(int fd, int op, const unsigned char *src, size_t n, unsigned char **resp, size_t *cap, size_t *rlen){
+    unsigned char hd[HUFFD_FRAME_BYTES];
+    huffd_frame_encode(hd, op, (uint32_t)n);
+    // 伺服器拒收過大請求時會先回應再關閉連線，寫入失敗仍要讀回 status
+    bool sent = io_full(fd, hd, sizeof hd, true) == 0 && (!n || io_full(fd, (unsigned char*)src, n, true) == 0);
+    if(io_full(fd, hd, sizeof hd, false) != 0) return -1;
+    if(!sent && hd[0] == HUFFD_OK) return -1;
+    size_t len = huffd_frame_len(hd);
+    if(len > *cap){
+        unsigned char *p = (unsigned char*)realloc(*resp, len);
+        if(!p) return -1;
+        *resp = p; *cap = len;
+    }
+    if(len && io_full(fd, *resp, len, false) != 0) return -1;
+    *rlen = len;
+    return hd[0];
+}
+
+static const char *status_name(int s){
+    if(s == HUFFD_E_OP) return "bad_op";
+    if(s == HUFFD_E_TOO_BIG) return "request_too_big";
+    if(s < 0) return "connection";
+    return huff_strerror(-s);
+}
+
+typedef struct {
+    const unsigned char *src;
+    size_t n;
+    int requests;              // 此連線要做的 encode + decode 輪數
+    double *lat_enc, *lat_dec;
+    int done, errors, mismatch;
+} LoadJob;
+
+static void *load_main(void *arg){
+    LoadJob *j = (LoadJob*)arg;
+    int fd = connect_sock();
+    if(fd < 0){ j->errors = j->requests; return NULL; }
+    unsigned char *enc = NULL, *dec = NULL;
+    size_t enc_cap = 0, dec_cap = 0, enc_len = 0, dec_len = 0;
+    for(int i=0;i<j->requests;i++){
+        double t0 = now_sec();
+        int s = call(fd, HUFFD_OP_ENCODE, j->src, j->n, &enc, &enc_cap, &enc_len);
+        double t1 = now_sec();
+        if(s != HUFFD_OK){ j->errors++; if(s < 0) break; continue; }
+        s = call(fd, HUFFD_OP_DECODE, enc, enc_len, &dec, &dec_cap, &dec_len);
+        double t2 = now_sec();
+        if(s != HUFFD_OK){ j->errors++; if(s < 0) break; continue; }
+        if(dec_len != j->n || (j->n && memcmp(dec, j->src, j->n) != 0)) j->mismatch++;
+        j->lat_enc[j->done] = t1 - t0;
+        j->lat_dec[j->done] = t2 - t1;
+        j->done++;
+    }
+    close(fd);
+    free(enc); free(dec);
+    return NULL;
+}
+
+static int cmp_double(const void *A, const void *B){
+    double a = *(const double*)A, b = *(const double*)B;
+    return (a > b) - (a < b);
+}
+static double pct_us(const double *v, int n, double q){
+    return n ? 1e6*v[(int)(q*(double)(n-1) + 0.5)] : 0.0;
+}
+
+static int run_load(const char *in_fn, int total, int conc){
+    size_t n;
+    unsigned char *src = load_file(in_fn, &n);
+    if(!src){ log_error("huffc","open input failed file=%s", in_fn); return 2; }
+    if(conc > total) conc = total;
+    LoadJob *jobs = (LoadJob*)calloc((size_t)conc, sizeof(LoadJob));
+    pthread_t *th = (pthread_t*)calloc((size_t)conc, sizeof(pthread_t));
+    double *lat_enc = (double*)malloc(sizeof(double)*(size_t)total);
+    double *lat_dec = (double*)malloc(sizeof(double)*(size_t)total);
+    int off = 0;
+    for(int c=0;c<conc;c++){
+        jobs[c].src = src; jobs[c].n = n;
+        jobs[c].requests = total/conc + (c < total%conc);
+        jobs[c].lat_enc = lat_enc + off;
+        jobs[c].lat_dec = lat_dec + off;
+        off += jobs[c].requests;
+    }
+    double t0 = now_sec();
+    for(int c=0;c<conc;c++) pthread_create(&th[c], NULL, load_main, &jobs[c]);
+    for(int c=0;c<conc;c++) pthread_join(th[c], NULL);
+    double wall = now_sec() - t0;
+
+    // 各連線的延遲樣本收攏到開頭再排序
+    int done = 0, errors = 0, mismatch = 0;
+    for(int c=0;c<conc;c++){
+        memmove(lat_enc + done, jobs[c].lat_enc, sizeof(double)*(size_t)jobs[c].done);
+        memmove(lat_dec + done, jobs[c].lat_dec, sizeof(double)*(size_t)jobs[c].done);
+        done += jobs[c].done; errors += jobs[c].errors; mismatch += jobs[c].mismatch;
+    }
+    qsort(lat_enc, (size_t)done, sizeof(double), cmp_double);
+    qsort(lat_dec, (size_t)done, sizeof(double), cmp_double);
+    log_info("metrics","summary tool=huffc file=%s bytes=%zu concurrency=%d roundtrips=%d errors=%d mismatch=%d wall_ms=%.3f "
+                       "requests_per_sec=%.1f mb_per_sec=%.2f "
+                       "encode_us_p50=%.1f encode_us_p90=%.1f encode_us_p99=%.1f encode_us_max=%.1f "
+                       "decode_us_p50=%.1f decode_us_p90=%.1f decode_us_p99=%.1f decode_us_max=%.1f",
+             in_fn, n, conc, done, errors, mismatch, wall*1e3,
+             wall > 0 ? 2.0*done/wall : 0.0, wall > 0 ? (double)n*done/wall/1e6 : 0.0,
+             pct_us(lat_enc, done, 0.50), pct_us(lat_enc, done, 0.90), pct_us(lat_enc, done, 0.99), pct_us(lat_enc, done, 1.0),
+             pct_us(lat_dec, done, 0.50), pct_us(lat_dec, done, 0.90), pct_us(lat_dec, done, 0.99), pct_us(lat_dec, done, 1.0));
+    free(jobs); free(th); free(lat_enc); free(lat_dec); free(src);
+    if(errors || mismatch || done != total){ log_error("huffc","load failed errors=%d mismatch=%d", errors, mismatch); return 5; }
+    return 0;
+}
+
+static int run_single(int op, const char *in_fn, const char *out_fn){
+    size_t n = 0;
+    unsigned char *src = op == HUFFD_OP_STATS ? NULL : load_file(in_fn, &n);
+    if(op != HUFFD_OP_STATS && !src){ log_error("huffc","open input failed file=%s", in_fn); return 2; }
+    int fd = connect_sock();
+    if(fd < 0){ log_error("huffc","connect failed socket=%s errno=%d", sock_path, errno); free(src); return 3; }
+    unsigned char *resp = NULL;
+    size_t cap = 0, len = 0;
+    int s = call(fd, op, src, n, &resp, &cap, &len);
+    close(fd);
+    free(src);
+    if(s != HUFFD_OK){ log_error("huffc","request failed status=%s", status_name(s)); free(resp); return 5; }
+    int rc = 0;
+    if(op == HUFFD_OP_STATS){
+        printf("%.*s\n", (int)len, (const char*)resp);
+    }else{
+        FILE *f = fopen(out_fn, "wb");
+        if(!f || fwrite(resp, 1, len, f) != len){ log_error("huffc","write output failed file=%s", out_fn); rc = 2; }
+        if(f) fclose(f);
+        if(!rc) log_info("huffc","finish in_bytes=%zu out_bytes=%zu", n, len);
+    }
+    free(resp);
+    return rc;
+}
+#endif
+
+int main(int argc, char **argv){
+    const char *pos[2] = {NULL, NULL};
+    int npos = 0, op = 0, load = 0, conc = 1;
+    bool bad = false;
+    for(int i=1;i<argc;i++){
+        if(strncmp(argv[i], "--socket=", 9) == 0){
+#ifdef HAVE_UNIX_SOCKET
+            sock_path = argv[i]+9;
+#endif
+        }
+        else if(strcmp(argv[i], "--encode") == 0) op = HUFFD_OP_ENCODE;
+        else if(strcmp(argv[i], "--decode") == 0) op = HUFFD_OP_DECODE;
+        else if(strcmp(argv[i], "--stats") == 0) op = HUFFD_OP_STATS;
+        else if(strncmp(argv[i], "--load=", 7) == 0){ load = atoi(argv[i]+7); if(load < 1) bad = true; }
+        else if(strncmp(argv[i], "--concurrency=", 14) == 0){ conc = atoi(argv[i]+14); if(conc < 1) bad = true; }
+        else if(argv[i][0] == '-' && argv[i][1] == '-') bad = true;
+        else if(npos < 2) pos[npos++] = argv[i];
+        else bad = true;
+    }
+    if(load && op) bad = true;
+    if(load && npos != 1) bad = true;
+    if((op == HUFFD_OP_ENCODE || op == HUFFD_OP_DECODE) && npos != 2) bad = true;
+    if(op == HUFFD_OP_STATS && npos != 0) bad = true;
+    if(!load && !op) bad = true;
+#ifdef HAVE_UNIX_SOCKET
+    if(!sock_path) bad = true;
+#endif
+    if(bad){
+        fprintf(stderr, "Usage: %s --socket=PATH --encode|--decode in_fn out_fn\n"
+                        "       %s --socket=PATH --stats\n"
+                        "       %s --socket=PATH --load=N [--concurrency=C] in_fn\n", argv[0], argv[0], argv[0]);
+        return 1;
+    }
+#ifdef HAVE_UNIX_SOCKET
+    signal(SIGPIPE, SIG_IGN);
+    int rc = load ? run_load(pos[0], load, conc) : run_single(op, pos[0], pos[1]);
+    log_flush();
+    return rc;
+#else
+    log_error("huffc","unsupported reason=no_unix_domain_socket");
+    return 1;
+#endif
+}
@@ -0,0 +1,686 @@
+#include "huff.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* ---------- 建樹 ---------- */
+/* 節點放在呼叫端堆疊上的單一陣列（最多 2*nsym-1 個），子節點以索引表示，不需配置記憶體 */
+typedef struct {
+    long long freq;
+    int symbol;                // 0..nsym-1；內部節點為 -1
+    int minSym;                // 子樹中最小的 symbol（做 tie-break）
+    int l, r;                  // 子節點索引
+} HNode;
+
+static int cmp_node(const HNode *x, const HNode *y){
+    if (x->freq != y->freq) return (x->freq < y->freq) ? -1 : 1;
+    // tie-break：minSym 小者在前，確保可重現性
+    if (x->minSym != y->minSym) return (x->minSym < y->minSym) ? -1 : 1;
+    return 0;
+}
+static int cmp_leaf(const void *A, const void *B){ return cmp_node((const HNode*)A, (const HNode*)B); }
+
+/* 兩個佇列的前端取 (freq, minSym) 較小者：葉節點已排序，
+ * 內部節點依建立順序本身就是遞增的（兩個子節點依序取出，和與 minSym 都不會變小） */
+static int pop_min(const HNode *pool, int *leaf, int nleaf, int *inner, int np){
+    if (*leaf < nleaf && (*inner == np || cmp_node(&pool[*leaf], &pool[*inner]) < 0)) return (*leaf)++;
+    return (*inner)++;
+}
+
+static int gen_codes_rec(const HNode *pool, int i, uint64_t v, int d, HuffCode *code){
+    const HNode *p = &pool[i];
+    if (p->symbol >= 0) {
+        code[p->symbol].bits = v;
+        code[p->symbol].len  = d ? d : 1;  // 單一符號邊界：給 '0'
+        return 0;
+    }
+    if (d >= HUFF_MAX_CODE_LEN) return -1;
+    if (gen_codes_rec(pool, p->l, v<<1, d+1, code)) return -1;
+    return gen_codes_rec(pool, p->r, (v<<1)|1, d+1, code);
+}
+
+int huff_build_codes(const long long *freq, int nsym, HuffCode *code, int *unique){
+    HNode pool[2*HUFF_MAX_SYMBOLS];
+    int np = 0;
+    if (nsym > HUFF_MAX_SYMBOLS) return -1;
+    memset(code, 0, sizeof(HuffCode)*(size_t)nsym);
+    for (int s=0;s<nsym;s++) {
+        if (freq[s] <= 0) continue;
+        HNode *p = &pool[np++];
+        p->freq = freq[s]; p->symbol = s; p->minSym = s; p->l = p->r = -1;
+    }
+    if (unique) *unique = np;
+    if (np == 0) return 0;
+    // 葉節點排序後，內部節點依序接在陣列後段：合併順序與最小堆相同，只是不需要堆
+    qsort(pool, (size_t)np, sizeof(HNode), cmp_leaf);
+    int nleaf = np, leaf = 0, inner = np;
+    while ((nleaf - leaf) + (np - inner) >= 2) {
+        int a = pop_min(pool, &leaf, nleaf, &inner, np);
+        int b = pop_min(pool, &leaf, nleaf, &inner, np);
+        HNode *p = &pool[np++];
+        p->freq = pool[a].freq + pool[b].freq; p->symbol = -1; p->l = a; p->r = b;
+        p->minSym = pool[a].minSym < pool[b].minSym ? pool[a].minSym : pool[b].minSym;
+    }
+    return gen_codes_rec(pool, np-1, 0, 0, code);
+}
+
+int huff_canonicalize(HuffCode *code, int nsym, uint8_t *len_out){
+    uint64_t val[HUFF_MAX_SYMBOLS];
+    if (nsym > HUFF_MAX_SYMBOLS) return -1;
+    for (int s=0;s<nsym;s++) len_out[s] = (uint8_t)code[s].len;
+    if (huff_canonical_codes(len_out, nsym, val) != 0) return -1;
+    for (int s=0;s<nsym;s++) code[s].bits = val[s];
+    return 0;
+}
+
+int huff_max_code_len(const HuffCode *code, int nsym){
+    int m = 0;
+    for (int s=0;s<nsym;s++) if (code[s].len > m) m = code[s].len;
+    return m;
+}
+
+int huff_limit_codes(const long long *freq, int nsym, int max_len, HuffCode *code, uint8_t *len_out,
+                     const HuffAllocator *a){
+    uint64_t val[HUFF_MAX_SYMBOLS];
+    if (huff_max_code_len(code, nsym) <= max_len) return 0;
+    if (huff_limited_lengths(freq, nsym, max_len, len_out, a) != 0) return -1;
+    if (huff_canonical_codes(len_out, nsym, val) != 0) return -1;
+    for (int s=0;s<nsym;s++) { code[s].bits = val[s]; code[s].len = len_out[s]; }
+    return 0;
+}
+
+/* ---------- order-1 context 碼表 ---------- */
+/* 長度不超過 HUFF_CTX_MAX_CODE_LEN 的最佳前綴碼長度 */
+static int ctx_lengths(const long long *f, uint8_t *len, const HuffAllocator *a){
+    HuffCode code[HUFF_MAX_SYMBOLS];
+    if (huff_build_codes(f, HUFF_MAX_SYMBOLS, code, NULL) != 0)
+        return huff_limited_lengths(f, HUFF_MAX_SYMBOLS, HUFF_CTX_MAX_CODE_LEN, len, a);
+    if (huff_canonicalize(code, HUFF_MAX_SYMBOLS, len) != 0) return -1;
+    return huff_limit_codes(f, HUFF_MAX_SYMBOLS, HUFF_CTX_MAX_CODE_LEN, code, len, a);
+}
+static long long ctx_cost(const long long *f, const uint8_t *len){
+    long long b = 0;
+    for (int s=0;s<HUFF_MAX_SYMBOLS;s++) b += f[s]*len[s];
+    return b;
+}
+
+int huff_ctx_build(const long long (*freq)[HUFF_MAX_SYMBOLS], int last, HuffCtxTables *c,
+                   HuffCode (*code)[HUFF_MAX_SYMBOLS], long long *bits, const HuffAllocator *a){
+    long long (*row)[HUFF_MAX_SYMBOLS] = (long long(*)[HUFF_MAX_SYMBOLS])huff_alloc(a, 256*sizeof *row);
+    c->len = (uint8_t(*)[HUFF_MAX_SYMBOLS])huff_alloc(a, HUFF_CTX_MAX_CLASSES*sizeof *c->len);
+    if (!row || !c->len) { huff_free(a, row); huff_ctx_free(c, a); return -1; }
+    memset(c->len, 0, HUFF_CTX_MAX_CLASSES*sizeof *c->len);
+    memcpy(row, freq, 256*sizeof *row);
+    row[last][HUFF_EOF_MARK] = 1;
+
+    // 先以 order-0 表為基準，估計每個 context 獨立成表能省下多少位元（扣掉表本身的大小）
+    long long all[HUFF_MAX_SYMBOLS] = {0}, gain[256];
+    uint8_t base[HUFF_MAX_SYMBOLS], own[HUFF_MAX_SYMBOLS];
+    for (int p=0;p<256;p++) for (int s=0;s<HUFF_MAX_SYMBOLS;s++) all[s] += row[p][s];
+    int rc = ctx_lengths(all, base, a);
+    int order[256], nsel = 0;
+    for (int p=0;p<256 && rc==0;p++) {
+        gain[p] = 0;
+        int k = 0;
+        for (int s=0;s<HUFF_MAX_SYMBOLS;s++) k += row[p][s] > 0;
+        if (k == 0) continue;
+        if ((rc = ctx_lengths(row[p], own, a)) != 0) break;
+        gain[p] = ctx_cost(row[p], base) - ctx_cost(row[p], own) - 8LL*(HUFF_CTX_BITMAP_BYTES + (k+1)/2);
+        if (gain[p] > 0) order[nsel++] = p;
+    }
+    // 最多 255 個獨立類別：依省下的位元數穩定排序（相同時 p 小者在前）後截斷，再依 p 編號使結果可重現
+    for (int i=1;i<nsel;i++)
+        for (int j=i;j>0 && gain[order[j]] > gain[order[j-1]];j--) {
+            int t = order[j]; order[j] = order[j-1]; order[j-1] = t;
+        }
+    if (nsel > HUFF_CTX_MAX_CLASSES-1) nsel = HUFF_CTX_MAX_CLASSES-1;
+    unsigned char sel[256] = {0};
+    for (int i=0;i<nsel;i++) sel[order[i]] = 1;
+    long long merged[HUFF_MAX_SYMBOLS] = {0};
+    c->nclass = 1;
+    for (int p=0;p<256;p++) {
+        if (sel[p]) { c->map[p] = (uint8_t)c->nclass++; continue; }
+        c->map[p] = 0;
+        for (int s=0;s<HUFF_MAX_SYMBOLS;s++) merged[s] += row[p][s];
+    }
+
+    *bits = 0;
+    for (int k=0;k<c->nclass && rc==0;k++) {
+        const long long *f = merged;
+        if (k) for (int p=0;p<256;p++) if (c->map[p] == k) { f = row[p]; break; }
+        if ((rc = ctx_lengths(f, c->len[k], a)) != 0) break;
+        uint64_t val[HUFF_MAX_SYMBOLS];
+        if ((rc = huff_canonical_codes(c->len[k], HUFF_MAX_SYMBOLS, val)) != 0) break;
+        for (int s=0;s<HUFF_MAX_SYMBOLS;s++) { code[k][s].bits = val[s]; code[k][s].len = c->len[k][s]; }
+        *bits += ctx_cost(f, c->len[k]);
+    }
+    huff_free(a, row);
+    if (rc != 0) huff_ctx_free(c, a);
+    return rc;
+}
+
+/* ---------- 擴充字母表（byte 對） ---------- */
+typedef struct { uint64_t cnt; uint32_t key; } PairCount;
+
+static int cmp_pair(const void *A, const void *B){
+    const PairCount *x = (const PairCount*)A, *y = (const PairCount*)B;
+    if (x->cnt != y->cnt) return x->cnt > y->cnt ? -1 : 1;
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+int huff_digram_select(const unsigned char *src, size_t n, int max_pairs, HuffDigrams *dg, const HuffAllocator *a){
+    uint64_t *cnt = (uint64_t*)huff_alloc(a, sizeof(uint64_t)<<16);
+    PairCount *cand = (PairCount*)huff_alloc(a, sizeof(PairCount)<<16);
+    if (!cnt || !cand) { huff_free(a, cnt); huff_free(a, cand); return -1; }
+    memset(cnt, 0, sizeof(uint64_t)<<16);
+    for (size_t i=1;i<n;i++) cnt[src[i-1]<<8 | src[i]]++;
+    int nc = 0;
+    for (uint32_t k=0;k<(1u<<16);k++)
+        if (cnt[k] >= HUFF_DIGRAM_MIN_COUNT) { cand[nc].cnt = cnt[k]; cand[nc].key = k; nc++; }
+    qsort(cand, (size_t)nc, sizeof(PairCount), cmp_pair);
+    if (max_pairs > HUFF_DIGRAM_MAX) max_pairs = HUFF_DIGRAM_MAX;
+    dg->n = nc < max_pairs ? nc : max_pairs;
+    memset(dg->sym, 0, sizeof dg->sym);
+    for (int k=0;k<dg->n;k++) {
+        dg->pair[k][0] = (uint8_t)(cand[k].key >> 8);
+        dg->pair[k][1] = (uint8_t)cand[k].key;
+        dg->sym[cand[k].key] = (uint16_t)(HUFF_MAX_SYMBOLS+k);
+    }
+    huff_free(a, cnt); huff_free(a, cand);
+    return dg->n;
+}
+
+void huff_digram_count(const HuffDigrams *dg, const unsigned char *src, size_t n, long long *freq){
+    size_t i = 0;
+    while (i + 1 < n) {
+        int s = dg->sym[src[i]<<8 | src[i+1]];
+        if (s) { freq[s]++; i += 2; }
+        else   { freq[src[i]]++; i++; }
+    }
+    if (i < n) freq[src[i]]++;
+}
+
+int huff_digram_prune(HuffDigrams *dg, long long *freq, long long min){
+    int m = 0;
+    memset(dg->sym, 0, sizeof dg->sym);
+    for (int k=0;k<dg->n;k++) {
+        if (freq[HUFF_MAX_SYMBOLS+k] < min) continue;
+        dg->pair[m][0] = dg->pair[k][0]; dg->pair[m][1] = dg->pair[k][1];
+        freq[HUFF_MAX_SYMBOLS+m] = freq[HUFF_MAX_SYMBOLS+k];
+        dg->sym[dg->pair[m][0]<<8 | dg->pair[m][1]] = (uint16_t)(HUFF_MAX_SYMBOLS+m);
+        m++;
+    }
+    for (int k=m;k<dg->n;k++) freq[HUFF_MAX_SYMBOLS+k] = 0;
+    int removed = dg->n - m;
+    dg->n = m;
+    return removed;
+}
+
+/* ---------- 位元寫出 ---------- */
+#define BW_FILE_BUF (1<<20)
+
+void huff_bw_init(HuffBitWriter *bw, FILE *f){
+    bw->f=f; bw->acc=0; bw->nbits=0; bw->total_bits=0; bw->overflow=0;
+    bw->buf=(unsigned char*)malloc(BW_FILE_BUF); bw->pos=0; bw->cap=BW_FILE_BUF;
+}
+void huff_bw_init_mem(HuffBitWriter *bw, unsigned char *buf, size_t cap){
+    bw->f=NULL; bw->acc=0; bw->nbits=0; bw->total_bits=0; bw->overflow=0;
+    bw->buf=buf; bw->pos=0; bw->cap=cap;
+}
+static void bw_drain(HuffBitWriter *bw){
+    if(bw->f && bw->pos){ fwrite(bw->buf, 1, bw->pos, bw->f); bw->pos=0; }
+}
+static void bw_emit_word(HuffBitWriter *bw, uint64_t w){
+    if(bw->pos + 8 > bw->cap){
+        bw_drain(bw);
+        if(bw->pos + 8 > bw->cap){ bw->overflow=1; return; }
+    }
+    unsigned char *p = bw->buf + bw->pos;
+    for(int i=0;i<8;i++) p[i] = (unsigned char)(w >> (56-8*i));
+    bw->pos += 8;
+}
+/* 寫入 v 的低 len 位元（1..64） */
+static inline void bw_put_bits(HuffBitWriter *bw, uint64_t v, int len){
+    int room = 64 - bw->nbits;
+    bw->total_bits += len;
+    if(len < room){
+        bw->acc |= v << (room - len);
+        bw->nbits += len;
+        return;
+    }
+    bw->acc |= v >> (len - room);
+    bw_emit_word(bw, bw->acc);
+    bw->nbits = len - room;
+    bw->acc = bw->nbits ? v << (64 - bw->nbits) : 0;
+}
+void huff_bw_put(HuffBitWriter *bw, HuffCode c){ bw_put_bits(bw, c.bits, c.len); }
+void huff_bw_encode(HuffBitWriter *bw, const HuffCode *code, const unsigned char *src, size_t n){
+    for(size_t i=0;i<n;i++) bw_put_bits(bw, code[src[i]].bits, code[src[i]].len);
+}
+void huff_bw_encode_digram(HuffBitWriter *bw, const HuffCode *code, const HuffDigrams *dg,
+                           const unsigned char *src, size_t n){
+    size_t i = 0;
+    while(i + 1 < n){
+        int s = dg->sym[src[i]<<8 | src[i+1]];
+        if(s){ bw_put_bits(bw, code[s].bits, code[s].len); i += 2; }
+        else { bw_put_bits(bw, code[src[i]].bits, code[src[i]].len); i++; }
+    }
+    if(i < n) bw_put_bits(bw, code[src[i]].bits, code[src[i]].len);
+}
+void huff_bw_flush(HuffBitWriter *bw){
+    int nbytes = (bw->nbits + 7) / 8;
+    bw->total_bits += nbytes*8 - bw->nbits;
+    if(bw->pos + 8 > bw->cap) bw_drain(bw);
+    if(bw->pos + nbytes > bw->cap){ bw->overflow=1; nbytes=0; }
+    for(int i=0;i<nbytes;i++) bw->buf[bw->pos++] = (unsigned char)(bw->acc >> (56-8*i));
+    bw->acc=0; bw->nbits=0;
+    bw_drain(bw);
+}
+void huff_bw_free(HuffBitWriter *bw){ if(bw->f) free(bw->buf); bw->buf=NULL; }
+
+/* ---------- 位元讀取 ---------- */
+#define BR_FILE_BUF (1<<16)
+
+void huff_br_init(HuffBitReader *br, FILE *f){
+    br->f=f; br->chunk=(unsigned char*)malloc(BR_FILE_BUF); br->buf=br->chunk;
+    br->pos=br->len=0; br->bits=0; br->nbits=0; br->avail=0; br->eof=0; br->misses=0;
+}
+void huff_br_init_mem(HuffBitReader *br, const unsigned char *data, size_t n){
+    br->f=NULL; br->chunk=NULL; br->buf=data;
+    br->pos=0; br->len=n; br->bits=0; br->nbits=0; br->avail=0; br->eof=0; br->misses=0;
+}
+void huff_br_free(HuffBitReader *br){ free(br->chunk); br->chunk=NULL; }
+
+static inline void br_refill(HuffBitReader *br){
+    while (br->nbits <= 56) {
+        if (br->pos == br->len) {
+            if (!br->eof && br->f) {
+                br->len = fread(br->chunk, 1, BR_FILE_BUF, br->f);
+                br->pos = 0;
+            }
+            if (br->pos == br->len) br->eof = 1;
+            if (br->eof) { br->nbits = 64; return; }
+        }
+        br->bits |= (uint64_t)br->buf[br->pos++] << (56 - br->nbits);
+        br->nbits += 8;
+        br->avail += 8;
+    }
+}
+void huff_br_refill(HuffBitReader *br){ br_refill(br); }
+void huff_br_skip(HuffBitReader *br, int n){
+    br_refill(br);
+    br->bits <<= n; br->nbits -= n; br->avail -= n;
+}
+
+/* ---------- 查表解碼 ---------- */
+/* 同 huff_dt_lookup，另計第二層查表次數（只在未命中的分支上多一次加法） */
+static inline const HuffDEntry* br_lookup(HuffBitReader *br, const HuffDTable *t){
+    const HuffDEntry *e = &t->e[br->bits >> (64-HUFF_DT_ROOT_BITS)];
+    if (e->sub_bits) {
+        e = &t->e[e->sub_off + (uint32_t)((br->bits << HUFF_DT_ROOT_BITS) >> (64 - e->sub_bits))];
+        br->misses++;
+    }
+    return e;
+}
+
+int huff_dtable_build(HuffDTable *t, const uint8_t *len, const uint64_t *val, int nsym, const HuffAllocator *a){
+    const int R = HUFF_DT_ROOT_BITS;
+    int sub_bits[1<<HUFF_DT_ROOT_BITS] = {0};
+    uint32_t off[1<<HUFF_DT_ROOT_BITS];
+
+    t->max_len = 0;
+    for (int s=0;s<nsym;s++) {
+        int L = len[s];
+        if (!L) continue;
+        if (L > HUFF_DT_MAX_CODE_LEN) return -1;
+        if (L > t->max_len) t->max_len = L;
+        if (L > R) {
+            uint32_t pre = (uint32_t)(val[s] >> (L-R));
+            if (L-R > sub_bits[pre]) sub_bits[pre] = L-R;
+        }
+    }
+
+    int size = 1<<R;
+    for (int p=0;p<(1<<R);p++) {
+        off[p] = (uint32_t)size;
+        if (sub_bits[p]) size += 1<<sub_bits[p];
+    }
+    if (size > t->cap) {
+        huff_free(a, t->e);
+        t->e = (HuffDEntry*)huff_alloc(a, sizeof(HuffDEntry)*(size_t)size);
+        t->cap = t->e ? size : 0;
+        if (!t->e) { t->size = 0; return -1; }
+    }
+    memset(t->e, 0, sizeof(HuffDEntry)*(size_t)size);
+    t->size = size;
+
+    for (int p=0;p<(1<<R);p++) {
+        if (sub_bits[p]) { t->e[p].sub_bits=(uint8_t)sub_bits[p]; t->e[p].sub_off=off[p]; }
+    }
+    for (int s=0;s<nsym;s++) {
+        int L = len[s];
+        if (!L) continue;
+        uint32_t v = (uint32_t)val[s];
+        HuffDEntry leaf = { (uint16_t)s, (uint8_t)L, 0, 0 };
+        if (L <= R) {
+            uint32_t first = v << (R-L), span = 1u << (R-L);
+            for (uint32_t j=0;j<span;j++) t->e[first+j] = leaf;
+        } else {
+            uint32_t pre = v >> (L-R);
+            int sb = sub_bits[pre];
+            uint32_t rest = v & ((1u<<(L-R))-1);
+            uint32_t first = off[pre] + (rest << (sb-(L-R))), span = 1u << (sb-(L-R));
+            for (uint32_t j=0;j<span;j++) t->e[first+j] = leaf;
+        }
+    }
+    return 0;
+}
+
+void huff_dtable_free(HuffDTable *t, const HuffAllocator *a){
+    huff_free(a, t->e); t->e=NULL; t->size=t->cap=0;
+}
+
+long long huff_br_decode(HuffBitReader *br, const HuffDTable *t, unsigned char *dst, size_t n, long long *bitpos){
+    for (size_t i=0;i<n;i++) {
+        br_refill(br);
+        const HuffDEntry *e = br_lookup(br, t);
+        int L = e->len;
+        if (L == 0 || L > br->avail || e->symbol == HUFF_EOF_MARK) return *bitpos + 1;
+        br->bits <<= L; br->nbits -= L; br->avail -= L;
+        *bitpos += L;
+        if (dst) dst[i] = (unsigned char)e->symbol;
+    }
+    return 0;
+}
+
+int huff_br_decode_eof(HuffBitReader *br, const HuffDTable *t, unsigned char *dst, size_t cap,
+                       size_t *outn, long long *bitpos){
+    size_t i = 0;
+    int rc;
+    for (;;) {
+        br_refill(br);
+        const HuffDEntry *e = br_lookup(br, t);
+        int L = e->len;
+        if (L == 0 || L > br->avail) {
+            // 真實位元不足以湊成一個 code：與逐位元解碼相同，視為缺少 EOF_MARK
+            if (br->eof && br->avail < t->max_len) { *bitpos += br->avail; rc = 1; }
+            else rc = HUFF_E_CORRUPT;
+            break;
+        }
+        if (e->symbol != HUFF_EOF_MARK && i == cap) { rc = HUFF_E_DST_SMALL; break; }
+        br->bits <<= L; br->nbits -= L; br->avail -= L;
+        *bitpos += L;
+        if (e->symbol == HUFF_EOF_MARK) { rc = 0; break; }
+        dst[i++] = (unsigned char)e->symbol;
+    }
+    *outn = i;
+    return rc;
+}
+
+int huff_br_decode_ctx_eof(HuffBitReader *br, const HuffDTable *tabs, const uint8_t *map, int *prev,
+                           unsigned char *dst, size_t cap, size_t *outn, long long *bitpos){
+    size_t i = 0;
+    int rc, p = *prev;
+    for (;;) {
+        const HuffDTable *t = &tabs[map[p]];
+        br_refill(br);
+        const HuffDEntry *e = br_lookup(br, t);
+        int L = e->len;
+        if (L == 0 || L > br->avail) {
+            if (br->eof && br->avail < t->max_len) { *bitpos += br->avail; rc = 1; }
+            else rc = HUFF_E_CORRUPT;
+            break;
+        }
+        if (e->symbol != HUFF_EOF_MARK && i == cap) { rc = HUFF_E_DST_SMALL; break; }
+        br->bits <<= L; br->nbits -= L; br->avail -= L;
+        *bitpos += L;
+        if (e->symbol == HUFF_EOF_MARK) { rc = 0; break; }
+        dst[i++] = (unsigned char)(p = e->symbol);
+    }
+    *prev = p;
+    *outn = i;
+    return rc;
+}
+
+int huff_br_decode_digram_eof(HuffBitReader *br, const HuffDTable *t, const HuffDigrams *dg,
+                              unsigned char *dst, size_t cap, size_t *outn, long long *bitpos){
+    size_t i = 0;
+    int rc;
+    for (;;) {
+        br_refill(br);
+        const HuffDEntry *e = br_lookup(br, t);
+        int L = e->len, s = e->symbol;
+        if (L == 0 || L > br->avail) {
+            if (br->eof && br->avail < t->max_len) { *bitpos += br->avail; rc = 1; }
+            else rc = HUFF_E_CORRUPT;
+            break;
+        }
+        // 一次查表寫出 1 或 2 個 byte；EOF_MARK 不佔 dst
+        size_t need = s < HUFF_ALPHABET ? 1 : s == HUFF_EOF_MARK ? 0 : 2;
+        if (i + need > cap) { rc = HUFF_E_DST_SMALL; break; }
+        br->bits <<= L; br->nbits -= L; br->avail -= L;
+        *bitpos += L;
+        if (s < HUFF_ALPHABET) dst[i++] = (unsigned char)s;
+        else if (s == HUFF_EOF_MARK) { rc = 0; break; }
+        else { memcpy(dst + i, dg->pair[s - HUFF_MAX_SYMBOLS], 2); i += 2; }
+    }
+    *outn = i;
+    return rc;
+}
+
+/* ---------- 4 路交錯位元串 ---------- */
+size_t huff_x4_bound(size_t n, int max_len){
+    size_t q = (n + HUFF_X4_STREAMS - 1) / HUFF_X4_STREAMS;
+    // 每段另留 8 bytes 給 64-bit 寫出的餘裕
+    return HUFF_X4_JUMP_BYTES + HUFF_X4_STREAMS * (q*(size_t)max_len/8 + 16);
+}
+
+long long huff_x4_encode(const HuffCode *code, const unsigned char *src, size_t n,
+                         unsigned char *dst, size_t cap, long long *bits){
+    if (cap < HUFF_X4_JUMP_BYTES) return -1;
+    size_t pos = HUFF_X4_JUMP_BYTES;
+    *bits = 0;
+    for (int k=0;k<HUFF_X4_STREAMS;k++) {
+        HuffBitWriter bw; huff_bw_init_mem(&bw, dst + pos, cap - pos);
+        huff_bw_encode(&bw, code, src + huff_x4_start(n, k), huff_x4_count(n, k));
+        huff_bw_flush(&bw);
+        if (bw.overflow || bw.pos > UINT32_MAX) return -1;
+        if (k < HUFF_X4_STREAMS-1)
+            for (int i=0;i<4;i++) dst[4*k+i] = (unsigned char)(bw.pos >> (8*i));
+        pos += bw.pos;
+        *bits += bw.total_bits;
+    }
+    return (long long)pos;
+}
+
+int huff_x4_offsets(const unsigned char *src, size_t srclen, size_t off[HUFF_X4_STREAMS+1]){
+    if (srclen < HUFF_X4_JUMP_BYTES) return -1;
+    off[0] = HUFF_X4_JUMP_BYTES;
+    for (int k=0;k<HUFF_X4_STREAMS-1;k++) {
+        const unsigned char *p = src + 4*k;
+        size_t len = (size_t)p[0] | (size_t)p[1]<<8 | (size_t)p[2]<<16 | (size_t)p[3]<<24;
+        if (len > srclen - off[k]) return -1;
+        off[k+1] = off[k] + len;
+    }
+    off[HUFF_X4_STREAMS] = srclen;
+    return 0;
+}
+
+/* 解一個符號；失敗回傳 0 */
+static inline int x4_step(HuffBitReader *br, const HuffDTable *t, unsigned char *dst, long long *bitpos){
+    br_refill(br);
+    const HuffDEntry *e = br_lookup(br, t);
+    int L = e->len;
+    if (L == 0 || L > br->avail || e->symbol == HUFF_EOF_MARK) return 0;
+    br->bits <<= L; br->nbits -= L; br->avail -= L;
+    *bitpos += L;
+    *dst = (unsigned char)e->symbol;
+    return 1;
+}
+
+long long huff_x4_decode(const unsigned char *src, size_t srclen, const HuffDTable *t,
+                         unsigned char *dst, size_t n, long long *misses){
+    size_t off[HUFF_X4_STREAMS+1];
+    if (huff_x4_offsets(src, srclen, off) != 0) return 1;
+    HuffBitReader br[HUFF_X4_STREAMS];
+    long long bitpos[HUFF_X4_STREAMS] = {0};
+    unsigned char *out[HUFF_X4_STREAMS];
+    for (int k=0;k<HUFF_X4_STREAMS;k++) {
+        huff_br_init_mem(&br[k], src + off[k], off[k+1] - off[k]);
+        out[k] = dst + huff_x4_start(n, k);
+    }
+    // 各段長度遞減、最後一段最短：共同長度內 4 段一起前進，剩下的由前幾段各自收尾
+    size_t common = huff_x4_count(n, HUFF_X4_STREAMS-1);
+    long long bad = 0;
+    int k = 0;
+    for (size_t i=0;i<common;i++) {
+        if (!x4_step(&br[0], t, out[0]+i, &bitpos[0])) { k = 0; bad = 1; break; }
+        if (!x4_step(&br[1], t, out[1]+i, &bitpos[1])) { k = 1; bad = 1; break; }
+        if (!x4_step(&br[2], t, out[2]+i, &bitpos[2])) { k = 2; bad = 1; break; }
+        if (!x4_step(&br[3], t, out[3]+i, &bitpos[3])) { k = 3; bad = 1; break; }
+    }
+    for (int j=0;j<HUFF_X4_STREAMS-1 && !bad;j++) {
+        size_t m = huff_x4_count(n, j);
+        if (m > common && huff_br_decode(&br[j], t, out[j]+common, m-common, &bitpos[j]) != 0) { k = j; bad = 1; }
+    }
+    for (int j=0;j<HUFF_X4_STREAMS;j++) *misses += br[j].misses;
+    return bad ? (long long)off[k]*8 + bitpos[k] + 1 : 0;
+}
+
+/* ---------- 記憶體對記憶體 API ---------- */
+static const HuffAllocator default_alloc = { NULL, NULL, NULL };
+
+struct HuffEncoder {
+    HuffAllocator a;
+    int max_len;
+    long long freq[HUFF_MAX_SYMBOLS];
+    HuffCode code[HUFF_MAX_SYMBOLS];
+    HuffHeader hdr;
+};
+
+struct HuffDecoder {
+    HuffAllocator a;
+    HuffHeader hdr;         // 目前解碼表對應的檔頭；長度表相同時沿用
+    int have_table;
+    HuffDTable t;
+};
+
+const char *huff_strerror(int rc){
+    switch (rc) {
+        case HUFF_OK:          return "ok";
+        case HUFF_E_PARAM:     return "invalid_parameter";
+        case HUFF_E_NOMEM:     return "out_of_memory";
+        case HUFF_E_DST_SMALL: return "destination_too_small";
+        case HUFF_E_FORMAT:    return "unsupported_format";
+        case HUFF_E_CORRUPT:   return "corrupt_input";
+        default:               return "unknown";
+    }
+}
+
+HuffEncoder *huff_encoder_new(const HuffAllocator *a){
+    if (!a) a = &default_alloc;
+    HuffEncoder *e = (HuffEncoder*)huff_alloc(a, sizeof(HuffEncoder));
+    if (!e) return NULL;
+    e->a = *a;
+    e->max_len = HUFF_DT_MAX_CODE_LEN;
+    return e;
+}
+
+void huff_encoder_free(HuffEncoder *e){
+    if (!e) return;
+    HuffAllocator a = e->a;
+    huff_free(&a, e);
+}
+
+int huff_encoder_set_max_code_len(HuffEncoder *e, int max_len){
+    if (max_len < 1 || max_len > HUFF_DT_MAX_CODE_LEN) return HUFF_E_PARAM;
+    e->max_len = max_len;
+    return HUFF_OK;
+}
+
+/* 最佳前綴碼的平均長度不超過 9 位元的定長碼（257 個符號），長度限制下亦然 */
+size_t huff_encode_bound(size_t n){
+    return HUFF_HEADER_MAX_BYTES + (size_t)((9*((uint64_t)n+1) + 7) / 8);
+}
+
+long long huff_encode(HuffEncoder *e, const void *src, size_t n, void *dst, size_t cap){
+    if (!e || (!src && n) || !dst) return HUFF_E_PARAM;
+    const unsigned char *in = (const unsigned char*)src;
+    memset(e->freq, 0, sizeof e->freq);
+    huff_histogram(in, n, e->freq);
+    e->freq[HUFF_EOF_MARK] = 1;
+
+    e->hdr.version = HUFF_VERSION;
+    e->hdr.flags = 0;
+    e->hdr.nsym = HUFF_MAX_SYMBOLS;
+    if (huff_build_codes(e->freq, HUFF_MAX_SYMBOLS, e->code, NULL) != 0
+        || huff_canonicalize(e->code, HUFF_MAX_SYMBOLS, e->hdr.len) != 0)
+        return HUFF_E_PARAM;
+    /* 長度上限容不下所有出現過的符號：參數錯誤而非記憶體不足 */
+    int used = 0;
+    for (int s=0;s<HUFF_MAX_SYMBOLS;s++) used += e->freq[s] != 0;
+    if (used > (1 << e->max_len)) return HUFF_E_PARAM;
+    if (huff_limit_codes(e->freq, HUFF_MAX_SYMBOLS, e->max_len, e->code, e->hdr.len, &e->a) != 0)
+        return HUFF_E_NOMEM;
+
+    uint64_t bits = 0;
+    for (int s=0;s<HUFF_MAX_SYMBOLS;s++) bits += (uint64_t)e->freq[s]*(uint64_t)e->code[s].len;
+    unsigned char *out = (unsigned char*)dst;
+    unsigned char hd[HUFF_HEADER_MAX_BYTES];
+    long hb = huff_header_encode(&e->hdr, hd);
+    size_t total = (size_t)hb + (size_t)((bits + 7) / 8);
+    if (total > cap) return HUFF_E_DST_SMALL;
+
+    memcpy(out, hd, (size_t)hb);
+    HuffBitWriter bw;
+    huff_bw_init_mem(&bw, out + hb, total - (size_t)hb);
+    huff_bw_encode(&bw, e->code, in, n);
+    huff_bw_put(&bw, e->code[HUFF_EOF_MARK]);
+    huff_bw_flush(&bw);
+    return (long long)total;
+}
+
+HuffDecoder *huff_decoder_new(const HuffAllocator *a){
+    if (!a) a = &default_alloc;
+    HuffDecoder *d = (HuffDecoder*)huff_alloc(a, sizeof(HuffDecoder));
+    if (!d) return NULL;
+    memset(d, 0, sizeof *d);
+    d->a = *a;
+    return d;
+}
+
+void huff_decoder_free(HuffDecoder *d){
+    if (!d) return;
+    HuffAllocator a = d->a;
+    huff_dtable_free(&d->t, &a);
+    huff_free(&a, d);
+}
+
+long long huff_decode(HuffDecoder *d, const void *src, size_t n, void *dst, size_t cap){
+    if (!d || !src || (!dst && cap)) return HUFF_E_PARAM;
+    const unsigned char *in = (const unsigned char*)src;
+    HuffHeader h;
+    long hb = huff_header_decode(in, n, &h);
+    if (hb == 0) return HUFF_E_FORMAT;
+    if (hb < 0) return HUFF_E_CORRUPT;
+    if (h.flags & (HUFF_FLAG_BLOCKS|HUFF_FLAG_STREAM|HUFF_FLAG_X4|HUFF_FLAG_CTX1|HUFF_FLAG_TANS|HUFF_FLAG_DIGRAM|HUFF_FLAG_CRC))
+        return HUFF_E_FORMAT;
+
+    // 長度表與上次相同就沿用解碼表
+    if (!d->have_table || d->hdr.nsym != h.nsym || memcmp(d->hdr.len, h.len, (size_t)h.nsym) != 0) {
+        uint64_t val[HUFF_MAX_SYMBOLS];
+        d->have_table = 0;
+        if (huff_canonical_codes(h.len, h.nsym, val) != 0) return HUFF_E_CORRUPT;
+        for (int s=0;s<h.nsym;s++) if (h.len[s] > HUFF_DT_MAX_CODE_LEN) return HUFF_E_FORMAT;
+        if (huff_dtable_build(&d->t, h.len, val, h.nsym, &d->a) != 0) return HUFF_E_NOMEM;
+        d->hdr = h;
+        d->have_table = 1;
+    }
+
+    HuffBitReader br;
+    huff_br_init_mem(&br, in + hb, n - (size_t)hb);
+    size_t outn = 0;
+    long long bitpos = 0;
+    int rc = huff_br_decode_eof(&br, &d->t, (unsigned char*)dst, cap, &outn, &bitpos);
+    if (rc == 0) return (long long)outn;
+    return rc == HUFF_E_DST_SMALL ? HUFF_E_DST_SMALL : HUFF_E_CORRUPT;
+}
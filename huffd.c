@@ -0,0 +1,482 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include "logger.h"
+#include "huff.h"
+#include "huffd.h"
+#include "metrics.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#define HAVE_UNIX_SOCKET 1
+#endif
+
+/* 常駐壓縮服務：主執行緒以 poll 同時監看所有連線，以非阻塞讀取湊齊一個完整請求後才放進佇列，
+ * 固定數量的工作執行緒逐個取出請求處理並寫回回應，再把連線交還主執行緒。閒置的連線不佔工作執行緒，
+ * 超過 --idle-timeout 沒有讀寫進度的連線會被關閉。每條工作執行緒保留自己的 HuffEncoder / HuffDecoder
+ * 與輸出緩衝，碼表、解碼表與緩衝都跨請求沿用。SIGINT / SIGTERM 時停止接受連線與讀取新請求，
+ * 等已讀入的請求回應寫完後輸出彙總並結束。 */
+
+#define MAX_CONNS  1024        // 同時保持的連線數上限
+#define LAT_WINDOW 65536       // 延遲百分位數取最近這麼多個請求
+#define IN_KEEP    ((size_t)1 << 20)   // 連線的輸入緩衝超過此大小時，請求處理完即釋放
+#define STICKY_MS  1           // 工作執行緒回應後在同一連線上等下一個請求的最長時間
+
+static double now_sec(void){
+    struct timespec ts;
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+/* "1048576"、"1024K"、"64M" → 位元組數；格式錯誤回傳 0 */
+static size_t parse_size(const char *s){
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if(*end=='K' || *end=='k'){ v <<= 10; end++; }
+    else if(*end=='M' || *end=='m'){ v <<= 20; end++; }
+    if(*end!='\0') return 0;
+    return (size_t)v;
+}
+
+#ifdef HAVE_UNIX_SOCKET
+typedef struct {
+    HuffEncoder *enc;
+    HuffDecoder *dec;
+    unsigned char *out;
+    size_t out_cap;
+    pthread_t th;
+} Worker;
+
+/* 一條連線：主執行緒讀滿一個請求後交給工作執行緒（busy），回應寫完再交回主執行緒 */
+typedef struct {
+    int fd;
+    unsigned char hd[HUFFD_FRAME_BYTES];
+    size_t got;                // 目前請求已讀入的位元組數（標頭 + payload）
+    size_t n;                  // payload 長度，標頭讀滿後才有效
+    int status;                // 不需處理即可回應的 status（HUFFD_E_TOO_BIG），否則 -1
+    unsigned char *in;
+    size_t in_cap;
+    double t0, last;           // 請求讀滿的時間；最近一次讀寫進度
+    bool busy, keep, dead;     // 工作執行緒處理中；回應後保留連線；主執行緒待關閉
+} Conn;
+
+typedef struct {
+    long long requests, encodes, decodes, stats, errors, connections, timeouts, bytes_in, bytes_out;
+    double encode_sec, decode_sec;
+    double lat[LAT_WINDOW];    // 最近請求的延遲（秒），環狀保存
+    long long nlat;
+} Stats;
+
+static volatile sig_atomic_t stop_flag = 0;
+static pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER;       // jobs、done 與 closing
+static pthread_cond_t  cv = PTHREAD_COND_INITIALIZER;
+static Conn *jobs[MAX_CONNS];  // 已讀滿、等待工作執行緒的請求（每條連線同時最多一個）
+static int jhead = 0, jlen = 0;
+static Conn *done[MAX_CONNS];  // 回應已寫完、待主執行緒收回的連線
+static int ndone = 0;
+static bool closing = false;
+static int wake_fd[2] = { -1, -1 };                          // 工作執行緒寫一個 byte 叫醒 poll
+static pthread_mutex_t st_mu = PTHREAD_MUTEX_INITIALIZER;
+static Stats st;
+static size_t max_request = HUFFD_DEFAULT_MAX_REQUEST;
+static int nworkers = 0;
+static int idle_timeout = 60;  // 秒
+
+static void on_signal(int sig){ (void)sig; stop_flag = 1; }
+
+static int set_nonblock(int fd){
+    int fl = fcntl(fd, F_GETFL, 0);
+    return fl < 0 ? -1 : fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+}
+
+/* fd 為非阻塞：寫不進去時等對方讀取，超過 idle_timeout 秒沒有進度就放棄 */
+static int write_full(int fd, const unsigned char *p, size_t n){
+    while(n){
+        ssize_t r = write(fd, p, n);
+        if(r < 0 && errno == EINTR) continue;
+        if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            struct pollfd pf = { fd, POLLOUT, 0 };
+            int k = poll(&pf, 1, idle_timeout*1000);
+            if(k < 0 && errno == EINTR) continue;
+            if(k <= 0) return -1;
+            continue;
+        }
+        if(r <= 0) return -1;
+        p += r; n -= (size_t)r;
+    }
+    return 0;
+}
+
+static int ensure(unsigned char **buf, size_t *cap, size_t need){
+    if(need <= *cap) return 0;
+    unsigned char *p = (unsigned char*)realloc(*buf, need);
+    if(!p) return -1;
+    *buf = p; *cap = need;
+    return 0;
+}
+
+static int cmp_double(const void *A, const void *B){
+    double a = *(const double*)A, b = *(const double*)B;
+    return (a > b) - (a < b);
+}
+
+/* 把目前的計數器與延遲百分位數格式化成一行 key=value */
+static int stats_text(char *dst, size_t cap){
+    pthread_mutex_lock(&st_mu);
+    Stats s = st;              // 複製後再排序，不佔住鎖
+    pthread_mutex_unlock(&st_mu);
+    size_t n = (size_t)(s.nlat < LAT_WINDOW ? s.nlat : LAT_WINDOW);
+    qsort(s.lat, n, sizeof(double), cmp_double);
+    #define LAT_US(q) (n ? 1e6*s.lat[(size_t)((q)*(double)(n-1) + 0.5)] : 0.0)
+    int w = snprintf(dst, cap, "workers=%d requests=%lld encode_requests=%lld decode_requests=%lld stats_requests=%lld "
+                               "errors=%lld connections=%lld idle_timeouts=%lld bytes_in=%lld bytes_out=%lld encode_ms=%.3f decode_ms=%.3f "
+                               "latency_us_p50=%.1f latency_us_p90=%.1f latency_us_p99=%.1f latency_us_max=%.1f",
+                     nworkers, s.requests, s.encodes, s.decodes, s.stats, s.errors, s.connections, s.timeouts, s.bytes_in, s.bytes_out,
+                     s.encode_sec*1e3, s.decode_sec*1e3, LAT_US(0.50), LAT_US(0.90), LAT_US(0.99), LAT_US(1.0));
+    #undef LAT_US
+    return w < 0 ? 0 : (size_t)w >= cap ? (int)cap-1 : w;
+}
+
+/* 處理 in[0..n) 的請求，結果放在 w->out[0..*olen)。回傳 status（HUFFD_OK / -HUFF_E_* / HUFFD_E_*） */
+static int handle(Worker *w, int op, const unsigned char *in, size_t n, size_t *olen){
+    *olen = 0;
+    if(op == HUFFD_OP_ENCODE){
+        size_t cap = huff_encode_bound(n);
+        if(ensure(&w->out, &w->out_cap, cap) != 0) return -HUFF_E_NOMEM;
+        long long r = huff_encode(w->enc, in, n, w->out, w->out_cap);
+        if(r < 0) return (int)-r;
+        *olen = (size_t)r;
+        return HUFFD_OK;
+    }
+    if(op == HUFFD_OP_DECODE){
+        // 每個符號至少 1 位元，原始資料不超過 8 倍；先試 4 倍，不夠再放大
+        size_t limit = n*8 + 64;
+        if(limit > UINT32_MAX) limit = UINT32_MAX;
+        size_t cap = w->out_cap > n*4 + 64 ? w->out_cap : n*4 + 64;
+        if(cap > limit) cap = limit;
+        for(;;){
+            if(ensure(&w->out, &w->out_cap, cap) != 0) return -HUFF_E_NOMEM;
+            long long r = huff_decode(w->dec, in, n, w->out, w->out_cap);
+            if(r == HUFF_E_DST_SMALL && w->out_cap < limit){ cap = w->out_cap*2 < limit ? w->out_cap*2 : limit; continue; }
+            if(r < 0) return (int)-r;
+            *olen = (size_t)r;
+            return HUFFD_OK;
+        }
+    }
+    if(op == HUFFD_OP_STATS){
+        if(ensure(&w->out, &w->out_cap, 1024) != 0) return -HUFF_E_NOMEM;
+        *olen = (size_t)stats_text((char*)w->out, w->out_cap);
+        return HUFFD_OK;
+    }
+    return HUFFD_E_OP;
+}
+
+/* 工作執行緒：處理 c 上已讀滿的請求並寫回回應，然後重置連線以讀下一個請求 */
+static void serve_request(Worker *w, Conn *c){
+    int op = c->hd[0];
+    size_t olen = 0;
+    int status = c->status >= 0 ? c->status : handle(w, op, c->in, c->n, &olen);
+    unsigned char hd[HUFFD_FRAME_BYTES];
+    huffd_frame_encode(hd, status, (uint32_t)olen);
+    c->keep = status != HUFFD_E_TOO_BIG;   // payload 沒讀，連線無法再對齊
+    if(write_full(c->fd, hd, sizeof hd) != 0 || (olen && write_full(c->fd, w->out, olen) != 0)) c->keep = false;
+    double dt = now_sec() - c->t0;
+
+    pthread_mutex_lock(&st_mu);
+    st.requests++;
+    if(status != HUFFD_OK) st.errors++;
+    if(op == HUFFD_OP_ENCODE){ st.encodes++; st.encode_sec += dt; }
+    else if(op == HUFFD_OP_DECODE){ st.decodes++; st.decode_sec += dt; }
+    else if(op == HUFFD_OP_STATS) st.stats++;
+    if(op != HUFFD_OP_STATS){
+        st.bytes_in += (long long)c->n; st.bytes_out += (long long)olen;
+        st.lat[st.nlat++ % LAT_WINDOW] = dt;
+    }
+    pthread_mutex_unlock(&st_mu);
+
+    c->got = 0; c->status = -1;
+    if(c->in_cap > IN_KEEP){ free(c->in); c->in = NULL; c->in_cap = 0; }
+}
+
+/* 非阻塞讀入 c 上目前請求的後續資料。回傳 1 請求已讀滿，0 尚未讀滿，-1 連線應關閉 */
+static int conn_fill(Conn *c, double now){
+    for(;;){
+        unsigned char *dst;
+        size_t want;
+        if(c->got < HUFFD_FRAME_BYTES){ dst = c->hd + c->got; want = HUFFD_FRAME_BYTES - c->got; }
+        else{ dst = c->in + (c->got - HUFFD_FRAME_BYTES); want = HUFFD_FRAME_BYTES + c->n - c->got; }
+        ssize_t r = read(c->fd, dst, want);
+        if(r < 0 && errno == EINTR) continue;
+        if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if(r <= 0) return -1;
+        c->got += (size_t)r;
+        c->last = now;
+        if(c->got == HUFFD_FRAME_BYTES){
+            c->n = huffd_frame_len(c->hd);
+            if(c->n > max_request || ensure(&c->in, &c->in_cap, c->n ? c->n : 1) != 0){
+                c->status = HUFFD_E_TOO_BIG;
+                return 1;
+            }
+        }
+        if(c->got == HUFFD_FRAME_BYTES + c->n) return 1;
+    }
+}
+
+/* 主執行緒：讀入 c 上的資料，請求讀滿就交給工作執行緒。回傳 -1 表示連線應關閉 */
+static int conn_read(Conn *c, double now){
+    int r = conn_fill(c, now);
+    if(r <= 0) return r;
+    c->t0 = now;
+    c->busy = true;
+    pthread_mutex_lock(&mu);
+    jobs[(jhead + jlen) % MAX_CONNS] = c; jlen++;
+    pthread_cond_signal(&cv);
+    pthread_mutex_unlock(&mu);
+    return 0;
+}
+
+static bool sticky_wait(Conn *c){
+    pthread_mutex_lock(&mu);
+    bool queued = jlen > 0 || closing;
+    pthread_mutex_unlock(&mu);
+    if(queued) return false;
+    struct pollfd pf = { c->fd, POLLIN, 0 };
+    return poll(&pf, 1, STICKY_MS) > 0;
+}
+
+static void *worker_main(void *arg){
+    Worker *w = (Worker*)arg;
+    for(;;){
+        pthread_mutex_lock(&mu);
+        while(!jlen && !closing) pthread_cond_wait(&cv, &mu);
+        if(!jlen){ pthread_mutex_unlock(&mu); break; }   // closing 且已讀入的請求都處理完
+        Conn *c = jobs[jhead];
+        jhead = (jhead + 1) % MAX_CONNS; jlen--;
+        pthread_mutex_unlock(&mu);
+
+        serve_request(w, c);
+        // 一問一答的 client 緊接著送來的下一個請求直接在這裡處理，省去交還主執行緒再派工的兩次喚醒；
+        // 只在沒有其他請求排隊時等待，且最多 STICKY_MS，其他連線的請求最多因此多等這麼久
+        while(c->keep && sticky_wait(c)){
+            int r = conn_fill(c, now_sec());
+            if(r < 0){ c->keep = false; break; }
+            if(r == 0) continue;   // 標頭與 payload 常分兩次到達；等不到後續時交還主執行緒繼續讀
+            c->t0 = now_sec();
+            serve_request(w, c);
+        }
+
+        pthread_mutex_lock(&mu);
+        done[ndone++] = c;
+        pthread_mutex_unlock(&mu);
+        unsigned char b = 0;
+        if(write(wake_fd[1], &b, 1) < 0){ /* pipe 已滿：主執行緒本來就會醒來 */ }
+    }
+    return NULL;
+}
+
+static void conn_close(Conn *c){
+    close(c->fd);
+    free(c->in);
+    free(c);
+}
+
+static int run(const char *sock_path, const char *metrics_fn){
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if(strlen(sock_path) >= sizeof addr.sun_path){ log_error("huffd","socket path too long path=%s", sock_path); return 1; }
+    strcpy(addr.sun_path, sock_path);
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(lfd < 0){ log_error("huffd","socket failed errno=%d", errno); return 2; }
+    unlink(sock_path);         // 上次未正常結束留下的 socket 檔
+    if(bind(lfd, (struct sockaddr*)&addr, sizeof addr) != 0 || listen(lfd, 128) != 0){
+        log_error("huffd","bind failed path=%s errno=%d", sock_path, errno);
+        close(lfd); return 2;
+    }
+
+    // SIGINT / SIGTERM 只交給主執行緒（不設 SA_RESTART，讓 accept 回傳 EINTR）；寫到已關閉的連線不終止行程
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+
+    if(pipe(wake_fd) != 0 || set_nonblock(wake_fd[0]) != 0 || set_nonblock(wake_fd[1]) != 0 || set_nonblock(lfd) != 0){
+        log_error("huffd","pipe failed errno=%d", errno);
+        close(lfd); unlink(sock_path); return 2;
+    }
+
+    Worker *ws = (Worker*)calloc((size_t)nworkers, sizeof(Worker));
+    int started = 0;
+    for(int i=0;i<nworkers;i++){
+        ws[i].enc = huff_encoder_new(NULL);
+        ws[i].dec = huff_decoder_new(NULL);
+        if(!ws[i].enc || !ws[i].dec || pthread_create(&ws[i].th, NULL, worker_main, &ws[i]) != 0){
+            huff_encoder_free(ws[i].enc); huff_decoder_free(ws[i].dec);
+            break;
+        }
+        started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if(started == 0){ log_error("huffd","start workers failed"); close(lfd); unlink(sock_path); free(ws); return 2; }
+    nworkers = started;
+    log_info("huffd","start socket=%s workers=%d max_request=%zu idle_timeout=%d max_connections=%d",
+             sock_path, nworkers, max_request, idle_timeout, MAX_CONNS);
+    log_flush();
+
+    // pf[0] 為 listen socket，pf[1] 為叫醒用的 pipe，其後是不在工作執行緒手上的連線
+    Conn **conns = (Conn**)malloc(sizeof(Conn*)*MAX_CONNS);
+    struct pollfd *pf = (struct pollfd*)malloc(sizeof(struct pollfd)*(MAX_CONNS+2));
+    Conn **pc = (Conn**)malloc(sizeof(Conn*)*(MAX_CONNS+2));
+    int nconn = 0;
+    double t0 = metrics_now();
+    while(!stop_flag){
+        // 收回回應已寫完的連線
+        pthread_mutex_lock(&mu);
+        for(int i=0;i<ndone;i++){
+            done[i]->busy = false;
+            done[i]->last = now_sec();
+            if(!done[i]->keep) done[i]->dead = true;
+        }
+        ndone = 0;
+        pthread_mutex_unlock(&mu);
+        int m = 0;
+        for(int i=0;i<nconn;i++){
+            if(conns[i]->dead) conn_close(conns[i]);
+            else conns[m++] = conns[i];
+        }
+        nconn = m;
+
+        int np = 0;
+        pf[np].fd = lfd; pf[np].events = POLLIN; pf[np].revents = 0; np++;
+        pf[np].fd = wake_fd[0]; pf[np].events = POLLIN; pf[np].revents = 0; np++;
+        for(int i=0;i<nconn;i++){
+            if(conns[i]->busy) continue;
+            pc[np] = conns[i];
+            pf[np].fd = conns[i]->fd; pf[np].events = POLLIN; pf[np].revents = 0; np++;
+        }
+        int k = poll(pf, (nfds_t)np, 1000);
+        if(k < 0){
+            if(errno == EINTR) continue;
+            log_error("huffd","poll failed errno=%d", errno);
+            break;
+        }
+        if(pf[1].revents){
+            unsigned char buf[256];
+            while(read(wake_fd[0], buf, sizeof buf) > 0){}
+        }
+        double now = now_sec();
+        for(int i=2;i<np;i++){
+            Conn *c = pc[i];
+            if(pf[i].revents){
+                if(conn_read(c, now) != 0) c->dead = true;
+            }else if(now - c->last > idle_timeout){
+                c->dead = true;
+                pthread_mutex_lock(&st_mu);
+                st.timeouts++;
+                pthread_mutex_unlock(&st_mu);
+            }
+        }
+        if(pf[0].revents & POLLIN){
+            int fd = accept(lfd, NULL, NULL);
+            if(fd < 0){
+                if(errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED){
+                    log_error("huffd","accept failed errno=%d", errno);
+                    break;
+                }
+                continue;
+            }
+            Conn *c = nconn < MAX_CONNS && set_nonblock(fd) == 0 ? (Conn*)calloc(1, sizeof(Conn)) : NULL;
+            if(!c){ close(fd); log_warn("huffd","connections full connection_dropped=1"); continue; }
+            c->fd = fd; c->status = -1; c->last = now;
+            conns[nconn++] = c;
+            pthread_mutex_lock(&st_mu);
+            st.connections++;
+            pthread_mutex_unlock(&st_mu);
+        }
+    }
+    close(lfd);
+    unlink(sock_path);
+
+    // 不再讀新的請求；已讀滿的請求由工作執行緒處理並寫完回應後結束，再關閉所有連線
+    pthread_mutex_lock(&mu);
+    closing = true;
+    pthread_cond_broadcast(&cv);
+    pthread_mutex_unlock(&mu);
+    for(int i=0;i<nworkers;i++){
+        pthread_join(ws[i].th, NULL);
+        huff_encoder_free(ws[i].enc); huff_decoder_free(ws[i].dec);
+        free(ws[i].out);
+    }
+    for(int i=0;i<nconn;i++) conn_close(conns[i]);
+    close(wake_fd[0]); close(wake_fd[1]);
+    free(conns); free(pf); free(pc); free(ws);
+    metrics_stage("serve", t0);
+
+    char line[1024];
+    stats_text(line, sizeof line);
+    log_info("metrics","summary tool=huffd %s", line);
+    metrics_count("requests", st.requests);
+    metrics_count("errors", st.errors);
+    metrics_count("connections", st.connections);
+    metrics_count("idle_timeouts", st.timeouts);
+    metrics_count("bytes_in", st.bytes_in);
+    metrics_count("bytes_out", st.bytes_out);
+    int rc = metrics_report("huffd", metrics_fn) == 0 ? 0 : 4;
+    log_info("huffd","finish status=ok");
+    return rc;
+}
+#endif
+
+int main(int argc, char **argv){
+    const char *sock_path = NULL;
+    const char *metrics_fn = NULL;
+    bool bad = false;
+    nworkers = huff_cpu_count();
+    for(int i=1;i<argc;i++){
+        if(strncmp(argv[i], "--socket=", 9) == 0) sock_path = argv[i]+9;
+        else if(strncmp(argv[i], "--threads=", 10) == 0){ nworkers = atoi(argv[i]+10); if(nworkers < 1) bad = true; }
+        else if(strncmp(argv[i], "--max-request=", 14) == 0){
+            max_request = parse_size(argv[i]+14);
+            if(max_request == 0 || max_request > UINT32_MAX) bad = true;
+        }
+        else if(strncmp(argv[i], "--idle-timeout=", 15) == 0){
+            idle_timeout = atoi(argv[i]+15);
+            if(idle_timeout < 1 || idle_timeout > 86400) bad = true;
+        }
+        else if(strncmp(argv[i], "--metrics-json=", 15) == 0) metrics_fn = argv[i]+15;
+        else bad = true;
+    }
+    if(bad || !sock_path){
+        fprintf(stderr, "Usage: %s --socket=PATH [--threads=N] [--max-request=SIZE] [--idle-timeout=SEC] [--metrics-json=FILE]\n", argv[0]);
+        return 1;
+    }
+#ifdef HAVE_UNIX_SOCKET
+    return run(sock_path, metrics_fn);
+#else
+    (void)metrics_fn;
+    log_error("huffd","unsupported reason=no_unix_domain_socket");
+    return 1;
+#endif
+}
@@ -0,0 +1,38 @@
+#ifndef HUFFD_H
+#define HUFFD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* huffd：Unix domain socket 上的壓縮服務。一條連線上可連續送多個請求，依序回應。
+ * 請求：u8 op、u8[3] 0、u32 LE payload 長度、payload
+ * 回應：u8 status、u8[3] 0、u32 LE payload 長度、payload
+ *   HUFFD_OP_ENCODE：payload 為原始資料，回應 container 格式（與 encoder --format=container 相容）
+ *   HUFFD_OP_DECODE：payload 為 container，回應原始資料
+ *   HUFFD_OP_STATS ：payload 為空，回應一行 "key=value ..." 文字（計數器與延遲百分位數）
+ * status 0 成功；1..5 為 libhuff 的 -HUFF_E_*；其餘見 HUFFD_E_*。失敗時 payload 為空。 */
+
+#define HUFFD_FRAME_BYTES 8
+#define HUFFD_DEFAULT_MAX_REQUEST (64u<<20)
+
+enum {
+    HUFFD_OP_ENCODE = 1,
+    HUFFD_OP_DECODE = 2,
+    HUFFD_OP_STATS  = 3
+};
+
+enum {
+    HUFFD_OK        = 0,
+    HUFFD_E_OP      = 16,   // 未知的 op
+    HUFFD_E_TOO_BIG = 17    // payload 超過伺服器的 --max-request（連線隨後關閉）
+};
+
+static inline void huffd_frame_encode(unsigned char *p, int code, uint32_t len){
+    p[0] = (unsigned char)code; p[1] = p[2] = p[3] = 0;
+    for (int i=0;i<4;i++) p[4+i] = (unsigned char)(len >> (8*i));
+}
+static inline uint32_t huffd_frame_len(const unsigned char *p){
+    return (uint32_t)p[4] | (uint32_t)p[5] << 8 | (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+}
+
+#endif
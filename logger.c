@@ -1,10 +1,48 @@
+#define _POSIX_C_SOURCE 200809L
 #include "logger.h"
 #include <time.h>
 #include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
 
-static void timestamp_now(char buf[20]) {
-    // 產生 YYYY-MM-DD HH:MM:SS
+/* INFO / WARN 先寫進記憶體緩衝，緩衝滿、程式結束（atexit）、切換輸出或遇到 ERROR 時才一次寫出；
+ * ERROR 先清空緩衝（保持順序）再立即寫到 stderr。時間戳每秒只格式化一次。 */
+#define LOG_BUF_SIZE (64*1024)
+#define LOG_LINE_MAX 2048
+
+static FILE *info_out = NULL;   // NULL 表示 stdout
+static char log_buf[LOG_BUF_SIZE];
+static size_t log_len = 0;
+static FILE *buf_out = NULL;    // log_buf 內容的目的地
+static pthread_mutex_t log_mu = PTHREAD_MUTEX_INITIALIZER;
+static int atexit_done = 0;
+static time_t ts_sec = (time_t)-1;
+static char ts_str[20];
+
+static void flush_locked(void) {
+    if (log_len && buf_out) fwrite(log_buf, 1, log_len, buf_out);
+    if (buf_out) fflush(buf_out);
+    log_len = 0;
+}
+
+void log_flush(void) {
+    pthread_mutex_lock(&log_mu);
+    flush_locked();
+    pthread_mutex_unlock(&log_mu);
+}
+
+void log_set_output(FILE *out) {
+    pthread_mutex_lock(&log_mu);
+    flush_locked();
+    info_out = out;
+    pthread_mutex_unlock(&log_mu);
+}
+
+static void timestamp_now(void) {
+    // 產生 YYYY-MM-DD HH:MM:SS；同一秒內沿用上次的字串
     time_t t = time(NULL);
+    if (t == ts_sec) return;
+    ts_sec = t;
     struct tm lt;
 
 #if defined(_MSC_VER)
@@ -19,31 +57,55 @@ static void timestamp_now(char buf[20]) {
     if (tmp) lt = *tmp;
 #endif
 
-    strftime(buf, 20, "%Y-%m-%d %H:%M:%S", &lt);
+    strftime(ts_str, sizeof ts_str, "%Y-%m-%d %H:%M:%S", &lt);
 }
 
 static void vlog_emit(const char *level, const char *component,
-                      const char *fmt, va_list ap, FILE *out) {
-    char ts[20];
-    timestamp_now(ts);
-    fprintf(out, "%s [%s] %s: ", ts, level, component);
-    vfprintf(out, fmt, ap);
-    fputc('\n', out);
-    fflush(out);
+                      const char *fmt, va_list ap, FILE *out, int sync) {
+    char line[LOG_LINE_MAX];
+    pthread_mutex_lock(&log_mu);
+    if (!atexit_done) { atexit(log_flush); atexit_done = 1; }
+    timestamp_now();
+    int h = snprintf(line, sizeof line, "%s [%s] %s: ", ts_str, level, component);
+    va_list aq;
+    va_copy(aq, ap);
+    int b = vsnprintf(line + h, sizeof line - (size_t)h, fmt, aq);
+    va_end(aq);
+
+    if (sync || out != buf_out) flush_locked();
+    if (b < 0 || (size_t)h + (size_t)b + 1 >= sizeof line) {
+        // 過長的一行不經緩衝，先清空緩衝再直接寫出
+        flush_locked();
+        fwrite(line, 1, (size_t)h, out);
+        vfprintf(out, fmt, ap);
+        fputc('\n', out);
+    } else if (sync) {
+        line[h+b] = '\n';
+        fwrite(line, 1, (size_t)(h+b+1), out);
+    } else {
+        size_t n = (size_t)(h+b+1);
+        line[h+b] = '\n';
+        buf_out = out;
+        if (log_len + n > LOG_BUF_SIZE) flush_locked();
+        memcpy(log_buf + log_len, line, n);
+        log_len += n;
+    }
+    if (sync) fflush(out);
+    pthread_mutex_unlock(&log_mu);
 }
 
 void log_info (const char *component, const char *fmt, ...) {
     va_list ap; va_start(ap, fmt);
-    vlog_emit("INFO", component, fmt, ap, stdout);
+    vlog_emit("INFO", component, fmt, ap, info_out ? info_out : stdout, 0);
     va_end(ap);
 }
 void log_warn (const char *component, const char *fmt, ...) {
     va_list ap; va_start(ap, fmt);
-    vlog_emit("WARN", component, fmt, ap, stdout);
+    vlog_emit("WARN", component, fmt, ap, info_out ? info_out : stdout, 0);
     va_end(ap);
 }
 void log_error(const char *component, const char *fmt, ...) {
     va_list ap; va_start(ap, fmt);
-    vlog_emit("ERROR", component, fmt, ap, stderr);
+    vlog_emit("ERROR", component, fmt, ap, stderr, 1);
     va_end(ap);
 }
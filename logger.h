@@ -7,5 +7,9 @@
 void log_info (const char *component, const char *fmt, ...);
 void log_warn (const char *component, const char *fmt, ...);
 void log_error(const char *component, const char *fmt, ...);
+/* INFO / WARN 的輸出目的地（預設 stdout；資料走 stdout 時改成 stderr） */
+void log_set_output(FILE *out);
+/* INFO / WARN 經記憶體緩衝，程式結束或 ERROR 時才寫出；需要立即看到時呼叫 */
+void log_flush(void);
 
 #endif
@@ -0,0 +1,60 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include "mapio.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int mf_open_read(const char *fn, MappedFile *m) {
+    struct stat st;
+    m->data = NULL; m->size = 0; m->fd = -1;
+    int fd = open(fn, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) { close(fd); return -1; }
+    m->fd = fd;
+    m->size = (size_t)st.st_size;
+    if (m->size == 0) return 0;
+    void *p = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) { close(fd); m->fd = -1; m->size = 0; return -1; }
+    posix_madvise(p, m->size, POSIX_MADV_SEQUENTIAL);
+    m->data = (unsigned char*)p;
+    return 0;
+}
+
+int mf_create(const char *fn, size_t size, MappedFile *m) {
+    m->data = NULL; m->size = 0; m->fd = -1;
+    int fd = open(fn, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)size) != 0) { close(fd); return -1; }
+    m->fd = fd;
+    m->size = size;
+    if (size == 0) return 0;
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) { close(fd); m->fd = -1; m->size = 0; return -1; }
+    posix_madvise(p, size, POSIX_MADV_SEQUENTIAL);
+    m->data = (unsigned char*)p;
+    return 0;
+}
+
+int mf_close(MappedFile *m) {
+    int rc = 0;
+    if (m->data && munmap(m->data, m->size) != 0) rc = -1;
+    if (m->fd >= 0 && close(m->fd) != 0) rc = -1;
+    m->data = NULL; m->size = 0; m->fd = -1;
+    return rc;
+}
+
+int mf_truncate(const char *fn, size_t size) {
+    return truncate(fn, (off_t)size) == 0 ? 0 : -1;
+}
+
+#else
+// 其他平台：一律退回 stdio
+int mf_open_read(const char *fn, MappedFile *m) { (void)fn; m->data = NULL; m->size = 0; m->fd = -1; return -1; }
+int mf_create(const char *fn, size_t size, MappedFile *m) { (void)fn; (void)size; m->data = NULL; m->size = 0; m->fd = -1; return -1; }
+int mf_close(MappedFile *m) { m->data = NULL; m->size = 0; m->fd = -1; return 0; }
+int mf_truncate(const char *fn, size_t size) { (void)size; return remove(fn) == 0 ? 0 : -1; }
+#endif
@@ -0,0 +1,23 @@
+#ifndef MAPIO_H
+#define MAPIO_H
+
+#include <stddef.h>
+
+/* 記憶體映射檔案：輸入以唯讀映射並提示循序讀取，輸出先預留大小再映射寫入。
+ * 不支援映射的平台或非一般檔案（pipe、終端機…）回傳 -1，由呼叫端改走 stdio。 */
+typedef struct {
+    unsigned char *data;    // size 為 0 時為 NULL
+    size_t size;
+    int fd;
+} MappedFile;
+
+/* 映射既有檔案供讀取；回傳 0 成功，-1 無法映射 */
+int  mf_open_read(const char *fn, MappedFile *m);
+/* 建立（或截斷）檔案為 size 位元組並映射供寫入；回傳 0 成功，-1 無法映射 */
+int  mf_create(const char *fn, size_t size, MappedFile *m);
+/* 解除映射並關閉；回傳 0 成功，-1 失敗 */
+int  mf_close(MappedFile *m);
+/* 把（已關閉的）檔案截成 size 位元組，解碼失敗時只留下已驗證的前段；不支援的平台改為刪除檔案。回傳 0 成功，-1 失敗 */
+int  mf_truncate(const char *fn, size_t size);
+
+#endif
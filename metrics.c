@@ -0,0 +1,82 @@
+#define _POSIX_C_SOURCE 200809L
+#include "metrics.h"
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define METRICS_MAX 32
+
+typedef struct { const char *name; double sec; long long calls; } Stage;
+typedef struct { const char *name; long long value; } Counter;
+
+static Stage stages[METRICS_MAX];
+static int nstages = 0;
+static Counter counters[METRICS_MAX];
+static int ncounters = 0;
+static double t_start = -1.0;
+
+double metrics_now(void) {
+    struct timespec ts;
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    double t = (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+    if (t_start < 0) t_start = t;     // 第一次取時間視為程式起點
+    return t;
+}
+
+void metrics_stage(const char *stage, double t0) {
+    double dt = metrics_now() - t0;
+    int i = 0;
+    while (i < nstages && strcmp(stages[i].name, stage) != 0) i++;
+    if (i == nstages) {
+        if (nstages == METRICS_MAX) return;
+        stages[nstages].name = stage; stages[nstages].sec = 0; stages[nstages].calls = 0;
+        nstages++;
+    }
+    stages[i].sec += dt;
+    stages[i].calls++;
+}
+
+void metrics_count(const char *counter, long long delta) {
+    int i = 0;
+    while (i < ncounters && strcmp(counters[i].name, counter) != 0) i++;
+    if (i == ncounters) {
+        if (ncounters == METRICS_MAX) return;
+        counters[ncounters].name = counter; counters[ncounters].value = 0;
+        ncounters++;
+    }
+    counters[i].value += delta;
+}
+
+int metrics_report(const char *tool, const char *json_fn) {
+    char line[2048];
+    size_t n = 0;
+    double total = t_start < 0 ? 0.0 : metrics_now() - t_start;
+    for (int i=0;i<nstages && n < sizeof line;i++)
+        n += (size_t)snprintf(line+n, sizeof line-n, "%s_ms=%.3f ", stages[i].name, stages[i].sec*1e3);
+    if (n < sizeof line) snprintf(line+n, sizeof line-n, "total_ms=%.3f", total*1e3);
+    log_info("metrics","stages tool=%s %s", tool, line);
+
+    n = 0; line[0] = '\0';
+    for (int i=0;i<ncounters && n < sizeof line;i++)
+        n += (size_t)snprintf(line+n, sizeof line-n, "%s%s=%lld", i ? " " : "", counters[i].name, counters[i].value);
+    log_info("metrics","counters tool=%s %s", tool, line);
+
+    if (!json_fn) return 0;
+    FILE *f = fopen(json_fn, "w");
+    if (!f) { log_error("metrics","open json failed file=%s", json_fn); return -1; }
+    fprintf(f, "{\"tool\":\"%s\",\"total_ms\":%.3f,\"stages\":{", tool, total*1e3);
+    for (int i=0;i<nstages;i++)
+        fprintf(f, "%s\"%s\":{\"ms\":%.3f,\"calls\":%lld}", i ? "," : "", stages[i].name, stages[i].sec*1e3, stages[i].calls);
+    fprintf(f, "},\"counters\":{");
+    for (int i=0;i<ncounters;i++)
+        fprintf(f, "%s\"%s\":%lld", i ? "," : "", counters[i].name, counters[i].value);
+    fprintf(f, "}}\n");
+    if (fclose(f) != 0) { log_error("metrics","write json failed file=%s", json_fn); return -1; }
+    log_info("metrics","write_json file=%s", json_fn);
+    return 0;
+}
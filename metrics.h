@@ -0,0 +1,17 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/* 各階段計時與計數器：以單調時鐘累計每個階段的耗時與次數，
+ * 結束時以一行 log 輸出，並可另存成 JSON。只供主執行緒使用。 */
+
+/* 單調時鐘（秒） */
+double metrics_now(void);
+/* 將 metrics_now() - t0 累計到 stage（名稱須為常數字串） */
+void metrics_stage(const char *stage, double t0);
+/* 計數器累加 delta（名稱須為常數字串） */
+void metrics_count(const char *counter, long long delta);
+/* 輸出 "metrics stages ..." 與 "metrics counters ..." 兩行 log；
+ * json_fn 非 NULL 時另寫成 JSON 檔。回傳 0 成功，-1 JSON 檔寫入失敗 */
+int metrics_report(const char *tool, const char *json_fn);
+
+#endif
@@ -0,0 +1,254 @@
+#include "huff.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* ---------- tANS（table-based asymmetric numeral systems） ----------
+ * 狀態表大小 T = 1<<table_log，符號 s 佔 norm[s] 個狀態。編碼由最後一個符號往前處理、
+ * 位元往前寫（LSB 先）；解碼由位元串尾端往回讀，符號依原順序輸出。
+ * 兩個狀態輪流處理偶數 / 奇數位置的符號，解碼時兩條相依鏈可重疊執行。 */
+
+#define TANS_STATES 2
+
+static int highbit32(uint32_t v){ return 31 - __builtin_clz(v); }
+
+static void put_le(unsigned char *p, uint64_t v, int n) {
+    for (int i=0;i<n;i++) p[i] = (unsigned char)(v >> (8*i));
+}
+static uint64_t get_le(const unsigned char *p, int n) {
+    uint64_t v = 0;
+    for (int i=n-1;i>=0;i--) v = (v<<8) | p[i];
+    return v;
+}
+/* 8 bytes 讀寫：little-endian 主機直接以 memcpy 存取，其餘逐 byte 組合 */
+static inline uint64_t load_le64(const unsigned char *p){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t v; memcpy(&v, p, 8); return v;
+#else
+    return get_le(p, 8);
+#endif
+}
+static inline void store_le64(unsigned char *p, uint64_t v){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(p, &v, 8);
+#else
+    put_le(p, v, 8);
+#endif
+}
+
+/* ---------- 正規化 ---------- */
+int huff_tans_normalize(const long long *freq, int table_log, HuffTansModel *m){
+    if (table_log < HUFF_TANS_MIN_LOG || table_log > HUFF_TANS_MAX_LOG) return -1;
+    long long total = 0;
+    int present = 0;
+    for (int s=0;s<HUFF_ALPHABET;s++) { total += freq[s]; present += freq[s] > 0; }
+    const int T = 1 << table_log;
+    if (present > T) return -1;
+    m->table_log = table_log;
+    memset(m->norm, 0, sizeof m->norm);
+    if (total == 0) return 0;
+
+    // 先依比例無條件捨去（出現過的至少 1 份），差額逐份交給增減後編碼成本變化最有利的符號：
+    // 符號 s 由 n 份改成 n±1 份，成本改變 freq[s]*log2(n/(n±1)) 位元
+    int sum = 0;
+    for (int s=0;s<HUFF_ALPHABET;s++) {
+        if (!freq[s]) continue;
+        long long n = (long long)((double)freq[s] * T / (double)total);
+        if (n < 1) n = 1;
+        m->norm[s] = (uint16_t)n;
+        sum += (int)n;
+    }
+    for (; sum != T; sum += sum < T ? 1 : -1) {
+        int best = -1;
+        double best_d = 0;
+        for (int s=0;s<HUFF_ALPHABET;s++) {
+            int n = m->norm[s];
+            if (!n || (sum > T && n == 1)) continue;
+            double d = sum < T ? (double)freq[s] * log2((double)(n+1)/n)       // 加一份省下的位元
+                               : -(double)freq[s] * log2((double)n/(n-1));     // 減一份多花的位元
+            if (best < 0 || d > best_d) { best = s; best_d = d; }
+        }
+        if (best < 0) return -1;
+        m->norm[best] = (uint16_t)(m->norm[best] + (sum < T ? 1 : -1));
+    }
+    return 0;
+}
+
+/* ---------- 模型序列化：u8 table_log、u8[32] 符號 bitmap、出現符號的 u16 LE 份數 ---------- */
+size_t huff_tans_model_size(const HuffTansModel *m){
+    size_t n = 1 + 32;
+    for (int s=0;s<HUFF_ALPHABET;s++) n += m->norm[s] ? 2 : 0;
+    return n;
+}
+
+void huff_tans_model_encode(const HuffTansModel *m, unsigned char *dst){
+    dst[0] = (unsigned char)m->table_log;
+    memset(dst+1, 0, 32);
+    unsigned char *p = dst + 33;
+    for (int s=0;s<HUFF_ALPHABET;s++) {
+        if (!m->norm[s]) continue;
+        dst[1 + (s>>3)] |= (unsigned char)(1u << (s&7));
+        put_le(p, m->norm[s], 2); p += 2;
+    }
+}
+
+long huff_tans_model_decode(const unsigned char *p, size_t n, HuffTansModel *m){
+    if (n < 33) return -1;
+    m->table_log = p[0];
+    if (m->table_log < HUFF_TANS_MIN_LOG || m->table_log > HUFF_TANS_MAX_LOG) return -1;
+    size_t off = 33;
+    long sum = 0;
+    for (int s=0;s<HUFF_ALPHABET;s++) {
+        m->norm[s] = 0;
+        if (!((p[1 + (s>>3)] >> (s&7)) & 1)) continue;
+        if (off + 2 > n) return -1;
+        m->norm[s] = (uint16_t)get_le(p + off, 2);
+        if (!m->norm[s]) return -1;
+        sum += m->norm[s];
+        off += 2;
+    }
+    // 空輸入時沒有任何符號
+    if (sum != 0 && sum != 1L << m->table_log) return -1;
+    return (long)off;
+}
+
+/* ---------- 狀態表 ---------- */
+static void tans_spread(const HuffTansModel *m, uint8_t *sym){
+    const int T = 1 << m->table_log, mask = T - 1, step = (T>>1) + (T>>3) + 3;
+    int pos = 0;
+    for (int s=0;s<HUFF_ALPHABET;s++)
+        for (int i=0;i<m->norm[s];i++) { sym[pos] = (uint8_t)s; pos = (pos + step) & mask; }
+}
+
+typedef struct { uint32_t delta_nb; int32_t delta_find; } TansSym;
+
+size_t huff_tans_bound(size_t n, int table_log){
+    // 每個符號最多 table_log 位元，另加兩個最終狀態與 8 bytes 的寫出餘裕
+    return n*(size_t)table_log/8 + 2*(size_t)table_log/8 + 16;
+}
+
+long long huff_tans_encode(const HuffTansModel *m, const unsigned char *src, size_t n,
+                           unsigned char *dst, size_t cap){
+    const int L = m->table_log, T = 1 << L;
+    uint8_t sym[1 << HUFF_TANS_MAX_LOG];
+    uint16_t next[1 << HUFF_TANS_MAX_LOG];
+    int cumul[HUFF_ALPHABET+1];
+    TansSym tt[HUFF_ALPHABET];
+    if (cap < 16) return -1;
+    tans_spread(m, sym);
+    cumul[0] = 0;
+    for (int s=0;s<HUFF_ALPHABET;s++) cumul[s+1] = cumul[s] + m->norm[s];
+    if (n && cumul[HUFF_ALPHABET] != T) return -1;
+    for (int u=0;u<T && n;u++) next[cumul[sym[u]]++] = (uint16_t)(T + u);
+    int total = 0;
+    for (int s=0;s<HUFF_ALPHABET;s++) {
+        int c = m->norm[s];
+        if (c == 0) { tt[s].delta_nb = 0; tt[s].delta_find = 0; continue; }
+        int max_out = c > 1 ? L - highbit32((uint32_t)(c-1)) : L;
+        tt[s].delta_nb = ((uint32_t)max_out << 16) - ((uint32_t)c << max_out);
+        tt[s].delta_find = total - c;
+        total += c;
+    }
+
+    uint64_t acc = 0;
+    int nb = 0;
+    size_t pos = 0, limit = cap - 8;
+    uint32_t x[TANS_STATES] = { (uint32_t)T, (uint32_t)T };
+    for (size_t i=n;i-->0;) {
+        uint32_t *st = &x[i & 1];
+        const TansSym *t = &tt[src[i]];
+        if (!m->norm[src[i]]) return -1;
+        int k = (int)((*st + t->delta_nb) >> 16);
+        acc |= (uint64_t)(*st & ((1u << k) - 1)) << nb;
+        nb += k;
+        *st = next[(int)(*st >> k) + t->delta_find];
+        // 每兩個符號（最多 7 + 2*12 位元）寫出一次：一次寫 8 bytes，只前進完整的部分
+        if (i & 1) continue;
+        if (pos > limit) return -1;
+        store_le64(dst + pos, acc);
+        pos += (size_t)(nb >> 3);
+        acc >>= (nb & ~7);
+        nb &= 7;
+    }
+    // 最終狀態（先奇後偶，解碼時先讀到偶數狀態）與結尾的哨兵位元
+    for (int j=TANS_STATES-1;j>=0;j--) {
+        acc |= (uint64_t)(x[j] - (uint32_t)T) << nb;
+        nb += L;
+        if (pos > limit) return -1;
+        store_le64(dst + pos, acc);
+        pos += (size_t)(nb >> 3);
+        acc >>= (nb & ~7);
+        nb &= 7;
+    }
+    acc |= 1ull << nb;
+    nb++;
+    if (pos + (size_t)((nb + 7) >> 3) > cap) return -1;
+    put_le(dst + pos, acc, (nb + 7) >> 3);
+    return (long long)(pos + (size_t)((nb + 7) >> 3));
+}
+
+/* ---------- 解碼 ---------- */
+typedef struct { uint16_t new_state; uint8_t symbol, nb; } TansDEntry;
+
+/* 由位元位置 p 往回讀 k 位元（p 先減 k），k <= HUFF_TANS_MAX_LOG。
+ * 快速版一次讀 8 bytes，呼叫端須保證 (p>>3) + 8 <= 位元串長度 */
+static inline uint32_t tans_read_fast(const unsigned char *src, long long *p, int k){
+    *p -= k;
+    return (uint32_t)(load_le64(src + (*p >> 3)) >> (*p & 7)) & ((1u << k) - 1);
+}
+static inline uint32_t tans_read(const unsigned char *src, size_t len, long long *p, int k){
+    *p -= k;
+    size_t o = (size_t)(*p >> 3);
+    uint64_t w = get_le(src + o, o + 8 <= len ? 8 : (int)(len - o));
+    return (uint32_t)(w >> (*p & 7)) & ((1u << k) - 1);
+}
+
+long long huff_tans_decode(const HuffTansModel *m, const unsigned char *src, size_t srclen,
+                           unsigned char *dst, size_t n){
+    const int L = m->table_log, T = 1 << L;
+    uint8_t sym[1 << HUFF_TANS_MAX_LOG];
+    TansDEntry dt[1 << HUFF_TANS_MAX_LOG];
+    uint32_t next[HUFF_ALPHABET];
+    if (srclen == 0 || src[srclen-1] == 0) return -1;
+    long sum = 0;
+    for (int s=0;s<HUFF_ALPHABET;s++) { next[s] = m->norm[s]; sum += m->norm[s]; }
+    if (sum != T) return n ? -1 : 0;
+    tans_spread(m, sym);
+    for (int u=0;u<T;u++) {
+        uint32_t v = next[sym[u]]++;
+        int k = L - highbit32(v);
+        dt[u].symbol = sym[u];
+        dt[u].nb = (uint8_t)k;
+        dt[u].new_state = (uint16_t)((v << k) - (uint32_t)T);
+    }
+
+    // 哨兵：最後一個 byte 最高的 1 位元
+    long long p = (long long)(srclen-1)*8 + highbit32(src[srclen-1]);
+    if (p < 2LL*L) return -1;
+    uint32_t x0 = tans_read(src, srclen, &p, L);
+    uint32_t x1 = tans_read(src, srclen, &p, L);
+    size_t i = 0;
+    // 位元串結尾 8 bytes 內逐次檢查讀取範圍；之後每對符號最多讀 2L 位元，剩餘位元足夠時不必逐次檢查
+    const long long fast_from = srclen >= 8 ? (long long)(srclen - 8) * 8 : 0;
+    for (; i+1 < n && p > fast_from && p >= 2LL*L; i += 2) {
+        const TansDEntry *a = &dt[x0], *b = &dt[x1];
+        dst[i] = a->symbol; dst[i+1] = b->symbol;
+        x0 = a->new_state + tans_read(src, srclen, &p, a->nb);
+        x1 = b->new_state + tans_read(src, srclen, &p, b->nb);
+    }
+    for (; i+1 < n && p >= 2LL*L; i += 2) {
+        const TansDEntry *a = &dt[x0], *b = &dt[x1];
+        dst[i] = a->symbol; dst[i+1] = b->symbol;
+        x0 = a->new_state + tans_read_fast(src, &p, a->nb);
+        x1 = b->new_state + tans_read_fast(src, &p, b->nb);
+    }
+    for (; i < n; i++) {
+        uint32_t *x = (i & 1) ? &x1 : &x0;
+        const TansDEntry *e = &dt[*x];
+        if (p < e->nb) return -1;
+        dst[i] = e->symbol;
+        *x = e->new_state + tans_read(src, srclen, &p, e->nb);
+    }
+    // 位元必須剛好用完，兩個狀態也回到編碼起點
+    return (p == 0 && x0 == 0 && x1 == 0) ? 0 : -1;
+}